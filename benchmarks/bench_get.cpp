@@ -0,0 +1,297 @@
+//Loopback benchmark of async_http_get against the in-process test server.
+//
+//Every scenario runs a closed loop: `concurrency` threads issue requests back to back
+//until `requests` have completed. Reported per scenario:
+// - requests per second
+// - latency percentiles seen by the caller
+// - client CPU per request: process CPU minus the CPU of the server threads
+// - client allocations per request: operator new calls outside the server threads
+// - warm connections: percentage of requests that found an open connection in the pool
+//
+//Scenarios open a connection per request, except the +pool ones, which reuse kept alive
+//connections, and +prewarm, which also opens them before the first request.
+//
+//Scenarios with a +<option> suffix repeat fixed-16KiB with that socket option set in the client,
+//or, for +nagle, with TCP_NODELAY unset.
+//
+//Scenarios with a +prepared or +prep suffix send a prepared_request built once, which keeps the
+//request bytes and the resolved endpoints, instead of host and resource.
+//
+//Scenarios named tiny-* get bodies small enough to be kept inline in the response, through
+//pooled connections, and fail if the client allocates more per request than they allow.
+//
+//Scenarios named unix-* serve the same responses as their fixed-* counterparts through a
+//Unix domain socket instead of loopback TCP.
+//
+//Takes the options of bench_support.hpp.
+
+#include "bench_support.hpp"
+#include "gdg/srl/srl.hpp"
+#include "gdg/srl/testing/http_server.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace srl = gdg::srl;
+using namespace std;
+
+namespace {
+
+srl::client_options connection_per_request(srl::socket_options socket = {}) {
+    srl::client_options options;
+    options.socket = socket;
+    options.reuseConnections = false;
+    return options;
+}
+
+
+srl::client_options pooled() {
+    return {};
+}
+
+
+srl::client_options adaptive(srl::limit_algorithm algorithm) {
+    auto options = pooled();
+    options.scheduler.adaptiveLimit.algorithm = algorithm;
+    options.scheduler.adaptiveLimit.initialLimit = 4;
+    return options;
+}
+
+
+struct scenario {
+    string name;
+    srl::testing::http_server_options server;
+    size_t concurrency;
+    size_t requests;
+    srl::client_options client = connection_per_request();
+    //Connections opened before the first request
+    size_t prewarm = 0;
+    bool prepared = false;
+    //Client allocations per request above which the scenario fails, zero for no limit
+    double maxAllocations = 0;
+};
+
+
+chrono::nanoseconds process_cpu_time() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+        + chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+
+srl::testing::http_server_options fixed(size_t bodySize) {
+    srl::testing::http_server_options options;
+    options.bodySize = bodySize;
+    return options;
+}
+
+
+srl::testing::http_server_options chunked(size_t bodySize) {
+    auto options = fixed(bodySize);
+    options.chunked = true;
+    return options;
+}
+
+
+srl::testing::http_server_options unix_socket(size_t bodySize) {
+    auto options = fixed(bodySize);
+    options.unixSocketPath = "/tmp/srl-bench-" + to_string(getpid()) + ".sock";
+    return options;
+}
+
+
+srl::testing::http_server_options delayed(size_t bodySize, chrono::microseconds latency) {
+    auto options = fixed(bodySize);
+    options.latency = latency;
+    return options;
+}
+
+
+srl::socket_options nagle() {
+    srl::socket_options options;
+    options.noDelay = false;
+    return options;
+}
+
+
+srl::socket_options small_buffers() {
+    srl::socket_options options;
+    options.receiveBufferSize = 8 * 1024;
+    options.sendBufferSize = 8 * 1024;
+    return options;
+}
+
+
+srl::socket_options quick_ack() {
+    srl::socket_options options;
+    options.quickAck = true;
+    return options;
+}
+
+
+srl::socket_options busy_poll() {
+    srl::socket_options options;
+    options.busyPollMicroseconds = 50;
+    return options;
+}
+
+
+srl::socket_options fast_open() {
+    srl::socket_options options;
+    options.fastOpen = true;
+    return options;
+}
+
+
+srl::socket_options keep_alive() {
+    srl::socket_options options;
+    options.keepAliveIdle = chrono::seconds(60);
+    options.keepAliveInterval = chrono::seconds(10);
+    options.keepAliveCount = 3;
+    return options;
+}
+
+
+//Returns false if the scenario went over its allocation limit
+bool run(scenario const & s) {
+    srl::testing::http_server server(s.server);
+    srl::net::io_service io;
+    srl::net::io_service::work work{io};
+    thread loop([&io] { io.run(); });
+    srl::client client(io, s.client);
+    srl::prepared_request const request(server.host(), "/");
+    if (s.prewarm)
+        client.prewarm(server.host(), s.prewarm).get();
+
+    //Warm up resolver, allocator and server
+    for (int i = 0; i < 10; ++i)
+        client.async_http_get(server.host(), "/").get();
+
+    atomic<long> remaining{static_cast<long>(s.requests)};
+    atomic<size_t> errors{0};
+    vector<srl::latency_histogram> latencies(s.concurrency);
+    vector<thread> callers;
+
+    auto const poolBefore = client.pool_stats();
+    auto const allocationsBefore = bench::allocations().load();
+    auto const cpuBefore = process_cpu_time();
+    auto const serverCpuBefore = server.cpu_time();
+    auto const start = chrono::steady_clock::now();
+    for (size_t i = 0; i < s.concurrency; ++i) {
+        callers.emplace_back([&, i] {
+                while (remaining.fetch_sub(1) > 0) {
+                    auto const requestStart = chrono::steady_clock::now();
+                    try {
+                        if (s.prepared)
+                            client.async_http_get(request, chrono::seconds(10)).get();
+                        else
+                            client.async_http_get(server.host(), "/", chrono::seconds(10)).get();
+                    }
+                    catch (...) {
+                        ++errors;
+                    }
+                    latencies[i].record(chrono::steady_clock::now() - requestStart);
+                }
+            });
+    }
+    for (auto & t : callers)
+        t.join();
+    auto const elapsed = chrono::steady_clock::now() - start;
+    auto const clientCpu = (process_cpu_time() - cpuBefore) - (server.cpu_time() - serverCpuBefore);
+    auto const allocations = bench::allocations().load() - allocationsBefore;
+    auto const warmHits = client.pool_stats().warmHits - poolBefore.warmHits;
+
+    io.stop();
+    loop.join();
+
+    srl::latency_histogram latency;
+    for (auto const & h : latencies)
+        latency.merge(h);
+    auto const us = [](chrono::nanoseconds d) { return d.count() / 1000.0; };
+    auto const requests = static_cast<double>(s.requests);
+    printf("%-22s %5zu %8zu %10.0f %9.1f %9.1f %9.1f %9.1f %10.1f %8.1f %6.1f %6zu\n",
+           s.name.c_str(), s.concurrency, s.requests,
+           requests / chrono::duration<double>(elapsed).count(),
+           us(latency.percentile(50)), us(latency.percentile(90)),
+           us(latency.percentile(99)), us(latency.percentile(99.9)),
+           us(clientCpu) / requests,
+           allocations / requests,
+           100 * warmHits / requests,
+           errors.load());
+    fflush(stdout);
+    if (s.maxAllocations && allocations / requests > s.maxAllocations) {
+        fprintf(stderr, "%s: %.1f allocations per request, over the limit of %.1f\n",
+                s.name.c_str(), allocations / requests, s.maxAllocations);
+        return false;
+    }
+    return true;
+}
+
+
+char const * io_backend() {
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL) \
+    || defined(ASIO_HAS_IO_URING) && defined(ASIO_DISABLE_EPOLL)
+    return "io_uring";
+#elif defined(__linux__)
+    return "epoll";
+#else
+    return "default reactor";
+#endif
+}
+
+} //anon namespace
+
+
+int main(int argc, char ** argv) {
+    auto const options = bench::parse_options(argc, argv);
+    vector<scenario> const scenarios = {
+        {"fixed-128B", fixed(128), 1, 2000},
+        {"fixed-128B", fixed(128), 16, 4000},
+        {"tiny-16B+pool", fixed(16), 1, 2000, pooled(), 0, false, 22},
+        {"tiny-16B+pool+prep", fixed(16), 1, 2000, pooled(), 0, true, 22},
+        {"tiny-chunked-64B+pool", chunked(64), 1, 2000, pooled(), 0, false, 22},
+        {"fixed-128B+pool", fixed(128), 1, 2000, pooled()},
+        {"fixed-128B+pool", fixed(128), 16, 4000, pooled()},
+        {"fixed-128B+prewarm", fixed(128), 16, 4000, pooled(), 16},
+        {"fixed-128B+prepared", fixed(128), 16, 4000, connection_per_request(), 0, true},
+        {"fixed-128B+pool+prep", fixed(128), 16, 4000, pooled(), 0, true},
+        {"unix-128B", unix_socket(128), 1, 2000},
+        {"unix-128B", unix_socket(128), 16, 4000},
+        {"fixed-16KiB", fixed(16 * 1024), 1, 2000},
+        {"fixed-16KiB", fixed(16 * 1024), 16, 4000},
+        {"fixed-16KiB+nagle", fixed(16 * 1024), 16, 4000, connection_per_request(nagle())},
+        {"fixed-16KiB+8KiB-bufs", fixed(16 * 1024), 16, 4000, connection_per_request(small_buffers())},
+        {"fixed-16KiB+quickack", fixed(16 * 1024), 16, 4000, connection_per_request(quick_ack())},
+        {"fixed-16KiB+busy-poll", fixed(16 * 1024), 16, 4000, connection_per_request(busy_poll())},
+        {"fixed-16KiB+fastopen", fixed(16 * 1024), 16, 4000, connection_per_request(fast_open())},
+        {"fixed-16KiB+keepalive", fixed(16 * 1024), 16, 4000, connection_per_request(keep_alive())},
+        {"unix-16KiB", unix_socket(16 * 1024), 1, 2000},
+        {"unix-16KiB", unix_socket(16 * 1024), 16, 4000},
+        {"fixed-1MiB", fixed(1024 * 1024), 4, 200},
+        {"chunked-16KiB", chunked(16 * 1024), 16, 4000},
+        {"fixed-128B+1ms", delayed(128, chrono::milliseconds(1)), 64, 4000},
+        {"fixed-128B+1ms+aimd", delayed(128, chrono::milliseconds(1)), 64, 4000,
+         adaptive(srl::limit_algorithm::aimd)},
+        {"fixed-128B+1ms+grad2", delayed(128, chrono::milliseconds(1)), 64, 4000,
+         adaptive(srl::limit_algorithm::gradient2)},
+    };
+
+    printf("io backend: %s\n", io_backend());
+    printf("%-22s %5s %8s %10s %9s %9s %9s %9s %10s %8s %6s %6s\n",
+           "scenario", "conc", "requests", "req/s", "p50(us)", "p90(us)", "p99(us)",
+           "p99.9(us)", "cpu/req(us)", "allocs", "warm%", "errors");
+    bool withinLimits = true;
+    for (auto s : scenarios) {
+        if (!options.selected(s.name))
+            continue;
+        s.requests /= options.divisor;
+        withinLimits = run(s) && withinLimits;
+    }
+    return withinLimits ? EXIT_SUCCESS : EXIT_FAILURE;
+}
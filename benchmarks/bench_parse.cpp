@@ -0,0 +1,159 @@
+//Benchmark of the parsing of response heads, out of any socket.
+//
+//Every scenario parses the same head over and over and then reads the fields a response
+//needs (Transfer-Encoding and Content-Length). Reported per scenario:
+// - nanoseconds per response
+// - allocations per response: operator new calls
+//
+//The map-* scenarios parse as the library did before the perfect hash of header fields:
+//through an istream, with a regex per line, into an unordered_map of every field. The
+//hash-* scenarios use detail::parse_response_head, which keeps the header lines and an
+//index of their fields in one buffer (response_headers), and finds the well-known fields
+//in a perfect hash.
+//
+//Takes the options of bench_support.hpp.
+
+#include "bench_support.hpp"
+#include "gdg/srl/detail/http.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <istream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace srl = gdg::srl;
+using namespace std;
+
+namespace {
+
+//A small head, as an API server sends it
+string const apiHead =
+    "HTTP/1.1 200 OK\r\n"
+    "Date: Mon, 27 Jan 2017 12:28:53 GMT\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 128\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+
+//A large head, as a CDN sends it, with fields the library does not know
+string const cdnHead =
+    "HTTP/1.1 200 OK\r\n"
+    "Date: Mon, 27 Jan 2017 12:28:53 GMT\r\n"
+    "Server: nginx/1.18.0\r\n"
+    "Content-Type: text/html; charset=utf-8\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "Connection: keep-alive\r\n"
+    "Vary: Accept-Encoding\r\n"
+    "Last-Modified: Wed, 22 Jul 2009 19:15:56 GMT\r\n"
+    "ETag: \"5f3a-4b2c8e7d\"\r\n"
+    "Cache-Control: public, max-age=3600\r\n"
+    "Expires: Mon, 27 Jan 2017 13:28:53 GMT\r\n"
+    "Age: 120\r\n"
+    "Accept-Ranges: bytes\r\n"
+    "X-Cache: HIT\r\n"
+    "X-Served-By: cache-mad22041\r\n"
+    "Strict-Transport-Security: max-age=31536000\r\n"
+    "\r\n";
+
+
+//The parser the library had before detail::parse_response_head
+struct map_head {
+    int status;
+    unordered_map<string, string> headers;
+};
+
+
+map_head parse_with_map(string const & head) {
+    istringstream response(head);
+    string httpVersion, retCode, retString;
+    response >> httpVersion >> retCode;
+    getline(response, retString);
+    map_head result;
+    result.status = stoi(retCode);
+    static const regex spaces("\\s*");
+    string line;
+    while (getline(response, line) && !regex_match(line, spaces)) {
+        auto const separatorIt = find(line.begin(), line.end(), ':');
+        auto fieldName = string(line.begin(), separatorIt);
+        transform(fieldName.begin(), fieldName.end(), fieldName.begin(), &::tolower);
+        auto const valueEnd = find_if(line.rbegin(), line.rend(),
+                                      [](auto c) {
+                                          return !isspace(c); }).base();
+        result.headers[fieldName] =
+            string(find_if(next(separatorIt),
+                           valueEnd,
+                           [](auto c) {
+                               return !isspace(c); }),
+                   valueEnd);
+    }
+    return result;
+}
+
+
+//Bytes of body a response announces, or -1 if it is chunked, as the library reads them
+int64_t body_size_with_map(string const & head) {
+    auto const parsed = parse_with_map(head);
+    if (parsed.headers.find("transfer-encoding") != parsed.headers.end())
+        return -1;
+    auto const it = parsed.headers.find("content-length");
+    return it == parsed.headers.end() ? 0 : stoi(it->second);
+}
+
+
+int64_t body_size_with_hash(string const & head) {
+    auto const parsed = srl::detail::parse_response_head(head);
+    if (parsed.chunked())
+        return -1;
+    return max<int64_t>(parsed.contentLength, 0);
+}
+
+
+struct scenario {
+    string name;
+    string const * head;
+    int64_t (*parse)(string const &);
+    size_t iterations;
+};
+
+
+void run(scenario const & s) {
+    int64_t checksum = 0;
+    auto const allocationsBefore = bench::allocations().load();
+    auto const start = chrono::steady_clock::now();
+    for (size_t i = 0; i < s.iterations; ++i)
+        checksum += s.parse(*s.head);
+    auto const elapsed = chrono::steady_clock::now() - start;
+    auto const iterations = static_cast<double>(s.iterations);
+    printf("%-22s %10zu %12.1f %8.1f %10lld\n",
+           s.name.c_str(), s.iterations,
+           chrono::duration<double, nano>(elapsed).count() / iterations,
+           (bench::allocations().load() - allocationsBefore) / iterations,
+           static_cast<long long>(checksum));
+    fflush(stdout);
+}
+
+} //anon namespace
+
+
+int main(int argc, char ** argv) {
+    auto const options = bench::parse_options(argc, argv);
+    vector<scenario> const scenarios = {
+        {"map-api", &apiHead, body_size_with_map, 200000},
+        {"hash-api", &apiHead, body_size_with_hash, 2000000},
+        {"map-cdn", &cdnHead, body_size_with_map, 50000},
+        {"hash-cdn", &cdnHead, body_size_with_hash, 1000000},
+    };
+
+    printf("%-22s %10s %12s %8s %10s\n", "scenario", "iterations", "ns/response", "allocs", "checksum");
+    for (auto s : scenarios) {
+        if (!options.selected(s.name))
+            continue;
+        s.iterations /= options.divisor;
+        run(s);
+    }
+}
@@ -0,0 +1,83 @@
+//Shared by the benchmarks: an operator new that counts the allocations of the client, and
+//the options that every benchmark takes.
+//
+//Pass --quick to run a tenth of the work of each scenario, and --scenario <name> to run only
+//the scenarios whose name contains <name>.
+//
+//It replaces the global operator new: include it in one translation unit of each benchmark.
+
+#ifndef GDG_SRL_BENCHMARKS_BENCH_SUPPORT_HPP_
+#define GDG_SRL_BENCHMARKS_BENCH_SUPPORT_HPP_
+
+#include "gdg/srl/testing/http_server.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace bench {
+
+/** Calls of operator new outside the threads of a testing::http_server
+ */
+inline std::atomic<std::uint64_t> & allocations() {
+    static std::atomic<std::uint64_t> count{0};
+    return count;
+}
+
+
+/** Options of the command line
+ */
+struct options {
+    /** The work of every scenario is divided by it: 10 with --quick */
+    std::size_t divisor = 1;
+    /** Part of the name of the scenarios to run. Empty for all of them */
+    std::string filter;
+
+    bool selected(std::string const & name) const { return name.find(filter) != std::string::npos; }
+};
+
+
+inline options parse_options(int argc, char ** argv) {
+    options result;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--quick"))
+            result.divisor = 10;
+        else if (!std::strcmp(argv[i], "--scenario") && i + 1 < argc)
+            result.filter = argv[++i];
+    }
+    return result;
+}
+
+} //ns bench
+
+
+//Out of line, so that the compiler does not pair inlined frees with this allocator
+#if defined(__GNUC__)
+#define SRL_BENCH_NOINLINE __attribute__((noinline))
+#else
+#define SRL_BENCH_NOINLINE
+#endif
+
+
+SRL_BENCH_NOINLINE void * operator new(std::size_t size) {
+    if (!gdg::srl::testing::is_server_thread())
+        bench::allocations().fetch_add(1, std::memory_order_relaxed);
+    if (void * p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+
+
+SRL_BENCH_NOINLINE void operator delete(void * p) noexcept {
+    std::free(p);
+}
+
+
+SRL_BENCH_NOINLINE void operator delete(void * p, std::size_t) noexcept {
+    std::free(p);
+}
+
+
+#endif
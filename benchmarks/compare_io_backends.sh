@@ -0,0 +1,30 @@
+#!/bin/sh
+#Compares the epoll and io_uring backends (meson option io-backend) with bench_get.
+#
+#For every backend it builds bench_get in build-bench-<backend>, runs the scenarios
+#whose name contains the first argument (fixed-128B by default) to report throughput
+#and tail latency, and runs them again under strace to count syscalls per request.
+#The syscalls are those of the whole process: the embedded server uses the same backend.
+#
+#Run from the root of the repository. Needs strace >= 5.18 and liburing.
+
+set -e
+
+scenario=${1:-fixed-128B}
+
+for backend in epoll io_uring; do
+    dir=build-bench-$backend
+    [ -d "$dir" ] || meson setup "$dir" -Dio-backend=$backend -Dbuildtype=release
+    ninja -C "$dir" bench_get
+
+    echo "== $backend"
+    "$dir/bench_get" --scenario "$scenario"
+
+    strace -f -c -q -U calls,name -o "$dir/strace.txt" \
+           "$dir/bench_get" --quick --scenario "$scenario" > "$dir/strace-run.txt"
+    #Every scenario warms up with 10 requests
+    requests=$(awk 'NR > 2 { n += $3 + 10 } END { print n }' "$dir/strace-run.txt")
+    calls=$(awk '$2 == "total" { print $1 }' "$dir/strace.txt")
+    echo "syscalls per request: $(echo "$calls $requests" | awk '{ printf "%.1f", $1 / $2 }')"
+    echo
+done
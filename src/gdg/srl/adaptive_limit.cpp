@@ -0,0 +1,196 @@
+#include "gdg/srl/adaptive_limit.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+namespace {
+
+//Samples between resets of the no load latency of vegas, per unit of limit
+uint64_t constexpr vegasProbeMultiplier = 30;
+
+//Samples averaged as they come before gradient2 switches to an exponential average
+uint64_t constexpr gradientWarmupSamples = 10;
+
+//Requests gradient2 lets queue in the upstream
+double constexpr gradientQueueSize = 4;
+
+} //anon namespace
+
+
+namespace gdg {
+
+namespace srl {
+
+
+adaptive_limit::adaptive_limit(adaptive_limit_options options)
+    : options_(move(options)),
+      limit_(0),
+      samplesToProbe_(0) {
+    set_limit(static_cast<double>(options_.initialLimit));
+    samplesToProbe_ = vegasProbeMultiplier * limit();
+}
+
+
+size_t adaptive_limit::limit() const {
+    return static_cast<size_t>(limit_);
+}
+
+
+void adaptive_limit::on_sample(chrono::steady_clock::duration latency, size_t inFlight, bool dropped) {
+    auto const nanoseconds = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(latency).count());
+    auto const sample = max(nanoseconds, 1.0);
+    switch (options_.algorithm) {
+    case limit_algorithm::none:
+        break;
+    case limit_algorithm::aimd:
+        on_aimd_sample(sample, inFlight, dropped);
+        break;
+    case limit_algorithm::vegas:
+        on_vegas_sample(sample, inFlight, dropped);
+        break;
+    case limit_algorithm::gradient2:
+        on_gradient2_sample(sample, inFlight, dropped);
+        break;
+    }
+}
+
+
+void adaptive_limit::on_aimd_sample(double latency, size_t inFlight, bool dropped) {
+    auto const threshold = chrono::duration_cast<chrono::nanoseconds>(options_.aimdLatencyThreshold).count();
+    if (dropped || latency > threshold)
+        set_limit(limit_ * options_.backoffRatio);
+    else if (inFlight * 2 >= limit())
+        set_limit(limit_ + 1);
+}
+
+
+void adaptive_limit::on_vegas_sample(double latency, size_t inFlight, bool dropped) {
+    if (--samplesToProbe_ == 0) {
+        noLoadLatency_ = latency;
+        samplesToProbe_ = vegasProbeMultiplier * limit();
+    }
+    if (noLoadLatency_ == 0 || latency < noLoadLatency_)
+        noLoadLatency_ = latency;
+
+    auto const step = max(1.0, log10(limit_));
+    if (dropped) {
+        set_limit(limit_ - step);
+        return;
+    }
+    if (inFlight * 2 < limit())
+        return;
+    auto const queued = ceil(limit_ * (1 - noLoadLatency_ / latency));
+    auto const alpha = 3 * step;
+    auto const beta = 6 * step;
+    if (queued <= step)
+        set_limit(limit_ + beta);
+    else if (queued < alpha)
+        set_limit(limit_ + step);
+    else if (queued > beta)
+        set_limit(limit_ - step);
+}
+
+
+void adaptive_limit::on_gradient2_sample(double latency, size_t inFlight, bool dropped) {
+    ++samples_;
+    if (samples_ <= gradientWarmupSamples)
+        longLatency_ += (latency - longLatency_) / samples_;
+    else
+        longLatency_ += (latency - longLatency_) * 2 / (options_.longWindow + 1);
+    //Let the long term latency follow quickly an upstream that got faster
+    if (longLatency_ / latency > 2)
+        longLatency_ *= 0.95;
+
+    if (!dropped && inFlight * 2 < limit())
+        return;
+    auto const gradient = dropped ? 0.5 : max(0.5, min(1.0, options_.tolerance * longLatency_ / latency));
+    auto const estimate = limit_ * gradient + gradientQueueSize;
+    set_limit(limit_ * (1 - options_.smoothing) + estimate * options_.smoothing);
+}
+
+
+void adaptive_limit::set_limit(double limit) {
+    limit_ = min(max(limit, static_cast<double>(max<size_t>(options_.minLimit, 1))),
+                 static_cast<double>(options_.maxLimit));
+}
+
+
+TEST_CASE("aimd limit grows while saturated and backs off on drops") {
+    adaptive_limit_options options;
+    options.algorithm = limit_algorithm::aimd;
+    options.initialLimit = 10;
+    adaptive_limit limit(options);
+
+    limit.on_sample(chrono::milliseconds(10), 2, false);
+    CHECK(limit.limit() == 10);
+    for (int i = 0; i < 5; ++i)
+        limit.on_sample(chrono::milliseconds(10), limit.limit(), false);
+    CHECK(limit.limit() == 15);
+    limit.on_sample(chrono::milliseconds(10), 15, true);
+    CHECK(limit.limit() == 13);
+    limit.on_sample(chrono::seconds(6), 13, false);
+    CHECK(limit.limit() == 12);
+
+    options.minLimit = 12;
+    adaptive_limit floor(options);
+    for (int i = 0; i < 10; ++i)
+        floor.on_sample(chrono::milliseconds(10), 12, true);
+    CHECK(floor.limit() == 12);
+}
+
+
+TEST_CASE("vegas limit follows the requests queued in the upstream") {
+    adaptive_limit_options options;
+    options.algorithm = limit_algorithm::vegas;
+    options.initialLimit = 20;
+    adaptive_limit limit(options);
+
+    //No queueing: latency at its lowest
+    for (int i = 0; i < 10; ++i)
+        limit.on_sample(chrono::milliseconds(10), limit.limit(), false);
+    auto const grown = limit.limit();
+    CHECK(grown > 20);
+
+    //Latency doubled: half of the requests in flight are queued upstream
+    for (int i = 0; i < 10; ++i)
+        limit.on_sample(chrono::milliseconds(20), limit.limit(), false);
+    CHECK(limit.limit() < grown);
+}
+
+
+TEST_CASE("gradient2 limit shrinks as latency rises and recovers after") {
+    adaptive_limit_options options;
+    options.algorithm = limit_algorithm::gradient2;
+    options.initialLimit = 50;
+    adaptive_limit limit(options);
+
+    for (int i = 0; i < 100; ++i)
+        limit.on_sample(chrono::milliseconds(10), limit.limit(), false);
+    auto const healthy = limit.limit();
+    CHECK(healthy > 50);
+
+    for (int i = 0; i < 20; ++i)
+        limit.on_sample(chrono::milliseconds(50), limit.limit(), false);
+    auto const degraded = limit.limit();
+    CHECK(degraded < healthy / 2);
+
+    for (int i = 0; i < 100; ++i)
+        limit.on_sample(chrono::milliseconds(10), limit.limit(), false);
+    CHECK(limit.limit() > degraded);
+
+    //Not saturated: the limit stays
+    auto const idle = limit.limit();
+    limit.on_sample(chrono::milliseconds(10), 1, false);
+    CHECK(limit.limit() == idle);
+}
+
+
+} //ns srl
+
+} //ns gdg
@@ -0,0 +1,94 @@
+#ifndef GDG_SRL_ADAPTIVE_LIMIT_HPP_
+#define GDG_SRL_ADAPTIVE_LIMIT_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace gdg {
+
+namespace srl {
+
+/** How an \ref adaptive_limit moves
+ */
+enum class limit_algorithm {
+    /** No adaptive limit */
+    none,
+    /** Additive increase while requests succeed, multiplicative decrease on drops */
+    aimd,
+    /** TCP Vegas: estimates the requests queued in the upstream from the latency
+        over the lowest latency seen, and keeps that queue between bounds */
+    vegas,
+    /** Scales the limit by the ratio of the long term latency to the latest one,
+        as Netflix concurrency-limits Gradient2 does */
+    gradient2
+};
+
+
+/** Tuning of an \ref adaptive_limit
+ */
+struct adaptive_limit_options {
+    limit_algorithm algorithm = limit_algorithm::none;
+    std::size_t initialLimit = 20;
+    std::size_t minLimit = 1;
+    std::size_t maxLimit = 1000;
+    /** aimd: requests slower than this count as dropped */
+    std::chrono::steady_clock::duration aimdLatencyThreshold = std::chrono::seconds(5);
+    /** aimd: factor applied to the limit after a drop */
+    double backoffRatio = 0.9;
+    /** gradient2: latency over the long term latency tolerated before the limit shrinks */
+    double tolerance = 1.5;
+    /** gradient2: weight of each new estimate of the limit */
+    double smoothing = 0.2;
+    /** gradient2: samples averaged in the long term latency */
+    std::size_t longWindow = 600;
+};
+
+
+/** Limit of requests in flight to an upstream, adjusted from the latency and
+    the failures of the requests.
+
+    The limit only grows while the requests in flight use at least half of it,
+    so that an idle upstream does not end with an unbounded limit.
+
+    Not thread safe.
+ */
+class adaptive_limit {
+public:
+    explicit adaptive_limit(adaptive_limit_options options);
+
+    /** Current limit, between options.minLimit and options.maxLimit */
+    std::size_t limit() const;
+
+    /** Adjusts the limit from a request over.
+
+        @latency[in] time from the start of the request to its end
+        @inFlight[in] requests in flight to the upstream as it ended, itself included
+        @dropped[in] true if the request timed out, failed to connect or the upstream was overloaded
+     */
+    void on_sample(std::chrono::steady_clock::duration latency, std::size_t inFlight, bool dropped);
+
+private:
+    void on_aimd_sample(double latency, std::size_t inFlight, bool dropped);
+    void on_vegas_sample(double latency, std::size_t inFlight, bool dropped);
+    void on_gradient2_sample(double latency, std::size_t inFlight, bool dropped);
+
+    void set_limit(double limit);
+
+    adaptive_limit_options options_;
+    double limit_;
+    //vegas: lowest latency seen, reset from time to time to follow changes in the upstream
+    double noLoadLatency_ = 0;
+    std::uint64_t samplesToProbe_;
+    //gradient2: exponential average of the latency
+    double longLatency_ = 0;
+    std::uint64_t samples_ = 0;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,73 @@
+#include "gdg/srl/budget.hpp"
+#include <algorithm>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+
+namespace gdg {
+
+namespace srl {
+
+
+request_budget::request_budget(double ratio, double maxBalance)
+    : ratio_(max(ratio, 0.0)),
+      maxBalance_(max(maxBalance, 1.0)),
+      balance_(maxBalance_) {
+}
+
+
+void request_budget::deposit() {
+    lock_guard<mutex> lock(mtx_);
+    balance_ = min(balance_ + ratio_, maxBalance_);
+}
+
+
+bool request_budget::try_withdraw() {
+    lock_guard<mutex> lock(mtx_);
+    if (balance_ < 1)
+        return false;
+    balance_ -= 1;
+    return true;
+}
+
+
+void request_budget::refund() {
+    lock_guard<mutex> lock(mtx_);
+    balance_ = min(balance_ + 1, maxBalance_);
+}
+
+
+double request_budget::balance() const {
+    lock_guard<mutex> lock(mtx_);
+    return balance_;
+}
+
+
+TEST_CASE("request budget allows extra requests in proportion to requests") {
+    request_budget budget(0.25, 2);
+    CHECK(budget.try_withdraw());
+    CHECK(budget.try_withdraw());
+    CHECK(!budget.try_withdraw());
+
+    for (int i = 0; i < 3; ++i)
+        budget.deposit();
+    CHECK(!budget.try_withdraw());
+    budget.deposit();
+    CHECK(budget.try_withdraw());
+    budget.refund();
+    CHECK(budget.try_withdraw());
+
+    //Idle time does not pile up more than maxBalance
+    for (int i = 0; i < 1000; ++i)
+        budget.deposit();
+    CHECK(budget.balance() == 2);
+}
+
+
+} //ns srl
+
+} //ns gdg
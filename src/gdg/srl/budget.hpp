@@ -0,0 +1,49 @@
+#ifndef GDG_SRL_BUDGET_HPP_
+#define GDG_SRL_BUDGET_HPP_
+
+#include <mutex>
+
+namespace gdg {
+
+namespace srl {
+
+/** Extra requests, such as hedges, allowed in proportion to the requests made.
+
+    Every request deposits ratio in the budget and every extra request withdraws
+    one, so extra requests stay below ratio times the requests over time.
+    The balance starts full and is capped at maxBalance, which bounds bursts.
+
+    Thread safe.
+ */
+class request_budget {
+public:
+    request_budget(double ratio, double maxBalance = 10);
+
+    request_budget(request_budget const &) = delete;
+    request_budget & operator=(request_budget const &) = delete;
+
+    /** Tells that a request was made */
+    void deposit();
+
+    /** Takes one extra request from the budget. False if the budget is spent */
+    bool try_withdraw();
+
+    /** Gives back an extra request withdrawn and then not made */
+    void refund();
+
+    double balance() const;
+
+private:
+    double const ratio_;
+    double const maxBalance_;
+    mutable std::mutex mtx_;
+    double balance_;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,97 @@
+#include "gdg/srl/cancellation.hpp"
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+
+namespace gdg {
+
+namespace srl {
+
+
+struct cancellation_token::state {
+    mutex mtx;
+    bool cancelled = false;
+    uint64_t lastId = 0;
+    map<uint64_t, callback> callbacks;
+};
+
+
+cancellation_token::cancellation_token()
+    : state_(make_shared<state>()) {
+}
+
+
+void cancellation_token::cancel() const {
+    map<uint64_t, callback> callbacks;
+    {
+        lock_guard<mutex> lock(state_->mtx);
+        if (state_->cancelled)
+            return;
+        state_->cancelled = true;
+        callbacks.swap(state_->callbacks);
+    }
+    //Outside the lock: a callback may subscribe or unsubscribe
+    for (auto & f : callbacks)
+        f.second();
+}
+
+
+bool cancellation_token::cancelled() const {
+    lock_guard<mutex> lock(state_->mtx);
+    return state_->cancelled;
+}
+
+
+uint64_t cancellation_token::subscribe(callback f) const {
+    {
+        lock_guard<mutex> lock(state_->mtx);
+        if (!state_->cancelled) {
+            auto const id = ++state_->lastId;
+            state_->callbacks.emplace(id, move(f));
+            return id;
+        }
+    }
+    f();
+    return 0;
+}
+
+
+void cancellation_token::unsubscribe(uint64_t id) const {
+    lock_guard<mutex> lock(state_->mtx);
+    state_->callbacks.erase(id);
+}
+
+
+TEST_CASE("cancellation token calls its callbacks once") {
+    cancellation_token token;
+    auto const copy = token;
+    int called = 0;
+    auto const first = token.subscribe([&called] { ++called; });
+    auto const second = copy.subscribe([&called] { called += 10; });
+    CHECK(first != 0);
+    CHECK(second != first);
+    copy.unsubscribe(second);
+    CHECK(!token.cancelled());
+
+    copy.cancel();
+    CHECK(token.cancelled());
+    CHECK(called == 1);
+    token.cancel();
+    CHECK(called == 1);
+
+    //Already cancelled: called right away
+    CHECK(token.subscribe([&called] { called += 100; }) == 0);
+    CHECK(called == 101);
+}
+
+
+} //ns srl
+
+} //ns gdg
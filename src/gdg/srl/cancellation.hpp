@@ -0,0 +1,50 @@
+#ifndef GDG_SRL_CANCELLATION_HPP_
+#define GDG_SRL_CANCELLATION_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace gdg {
+
+namespace srl {
+
+/** Stops the requests made with it, as in a fan-out where only the first answer matters.
+
+    Copies share the same state: cancelling one cancels the requests made with any of them.
+    Once cancelled it stays cancelled, and requests made with it later fail at once.
+
+    Thread safe.
+ */
+class cancellation_token {
+public:
+    using callback = std::function<void()>;
+
+    cancellation_token();
+
+    /** Calls the callbacks subscribed, in the calling thread. Only the first call does anything */
+    void cancel() const;
+
+    bool cancelled() const;
+
+    /** Calls f on cancel, or right away if already cancelled.
+
+        @return id to unsubscribe f, zero if f was called right away
+     */
+    std::uint64_t subscribe(callback f) const;
+
+    /** f will not be called. Waits for nothing: f may be running in a thread calling cancel */
+    void unsubscribe(std::uint64_t id) const;
+
+private:
+    struct state;
+    std::shared_ptr<state> state_;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
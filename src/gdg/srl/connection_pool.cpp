@@ -0,0 +1,226 @@
+#include "gdg/srl/connection_pool.hpp"
+#include "gdg/srl/testing/http_server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <thread>
+#include <sys/socket.h>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+namespace {
+
+//False if the server closed the idle connection or sent something nobody asked for
+bool is_usable(detail::socket_t & socket) {
+    char c;
+    auto const received = ::recv(socket.native_handle(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    //ENOTCONN: Fast Open connection whose handshake waits for the first write
+    return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN);
+}
+
+} //anon namespace
+
+
+namespace gdg {
+
+namespace srl {
+
+
+struct connection_pool::prewarm_state {
+    atomic<size_t> remaining{0};
+    promise<void> done;
+};
+
+
+connection_pool::connection_pool(net::io_service & io, connection_pool_options options)
+    : io_(io), options_(move(options)) {
+}
+
+
+unique_ptr<detail::socket_t> connection_pool::try_acquire(string const & host) {
+    unique_ptr<detail::socket_t> found;
+    {
+        lock_guard<mutex> lock(mtx_);
+        ++stats_.requests;
+        auto & connections = hosts_[host];
+        ++connections.inUse;
+        auto const now = chrono::steady_clock::now();
+        while (!found && !connections.idle.empty()) {
+            auto connection = move(connections.idle.back());
+            connections.idle.pop_back();
+            if (now - connection.since <= options_.idleTimeout && is_usable(*connection.socket)) {
+                found = move(connection.socket);
+                ++stats_.warmHits;
+                if (connection.prewarmed)
+                    ++stats_.prewarmedHits;
+            }
+            else {
+                ++stats_.staleConnections;
+            }
+        }
+    }
+    open_missing_warm_connections(host);
+    return found;
+}
+
+
+void connection_pool::release(string const & host, unique_ptr<detail::socket_t> connection) {
+    lock_guard<mutex> lock(mtx_);
+    auto & connections = hosts_[host];
+    --connections.inUse;
+    if (connections.idle.size() < max(options_.maxIdlePerHost, connections.warmTarget))
+        connections.idle.push_back({move(connection), chrono::steady_clock::now(), false});
+}
+
+
+void connection_pool::discard(string const & host) {
+    {
+        lock_guard<mutex> lock(mtx_);
+        --hosts_[host].inUse;
+    }
+    open_missing_warm_connections(host);
+}
+
+
+future<void> connection_pool::prewarm(string const & host,
+                                      size_t count,
+                                      socket_options const & options) {
+    auto state = make_shared<prewarm_state>();
+    auto result = state->done.get_future();
+    size_t toOpen = 0;
+    {
+        lock_guard<mutex> lock(mtx_);
+        auto & connections = hosts_[host];
+        connections.warmTarget = count;
+        connections.socketOptions = options;
+        toOpen = missing_warm_connections(connections);
+    }
+    if (!toOpen) {
+        state->done.set_value();
+        return result;
+    }
+    state->remaining = toOpen;
+    for (size_t i = 0; i < toOpen; ++i)
+        open_warm_connection(host, options, state);
+    return result;
+}
+
+
+connection_pool_stats connection_pool::stats() const {
+    lock_guard<mutex> lock(mtx_);
+    auto result = stats_;
+    result.idleConnections = 0;
+    for (auto const & host : hosts_)
+        result.idleConnections += host.second.idle.size();
+    return result;
+}
+
+
+size_t connection_pool::missing_warm_connections(host_connections & connections) {
+    auto const available = connections.idle.size() + connections.warming + connections.inUse;
+    auto const missing = connections.warmTarget > available ? connections.warmTarget - available : 0;
+    connections.warming += missing;
+    return missing;
+}
+
+
+void connection_pool::open_missing_warm_connections(string const & host) {
+    size_t toOpen = 0;
+    socket_options options;
+    {
+        lock_guard<mutex> lock(mtx_);
+        auto & connections = hosts_[host];
+        toOpen = missing_warm_connections(connections);
+        options = connections.socketOptions;
+    }
+    for (size_t i = 0; i < toOpen; ++i)
+        open_warm_connection(host, options, nullptr);
+}
+
+
+void connection_pool::open_warm_connection(string const & host,
+                                           socket_options const & options,
+                                           shared_ptr<prewarm_state> state) {
+    net::spawn(io_, [self = shared_from_this(), host, options, state](net::yield_context yield) {
+            auto socket = make_unique<detail::socket_t>(self->io_);
+            try {
+                detail::async_connect_host(self->io_, *socket, host, yield, nullptr, options);
+            }
+            catch (...) {
+                socket.reset();
+            }
+            {
+                lock_guard<mutex> lock(self->mtx_);
+                auto & connections = self->hosts_[host];
+                --connections.warming;
+                if (socket)
+                    connections.idle.push_back({move(socket), chrono::steady_clock::now(), true});
+            }
+            if (state && --state->remaining == 0)
+                state->done.set_value();
+        });
+}
+
+
+TEST_CASE("connection pool prewarms loopback connections") {
+    net::io_service io;
+    net::io_service::work work{io};
+    thread t([&io] { io.run(); });
+    testing::http_server server;
+    auto pool = make_shared<connection_pool>(io);
+
+    pool->prewarm(server.host(), 2).get();
+    CHECK(pool->stats().idleConnections == 2);
+
+    auto connection = pool->try_acquire(server.host());
+    CHECK(connection);
+    auto const stats = pool->stats();
+    CHECK(stats.requests == 1);
+    CHECK(stats.warmHits == 1);
+    CHECK(stats.prewarmedHits == 1);
+    CHECK(stats.idleConnections == 1);
+    pool->release(server.host(), move(connection));
+    CHECK(pool->stats().idleConnections == 2);
+
+    //A connection lost is replaced in the background
+    connection = pool->try_acquire(server.host());
+    connection.reset();
+    pool->discard(server.host());
+    for (int i = 0; i < 100 && pool->stats().idleConnections < 2; ++i)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    CHECK(pool->stats().idleConnections == 2);
+    io.stop();
+    t.join();
+}
+
+
+TEST_CASE("connection pool discards loopback connections closed by the server") {
+    net::io_service io;
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    auto const host = "127.0.0.1:" + to_string(acceptor.local_endpoint().port());
+    auto pool = make_shared<connection_pool>(io);
+
+    auto connection = make_unique<detail::socket_t>(io);
+    connection->connect(acceptor.local_endpoint());
+    ip::tcp::socket peer(io);
+    acceptor.accept(peer);
+    CHECK(!pool->try_acquire(host));
+    pool->release(host, move(connection));
+    CHECK(pool->stats().idleConnections == 1);
+
+    peer.close();
+    this_thread::sleep_for(chrono::milliseconds(20));
+    CHECK(!pool->try_acquire(host));
+    pool->discard(host);
+    CHECK(pool->stats().staleConnections == 1);
+    CHECK(pool->stats().idleConnections == 0);
+}
+
+
+} //ns srl
+
+} //ns gdg
@@ -0,0 +1,133 @@
+#ifndef GDG_SRL_CONNECTION_POOL_HPP_
+#define GDG_SRL_CONNECTION_POOL_HPP_
+
+#include "gdg/srl/alias.hpp"
+#include "gdg/srl/detail/http.hpp"
+#include "gdg/srl/socket_options.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace gdg {
+
+namespace srl {
+
+/** Tuning of a \ref connection_pool
+ */
+struct connection_pool_options {
+    /** Idle connections kept per host. Hosts with warm connections keep at least that many */
+    std::size_t maxIdlePerHost = 8;
+    /** Idle connections older than this are closed instead of reused */
+    std::chrono::steady_clock::duration idleTimeout = std::chrono::seconds(30);
+    /** Hosts to keep warm connections to, and how many, so that requests do not wait
+        for resolution and handshake. Taken connections are replaced in the background */
+    std::map<std::string, std::size_t> warmConnections;
+};
+
+
+/** How requests found their connections in a \ref connection_pool
+ */
+struct connection_pool_stats {
+    /** Connections asked to the pool */
+    std::uint64_t requests = 0;
+    /** Requests that found an open connection and skipped resolution and handshake */
+    std::uint64_t warmHits = 0;
+    /** Of warmHits, those that took a connection opened by pre-warming */
+    std::uint64_t prewarmedHits = 0;
+    /** Idle connections found closed by the server or too old, and discarded */
+    std::uint64_t staleConnections = 0;
+    /** Connections waiting for a request */
+    std::uint64_t idleConnections = 0;
+};
+
+
+/** Open connections kept per host for later requests.
+
+    Connections come back to the pool after a response that lets the connection
+    open, and can be opened before any request needs them (pre-warming).
+    With socket_options::fastOpen the handshake of a pre-warmed connection waits
+    for its first write, so the request goes out in the SYN.
+
+    Thread safe. Must be owned by a shared_ptr: connections being warmed keep the pool alive.
+ */
+class connection_pool : public std::enable_shared_from_this<connection_pool> {
+public:
+    connection_pool(net::io_service & io, connection_pool_options options = {});
+
+    connection_pool(connection_pool const &) = delete;
+    connection_pool & operator=(connection_pool const &) = delete;
+
+    /** Takes an idle connection to host, most recently used first, or returns an empty
+        pointer if there is none, in which case the caller opens its own connection.
+        Connections closed by the server are discarded.
+
+        Every call must be followed by \ref release or \ref discard once the request
+        is over, since the connections in use count towards the warm connections of host.
+     */
+    std::unique_ptr<detail::socket_t> try_acquire(std::string const & host);
+
+    /** Gives back a connection to host that is ready for another request
+     */
+    void release(std::string const & host, std::unique_ptr<detail::socket_t> connection);
+
+    /** Tells that the connection to host of a request is closed instead of given back
+     */
+    void discard(std::string const & host);
+
+    /** Opens connections to host until count of them are idle, and keeps that many from then on.
+
+        @options[in] socket options of the connections to host
+        @return a future ready once the connections opened by this call are established or failed
+     */
+    std::future<void> prewarm(std::string const & host,
+                              std::size_t count,
+                              socket_options const & options = {});
+
+    connection_pool_stats stats() const;
+
+private:
+    struct idle_connection {
+        std::unique_ptr<detail::socket_t> socket;
+        std::chrono::steady_clock::time_point since;
+        bool prewarmed;
+    };
+
+    struct host_connections {
+        std::deque<idle_connection> idle;
+        std::size_t inUse = 0;
+        std::size_t warmTarget = 0;
+        std::size_t warming = 0;
+        socket_options socketOptions;
+    };
+
+    struct prewarm_state;
+
+    //Connections to open to reach the warm target of host, counted as warming.
+    //Called with the lock held
+    std::size_t missing_warm_connections(host_connections & connections);
+
+    void open_missing_warm_connections(std::string const & host);
+
+    void open_warm_connection(std::string const & host,
+                              socket_options const & options,
+                              std::shared_ptr<prewarm_state> state);
+
+    net::io_service & io_;
+    connection_pool_options const options_;
+    mutable std::mutex mtx_;
+    std::map<std::string, host_connections> hosts_;
+    connection_pool_stats stats_;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
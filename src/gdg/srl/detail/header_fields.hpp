@@ -0,0 +1,136 @@
+#ifndef GDG_SRL_DETAIL_HEADER_FIELDS_HPP_
+#define GDG_SRL_DETAIL_HEADER_FIELDS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace gdg {
+
+namespace srl {
+
+namespace detail {
+
+/** Response header fields the library knows, kept in fixed slots of \ref response_head
+ */
+enum class header_field : std::uint8_t {
+    content_length,
+    transfer_encoding,
+    connection,
+    location,
+    content_range,
+    accept_ranges,
+    content_type,
+    content_encoding,
+    keep_alive,
+    retry_after,
+    date,
+    server,
+    etag,
+    last_modified,
+    cache_control,
+    expires,
+    vary,
+    age,
+    /** Any other field */
+    unknown
+};
+
+
+constexpr std::size_t headerFieldCount = static_cast<std::size_t>(header_field::unknown);
+
+
+/** Lowercase names of the fields, by header_field
+ */
+constexpr char const * headerFieldNames[headerFieldCount] = {
+    "content-length", "transfer-encoding", "connection", "location", "content-range",
+    "accept-ranges", "content-type", "content-encoding", "keep-alive", "retry-after", "date",
+    "server", "etag", "last-modified", "cache-control", "expires", "vary", "age"
+};
+
+
+namespace header_hash {
+
+//Slots of the hash table, and the weights of the length and the first and last characters in
+//the hash. Chosen so that every name has a slot of its own, which is checked below
+constexpr std::size_t slots = 32;
+constexpr std::size_t lengthWeight = 1;
+constexpr std::size_t firstWeight = 31;
+constexpr std::size_t lastWeight = 15;
+
+
+constexpr char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+
+constexpr std::size_t length(char const * name) {
+    std::size_t size = 0;
+    while (name[size])
+        ++size;
+    return size;
+}
+
+
+constexpr std::size_t hash(char const * name, std::size_t size) {
+    return (size * lengthWeight
+            + static_cast<unsigned char>(lower(name[0])) * firstWeight
+            + static_cast<unsigned char>(lower(name[size - 1])) * lastWeight) % slots;
+}
+
+
+//Field in each slot, header_field::unknown in the empty ones
+struct table {
+    constexpr table() : fields{} {
+        for (auto & field : fields)
+            field = header_field::unknown;
+        for (std::size_t i = 0; i < headerFieldCount; ++i) {
+            auto & field = fields[hash(headerFieldNames[i], length(headerFieldNames[i]))];
+            //Two names in a slot: the hash is not perfect anymore
+            if (field != header_field::unknown)
+                throw "header_hash collision";
+            field = static_cast<header_field>(i);
+        }
+    }
+
+    header_field fields[slots];
+};
+
+
+constexpr table fieldTable{};
+
+} //ns header_hash
+
+
+/** The field named name, in any case, or header_field::unknown.
+
+    Takes one probe in a perfect hash table built at compile time, and a comparison
+    with the name in its slot.
+ */
+constexpr header_field find_header_field(char const * name, std::size_t size) {
+    if (!size)
+        return header_field::unknown;
+    auto const field = header_hash::fieldTable.fields[header_hash::hash(name, size)];
+    if (field == header_field::unknown)
+        return field;
+    auto const known = headerFieldNames[static_cast<std::size_t>(field)];
+    for (std::size_t i = 0; i < size; ++i) {
+        if (!known[i] || header_hash::lower(name[i]) != known[i])
+            return header_field::unknown;
+    }
+    return known[size] ? header_field::unknown : field;
+}
+
+
+static_assert(find_header_field("Content-Length", 14) == header_field::content_length,
+              "well-known fields are found in any case");
+static_assert(find_header_field("content-lengths", 15) == header_field::unknown,
+              "other fields are not well-known");
+
+} //ns detail
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
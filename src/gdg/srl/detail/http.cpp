@@ -0,0 +1,862 @@
+#include "gdg/srl/detail/http.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <memory>
+#include <istream>
+#include <stdexcept>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+
+namespace gdg {
+
+namespace srl {
+
+namespace detail {
+
+
+bool is_unix_socket_host(string_view_t host) {
+    auto const prefixSize = sizeof(unixSocketPrefix) - 1;
+    return host.size() > prefixSize && host.substr(0, prefixSize) == unixSocketPrefix;
+}
+
+
+string build_request(string_view_t host,
+                     string_view_t resource,
+                     string_view_t extraHeaders,
+                     bool keepAlive) {
+    return build_request_head("GET", host, resource, extraHeaders, keepAlive);
+}
+
+
+string build_request_head(string_view_t method,
+                          string_view_t host,
+                          string_view_t resource,
+                          string_view_t extraHeaders,
+                          bool keepAlive) {
+    auto const hostHeader = is_unix_socket_host(host) ? string_view_t("localhost") : host;
+    string_view_t const close = keepAlive ? "" : "Connection: close\r\n";
+    //Sized up front, so that the request takes a single allocation
+    string request;
+    request.reserve(method.size() + resource.size() + hostHeader.size() + extraHeaders.size()
+                    + close.size() + 25);
+    request.append(method.data(), method.size()).append(" ")
+        .append(resource.data(), resource.size()).append(" HTTP/1.1\r\nHost: ")
+        .append(hostHeader.data(), hostHeader.size()).append("\r\n")
+        .append(extraHeaders.data(), extraHeaders.size())
+        .append(close.data(), close.size()).append("\r\n");
+    return request;
+}
+
+
+TEST_CASE("build request") {
+    CHECK(build_request("www.vandal.net", "/") ==
+          "GET / HTTP/1.1\r\nHost: www.vandal.net\r\nConnection: close\r\n\r\n");
+
+    CHECK(build_request("www.publico.es", "/") ==
+          "GET / HTTP/1.1\r\nHost: www.publico.es\r\nConnection: close\r\n\r\n");
+
+    CHECK(build_request("www.boost.org", "/LICENSE_1_0.txt") ==
+          "GET /LICENSE_1_0.txt HTTP/1.1\r\nHost: www.boost.org\r\nConnection: close\r\n\r\n");
+
+    CHECK(build_request("www.boost.org", "/LICENSE_1_0.txt", "Range: bytes=0-99\r\n", true) ==
+          "GET /LICENSE_1_0.txt HTTP/1.1\r\nHost: www.boost.org\r\nRange: bytes=0-99\r\n\r\n");
+
+    CHECK(build_request("unix:/run/sidecar.sock", "/health") ==
+          "GET /health HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+
+    CHECK(build_request_head("PUT", "www.boost.org", "/upload", "Content-Length: 3\r\n", true) ==
+          "PUT /upload HTTP/1.1\r\nHost: www.boost.org\r\nContent-Length: 3\r\n\r\n");
+}
+
+
+TEST_CASE("unix socket hosts") {
+    CHECK(is_unix_socket_host("unix:/run/sidecar.sock"));
+    CHECK(is_unix_socket_host("unix:relative.sock"));
+    CHECK(!is_unix_socket_host("unix:"));
+    CHECK(!is_unix_socket_host("unix"));
+    CHECK(!is_unix_socket_host("www.boost.org"));
+    CHECK(!is_unix_socket_host("localhost:8080"));
+}
+
+
+bool keeps_connection_open(response_head const & head) {
+    bool const persistent = head.version >= 11;
+    if (!head.has(header_field::connection))
+        return persistent;
+    auto const connection = head.get(header_field::connection);
+    string value(connection.data(), connection.size());
+    transform(value.begin(), value.end(), value.begin(), &::tolower);
+    if (value.find("close") != string::npos)
+        return false;
+    return persistent || value.find("keep-alive") != string::npos;
+}
+
+
+TEST_CASE("keeps connection open") {
+    CHECK(keeps_connection_open(parse_response_head("HTTP/1.1 200 OK\r\n\r\n")));
+    CHECK(keeps_connection_open(parse_response_head("HTTP/1.1 200 OK\r\nconnection: keep-alive\r\n\r\n")));
+    CHECK(!keeps_connection_open(parse_response_head("HTTP/1.1 200 OK\r\nConnection: Close\r\n\r\n")));
+    //HTTP/1.0 closes unless asked to keep alive
+    CHECK(!keeps_connection_open(parse_response_head("HTTP/1.0 200 OK\r\n\r\n")));
+    CHECK(keeps_connection_open(parse_response_head("HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\n\r\n")));
+    CHECK(!keeps_connection_open(parse_response_head("HTTP/1.0 200 OK\r\nConnection: close\r\n\r\n")));
+}
+
+
+pair<string, string> split_host_port(string const & host) {
+    if (!host.empty() && host[0] == '[') {
+        auto const close = host.find(']');
+        if (close != string::npos && (close + 1 == host.size() || host[close + 1] == ':')) {
+            auto const port = close + 2 < host.size() ? host.substr(close + 2) : string("http");
+            return {host.substr(1, close - 1), port};
+        }
+    }
+    auto const colon = host.rfind(':');
+    if (colon == string::npos || colon + 1 == host.size() || host.find(':') != colon
+        || !all_of(host.begin() + colon + 1, host.end(), [](unsigned char c) { return isdigit(c); }))
+        return {host, "http"};
+    return {host.substr(0, colon), host.substr(colon + 1)};
+}
+
+
+TEST_CASE("split host port") {
+    CHECK(split_host_port("www.boost.org") == make_pair(string("www.boost.org"), string("http")));
+    CHECK(split_host_port("localhost:8080") == make_pair(string("localhost"), string("8080")));
+    CHECK(split_host_port("127.0.0.1:80") == make_pair(string("127.0.0.1"), string("80")));
+    CHECK(split_host_port("::1") == make_pair(string("::1"), string("http")));
+    CHECK(split_host_port("localhost:") == make_pair(string("localhost:"), string("http")));
+    CHECK(split_host_port("localhost:http") == make_pair(string("localhost:http"), string("http")));
+    CHECK(split_host_port("[::1]:8080") == make_pair(string("::1"), string("8080")));
+    CHECK(split_host_port("[::1]") == make_pair(string("::1"), string("http")));
+}
+
+
+bool is_redirect(int status) {
+    return status == 301 || status == 302 || status == 303 || status == 307 || status == 308;
+}
+
+
+namespace {
+
+//Path without "." and ".." segments (RFC 3986 section 5.2.4). path starts with /
+string remove_dot_segments(string const & path) {
+    vector<string> segments;
+    bool trailingSlash = false;
+    size_t begin = 1;
+    for (;;) {
+        auto const end = min(path.find('/', begin), path.size());
+        auto const segment = path.substr(begin, end - begin);
+        bool const last = end == path.size();
+        trailingSlash = false;
+        if (segment == "..") {
+            if (!segments.empty())
+                segments.pop_back();
+            trailingSlash = true;
+        }
+        else if (segment == ".") {
+            trailingSlash = true;
+        }
+        else {
+            segments.push_back(segment);
+        }
+        if (last)
+            break;
+        begin = end + 1;
+    }
+    string result = "/";
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (i)
+            result += '/';
+        result += segments[i];
+    }
+    if (trailingSlash && !segments.empty())
+        result += '/';
+    return result;
+}
+
+
+//Splits a resource in path and query (with its ?)
+pair<string, string> split_query(string const & resource) {
+    auto const question = resource.find('?');
+    if (question == string::npos)
+        return {resource, ""};
+    return {resource.substr(0, question), resource.substr(question)};
+}
+
+} //anon namespace
+
+
+pair<string, string> resolve_location(string const & host, string const & resource, string_view_t location) {
+    string target(location);
+    target.erase(min(target.find('#'), target.size()));
+    target.erase(0, target.find_first_not_of(" \t"));
+    target.erase(target.find_last_not_of(" \t") + 1);
+
+    auto const colon = target.find(':');
+    if (colon != string::npos && colon < target.find_first_of("/?")) {
+        string scheme = target.substr(0, colon);
+        transform(scheme.begin(), scheme.end(), scheme.begin(), [](unsigned char c) { return tolower(c); });
+        if (scheme != "http")
+            throw invalid_argument("Cannot follow a redirect to " + target);
+        target.erase(0, colon + 1);
+    }
+
+    if (target.compare(0, 2, "//") == 0) {
+        auto const pathStart = min(target.find_first_of("/?", 2), target.size());
+        auto authority = target.substr(2, pathStart - 2);
+        auto const rest = split_query(target.substr(pathStart));
+        auto const path = rest.first.empty() ? string("/") : remove_dot_segments(rest.first);
+        return {move(authority), path + rest.second};
+    }
+
+    auto const base = split_query(resource.empty() ? string("/") : resource);
+    if (target.empty())
+        return {host, resource};
+    if (target[0] == '?')
+        return {host, base.first + target};
+    auto const relative = split_query(target);
+    if (target[0] == '/')
+        return {host, remove_dot_segments(relative.first) + relative.second};
+    auto const directory = base.first.substr(0, base.first.rfind('/') + 1);
+    return {host, remove_dot_segments(directory + relative.first) + relative.second};
+}
+
+
+TEST_CASE("resolve redirect locations") {
+    auto const resolve = [](string const & location) {
+        return resolve_location("a", "/b/c/d;p?q", location);
+    };
+    auto const in_a = [](string const & resource) { return make_pair(string("a"), resource); };
+    //Examples of RFC 3986 section 5.4
+    CHECK(resolve("g") == in_a("/b/c/g"));
+    CHECK(resolve("./g") == in_a("/b/c/g"));
+    CHECK(resolve("g/") == in_a("/b/c/g/"));
+    CHECK(resolve("/g") == in_a("/g"));
+    CHECK(resolve("?y") == in_a("/b/c/d;p?y"));
+    CHECK(resolve("g?y") == in_a("/b/c/g?y"));
+    CHECK(resolve("#s") == in_a("/b/c/d;p?q"));
+    CHECK(resolve("g#s") == in_a("/b/c/g"));
+    CHECK(resolve(".") == in_a("/b/c/"));
+    CHECK(resolve("..") == in_a("/b/"));
+    CHECK(resolve("../g") == in_a("/b/g"));
+    CHECK(resolve("../..") == in_a("/"));
+    CHECK(resolve("../../../g") == in_a("/g"));
+    CHECK(resolve("/./g") == in_a("/g"));
+    CHECK(resolve("g;x=1/../y") == in_a("/b/c/y"));
+
+    CHECK(resolve("//g") == make_pair(string("g"), string("/")));
+    CHECK(resolve("http://g:8080/x/../y?z") == make_pair(string("g:8080"), string("/y?z")));
+    CHECK(resolve("HTTP://g?z") == make_pair(string("g"), string("/?z")));
+    CHECK_THROWS_AS(resolve("https://g/"), invalid_argument);
+    CHECK(resolve_location("unix:/run/s.sock", "/x/y", "z") == make_pair(string("unix:/run/s.sock"), string("/x/z")));
+}
+
+
+namespace {
+
+void set_int_option(socket_t & s, int level, int name, int value) {
+    if (::setsockopt(s.native_handle(), level, name, &value, sizeof(value)) != 0)
+        throw boost::system::system_error{errno, boost::system::system_category()};
+}
+
+} //anon namespace
+
+
+void apply_socket_options(socket_t & s, socket_options const & options, bool tcp) {
+    if (options.receiveBufferSize)
+        s.set_option(net::socket_base::receive_buffer_size(options.receiveBufferSize));
+    if (options.sendBufferSize)
+        s.set_option(net::socket_base::send_buffer_size(options.sendBufferSize));
+    if (!tcp)
+        return;
+
+    if (options.noDelay)
+        s.set_option(ip::tcp::no_delay(true));
+    if (options.keepAliveIdle.count()) {
+        s.set_option(net::socket_base::keep_alive(true));
+#if defined(TCP_KEEPIDLE)
+        set_int_option(s, IPPROTO_TCP, TCP_KEEPIDLE, static_cast<int>(options.keepAliveIdle.count()));
+#elif defined(TCP_KEEPALIVE)
+        set_int_option(s, IPPROTO_TCP, TCP_KEEPALIVE, static_cast<int>(options.keepAliveIdle.count()));
+#endif
+#if defined(TCP_KEEPINTVL)
+        if (options.keepAliveInterval.count())
+            set_int_option(s, IPPROTO_TCP, TCP_KEEPINTVL,
+                           static_cast<int>(options.keepAliveInterval.count()));
+#endif
+#if defined(TCP_KEEPCNT)
+        if (options.keepAliveCount)
+            set_int_option(s, IPPROTO_TCP, TCP_KEEPCNT, options.keepAliveCount);
+#endif
+    }
+#if defined(SO_BUSY_POLL)
+    if (options.busyPollMicroseconds)
+        set_int_option(s, SOL_SOCKET, SO_BUSY_POLL, options.busyPollMicroseconds);
+#endif
+#if defined(TCP_FASTOPEN_CONNECT)
+    if (options.fastOpen)
+        set_int_option(s, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+#endif
+    apply_connected_socket_options(s, options, tcp);
+}
+
+
+void apply_connected_socket_options(socket_t & s, socket_options const & options, bool tcp) {
+#if defined(TCP_QUICKACK)
+    if (tcp && options.quickAck)
+        set_int_option(s, IPPROTO_TCP, TCP_QUICKACK, 1);
+#endif
+}
+
+
+vector<ip::tcp::endpoint> async_resolve_host(net::io_service & io,
+                                             string const & host,
+                                             net::yield_context yield) {
+    auto const hostPort = split_host_port(host);
+    ip::tcp::resolver::query q(hostPort.first, hostPort.second);
+    ip::tcp::resolver resolver(io);
+    vector<ip::tcp::endpoint> endpoints;
+    for (auto it = resolver.async_resolve(q, yield); it != ip::tcp::resolver::iterator{}; ++it)
+        endpoints.push_back(it->endpoint());
+    return endpoints;
+}
+
+
+void async_connect_host(net::io_service & io,
+                        socket_t & s,
+                        string const & host,
+                        net::yield_context yield,
+                        request_timings * timings,
+                        socket_options const & options) {
+    if (is_unix_socket_host(host)) {
+        if (timings)
+            timings->mark_resolved();
+        net::local::stream_protocol::endpoint const endpoint(host.substr(sizeof(unixSocketPrefix) - 1));
+        s.open(net::generic::stream_protocol(AF_UNIX, 0));
+        apply_socket_options(s, options, false);
+        s.async_connect(endpoint, yield);
+        if (timings)
+            timings->mark_connected();
+        return;
+    }
+
+    auto const endpoints = async_resolve_host(io, host, yield);
+    if (timings)
+        timings->mark_resolved();
+    async_connect_endpoints(io, s, endpoints, yield, options);
+    if (timings)
+        timings->mark_connected();
+}
+
+
+//Shared with the handler of the timer, which may run after the deadline is gone
+struct socket_deadline::state {
+    socket_t * socket = nullptr;
+    bool expired = false;
+};
+
+
+socket_deadline::socket_deadline(net::io_service & io,
+                                 chrono::steady_clock::duration timeOut,
+                                 net::yield_context yield)
+    : state_(make_shared<state>()), timer_(io) {
+    timer_.expires_from_now(timeOut);
+    auto onTimeout = [state = state_](boost::system::error_code ec) {
+        if (ec || state->expired)
+            return;
+        state->expired = true;
+        if (state->socket)
+            state->socket->close(ec);
+    };
+    //The handler runs in the strand of the coroutine. Bound to the strand itself, and not to
+    //the polymorphic executor, the timer tracks its work without a copy of the executor
+    using strand_t = net::strand<net::io_service::executor_type>;
+    auto const executor = coroutine_executor(yield);
+    if (auto const strand = executor.target<strand_t>())
+        timer_.async_wait(net::bind_executor(*strand, move(onTimeout)));
+    else
+        timer_.async_wait(net::bind_executor(executor, move(onTimeout)));
+}
+
+
+socket_deadline::~socket_deadline() {
+    state_->socket = nullptr;
+    timer_.cancel();
+}
+
+
+void socket_deadline::watch(socket_t & s) {
+    if (state_->expired) {
+        boost::system::error_code ec;
+        s.close(ec);
+    }
+    state_->socket = &s;
+}
+
+
+bool socket_deadline::expired() const {
+    //A coroutine that does not wait gives no chance to the timer
+    return state_->expired || chrono::steady_clock::now() >= timer_.expiry();
+}
+
+
+vector<ip::tcp::endpoint> interleave_address_families(vector<ip::tcp::endpoint> endpoints) {
+    if (endpoints.empty())
+        return endpoints;
+    bool const firstIsV6 = endpoints.front().address().is_v6();
+    vector<ip::tcp::endpoint> first, second;
+    for (auto const & endpoint : endpoints)
+        (endpoint.address().is_v6() == firstIsV6 ? first : second).push_back(endpoint);
+    endpoints.clear();
+    for (size_t i = 0; i < max(first.size(), second.size()); ++i) {
+        if (i < first.size())
+            endpoints.push_back(first[i]);
+        if (i < second.size())
+            endpoints.push_back(second[i]);
+    }
+    return endpoints;
+}
+
+
+TEST_CASE("interleave address families") {
+    auto const v4 = [](char const * address) {
+        return ip::tcp::endpoint(ip::address_v4::from_string(address), 80);
+    };
+    auto const v6 = [](char const * address) {
+        return ip::tcp::endpoint(ip::address_v6::from_string(address), 80);
+    };
+    CHECK(interleave_address_families({}).empty());
+    CHECK(interleave_address_families({v6("::1"), v6("::2"), v4("10.0.0.1"), v4("10.0.0.2"), v6("::3")})
+          == vector<ip::tcp::endpoint>{v6("::1"), v4("10.0.0.1"), v6("::2"), v4("10.0.0.2"), v6("::3")});
+    CHECK(interleave_address_families({v4("10.0.0.1"), v4("10.0.0.2"), v6("::1")})
+          == vector<ip::tcp::endpoint>{v4("10.0.0.1"), v6("::1"), v4("10.0.0.2")});
+}
+
+
+namespace {
+
+//Connection attempts of async_connect_endpoints. They run in the strand of the caller.
+struct connect_race {
+    explicit connect_race(net::io_service & io) : wakeup(io) {}
+
+    //Cancelled by every attempt that finishes, to wake up the caller
+    net::steady_timer wakeup;
+    vector<unique_ptr<socket_t>> sockets;
+    size_t running = 0;
+    int winner = -1;
+    boost::system::error_code lastError = net::error::host_not_found;
+};
+
+} //anon namespace
+
+
+void async_connect_endpoints(net::io_service & io,
+                             socket_t & s,
+                             vector<ip::tcp::endpoint> const & endpoints,
+                             net::yield_context yield,
+                             socket_options const & options,
+                             chrono::steady_clock::duration attemptDelay) {
+    //Nothing to race against: connect without the coroutine and state of the attempts
+    if (endpoints.size() == 1) {
+        s.open(net::generic::stream_protocol::endpoint(endpoints.front()).protocol());
+        apply_socket_options(s, options, true);
+        s.async_connect(endpoints.front(), yield);
+        apply_connected_socket_options(s, options, true);
+        return;
+    }
+
+    auto const ordered = interleave_address_families(endpoints);
+    auto race = make_shared<connect_race>(io);
+    race->sockets.reserve(ordered.size());
+    boost::system::error_code ec;
+    for (size_t i = 0; i < ordered.size() && race->winner < 0; ++i) {
+        race->sockets.push_back(make_unique<socket_t>(io));
+        ++race->running;
+        net::spawn(yield, [race, i, endpoint = ordered[i], options](net::yield_context attemptYield) {
+                boost::system::error_code ec;
+                auto & socket = *race->sockets[i];
+                try {
+                    socket.open(net::generic::stream_protocol::endpoint(endpoint).protocol());
+                    apply_socket_options(socket, options, true);
+                }
+                catch (boost::system::system_error const & e) {
+                    ec = e.code();
+                }
+                if (!ec)
+                    socket.async_connect(endpoint, attemptYield[ec]);
+                --race->running;
+                if (!ec && race->winner < 0)
+                    race->winner = static_cast<int>(i);
+                else if (ec && ec != net::error::operation_aborted)
+                    race->lastError = ec;
+                race->wakeup.cancel();
+            });
+        if (i + 1 < ordered.size()) {
+            race->wakeup.expires_from_now(attemptDelay);
+            race->wakeup.async_wait(yield[ec]);
+        }
+    }
+    while (race->winner < 0 && race->running) {
+        race->wakeup.expires_at(net::steady_timer::time_point::max());
+        race->wakeup.async_wait(yield[ec]);
+    }
+    if (race->winner < 0)
+        throw boost::system::system_error{race->lastError};
+
+    for (size_t i = 0; i < race->sockets.size(); ++i) {
+        if (static_cast<int>(i) != race->winner)
+            race->sockets[i]->close(ec);
+    }
+    s = move(*race->sockets[race->winner]);
+    apply_connected_socket_options(s, options, true);
+}
+
+
+TEST_CASE("happy eyeballs connects past loopback endpoints that do not answer") {
+    net::io_service io;
+    ip::tcp::endpoint const loopback(ip::address_v4::loopback(), 0);
+    ip::tcp::acceptor accepting(io, loopback);
+    //Once its backlog is full, a listener drops further connection requests
+    ip::tcp::acceptor blackhole(io);
+    blackhole.open(ip::tcp::v4());
+    blackhole.bind(loopback);
+    blackhole.listen(0);
+    ip::tcp::socket backlogFiller(io);
+    backlogFiller.connect(blackhole.local_endpoint());
+    ip::tcp::endpoint refusing;
+    {
+        ip::tcp::acceptor closed(io, loopback);
+        refusing = closed.local_endpoint();
+    }
+
+    auto const connect = [&io](vector<ip::tcp::endpoint> const & endpoints) {
+        socket_t s(io);
+        exception_ptr error;
+        net::spawn(io, [&](net::yield_context yield) {
+                try {
+                    async_connect_endpoints(io, s, endpoints, yield, {}, chrono::milliseconds(50));
+                }
+                catch (...) {
+                    error = current_exception();
+                }
+            });
+        io.run();
+        io.reset();
+        if (error)
+            rethrow_exception(error);
+        return s.remote_endpoint();
+    };
+
+    net::generic::stream_protocol::endpoint const acceptingEndpoint(accepting.local_endpoint());
+    auto const start = chrono::steady_clock::now();
+    CHECK(connect({blackhole.local_endpoint(), accepting.local_endpoint()}) == acceptingEndpoint);
+    //Without the staggered attempt, the blackholed one would wait for the SYN retransmissions
+    CHECK(chrono::steady_clock::now() - start < chrono::seconds(1));
+
+    CHECK(connect({refusing, accepting.local_endpoint()}) == acceptingEndpoint);
+    CHECK_THROWS_AS(connect({refusing}), boost::system::system_error);
+    CHECK_THROWS_AS(connect({}), boost::system::system_error);
+}
+
+
+TEST_CASE("socket options are set on loopback connections") {
+    net::io_service io;
+    ip::tcp::acceptor accepting(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    socket_options options;
+    options.receiveBufferSize = 256 * 1024;
+    options.keepAliveIdle = chrono::seconds(30);
+    options.keepAliveCount = 3;
+    socket_t s(io);
+    net::spawn(io, [&](net::yield_context yield) {
+            async_connect_host(io, s, "127.0.0.1:" + to_string(accepting.local_endpoint().port()),
+                               yield, nullptr, options);
+        });
+    io.run();
+
+    ip::tcp::no_delay noDelay;
+    s.get_option(noDelay);
+    CHECK(noDelay.value());
+    net::socket_base::receive_buffer_size receiveBufferSize;
+    s.get_option(receiveBufferSize);
+    CHECK(receiveBufferSize.value() >= 256 * 1024);
+    net::socket_base::keep_alive keepAlive;
+    s.get_option(keepAlive);
+    CHECK(keepAlive.value());
+#if defined(TCP_KEEPIDLE)
+    int idle = 0;
+    socklen_t size = sizeof(idle);
+    ::getsockopt(s.native_handle(), IPPROTO_TCP, TCP_KEEPIDLE, &idle, &size);
+    CHECK(idle == 30);
+#endif
+}
+
+
+TEST_CASE("receive buffer keeps small responses in its arena") {
+    receive_buffer buf;
+    string const response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    //As the first read of a response does
+    auto const space = buf.prepare(512);
+    net::buffer_copy(space, net::buffer(response));
+    buf.commit(response.size());
+    CHECK(buf.is_inline());
+    CHECK(parse_response_head(string_view_t(net::buffer_cast<char const *>(buf.data()), buf.size())).contentLength == 2);
+    buf.consume(response.size());
+    buf.prepare(1024);
+    CHECK(buf.is_inline());
+
+    //Larger responses go on in the heap
+    buf.prepare(64 * 1024);
+    buf.commit(64 * 1024);
+    CHECK(!buf.is_inline());
+}
+
+
+response_head async_read_response_head(socket_t & s,
+                                       receive_streambuf & buf,
+                                       net::yield_context yield) {
+    auto const headSize = net::async_read_until(s, buf, "\r\n\r\n",
+                                                yield);
+    //The head is parsed in place, out of the contiguous bytes of buf
+    auto head = parse_response_head(string_view_t(net::buffer_cast<char const *>(buf.data()), headSize));
+    buf.consume(headSize);
+    return head;
+}
+
+
+void async_read_fixed_body_into(socket_t & s,
+                                receive_streambuf & buf,
+                                byte_t * dest,
+                                size_t sizeInBytes,
+                                net::yield_context yield) {
+    //Body bytes that arrived together with the headers
+    auto const buffered = net::buffer_copy(net::buffer(dest, sizeInBytes), buf.data());
+    buf.consume(buffered);
+    if (buffered == sizeInBytes)
+        return;
+
+    boost::system::error_code ec{};
+    auto const bytesRead =
+        net::async_read(s, net::buffer(dest + buffered, sizeInBytes - buffered),
+                        yield[ec]);
+    if (ec && ec != net::error::eof)
+        throw boost::system::system_error{ec};
+    if (bytesRead != sizeInBytes - buffered)
+        throw runtime_error("Connection closed before the end of the response body");
+}
+
+
+response_body async_read_fixed_body(socket_t & s,
+                                    receive_streambuf & buf,
+                                    size_t sizeInBytes,
+                                    net::yield_context yield) {
+    response_body result(sizeInBytes);
+    async_read_fixed_body_into(s, buf, result.data(), sizeInBytes, yield);
+    return result;
+}
+
+
+void async_read_chunked_body(socket_t & s,
+                             receive_streambuf & buf,
+                             function<void(byte_t const *, size_t)> const & sink,
+                             net::yield_context yield) {
+    size_t chunkSize{};
+    istream is(&buf);
+    boost::system::error_code ec{};
+    //Reads until buf holds at least n bytes
+    auto fill = [&](size_t n) {
+        if (buf.size() >= n)
+            return;
+        net::async_read(s, buf, net::transfer_exactly(n - buf.size()), yield[ec]);
+        if (ec && ec != net::error::eof)
+            throw boost::system::system_error{ec};
+        if (buf.size() < n)
+            throw runtime_error("Connection closed before the end of the chunked body");
+    };
+    while (true) {
+        //Read the chunk size into the buffer, unless it came with the previous read, as
+        //the whole of a small body does
+        string_view_t const buffered(net::buffer_cast<char const *>(buf.data()), buf.size());
+        if (buffered.find("\r\n") == string_view_t::npos) {
+            net::async_read_until(s, buf, "\r\n",
+                                  yield[ec]);
+            if (ec && ec != net::error::eof)
+                throw boost::system::system_error{ec};
+        }
+        string chunkSizeStr;
+
+        //Put chunk size in a string
+        getline(is, chunkSizeStr);
+
+        //Convert hex chunksize into a decimal number
+        chunkSize = stoul(chunkSizeStr,
+                          nullptr, 16);
+        if (!chunkSize) {
+            //Discard the \r\n that ends the body
+            fill(2);
+            buf.consume(2);
+            break;
+        }
+
+        //Chunk data and its trailing \r\n
+        fill(chunkSize + 2);
+        sink(net::buffer_cast<byte_t const *>(buf.data()), chunkSize);
+        buf.consume(chunkSize + 2);
+    }
+}
+
+
+response_body async_read_chunked_body(socket_t & s,
+                                      receive_streambuf & buf,
+                                      net::yield_context yield) {
+    response_body result;
+    async_read_chunked_body(s, buf,
+                            [&result](byte_t const * data, size_t size) {
+                                result.append(data, size);
+                            },
+                            yield);
+    return result;
+}
+
+
+response_body async_read_body(socket_t & s,
+                              receive_streambuf & buf,
+                              bool readInChunks,
+                              net::yield_context yield,
+                              size_t contentLength) {
+    if (!readInChunks)
+        return async_read_fixed_body(s, buf, contentLength, yield);
+    return async_read_chunked_body(s, buf, yield);
+}
+
+
+namespace {
+
+int64_t parse_content_length(string_view_t value) {
+    if (value.empty() || value.size() > 18)
+        throw runtime_error("Cannot parse HTTP response -> invalid Content-Length");
+    int64_t length = 0;
+    for (auto c : value) {
+        if (c < '0' || c > '9')
+            throw runtime_error("Cannot parse HTTP response -> invalid Content-Length");
+        length = length * 10 + (c - '0');
+    }
+    return length;
+}
+
+} //anon namespace
+
+
+void parse_header_fields(string_view_t lines, response_head & head) {
+    head.headers = response_headers(lines);
+    head.known.fill(0);
+    head.contentLength = -1;
+    if (head.headers.size() >= UINT16_MAX)
+        throw runtime_error("Cannot parse HTTP response -> too many header fields");
+    for (size_t i = 0; i < head.headers.size(); ++i) {
+        auto const field = head.headers[i];
+        auto const known = find_header_field(field.name.data(), field.name.size());
+        if (known == header_field::unknown)
+            continue;
+        if (known == header_field::content_length)
+            head.contentLength = parse_content_length(field.value);
+        head.known[static_cast<size_t>(known)] = static_cast<uint16_t>(i + 1);
+    }
+}
+
+
+response_head parse_response_head(string_view_t lines) {
+    //HTTP/1.1 200 OK
+    auto const statusLineEnd = lines.find('\n');
+    auto const statusLine = lines.substr(0, statusLineEnd);
+    auto const codeStart = statusLine.find(' ');
+    if (codeStart == string_view_t::npos || statusLine.size() < codeStart + 4)
+        throw runtime_error("Cannot parse HTTP response -> invalid status line");
+    response_head head;
+    //HTTP/x.y, as 11 for HTTP/1.1. Anything else is taken as HTTP/1.1
+    if (codeStart == 8 && statusLine.substr(0, 5) == "HTTP/" && statusLine[6] == '.'
+        && isdigit(static_cast<unsigned char>(statusLine[5])) && isdigit(static_cast<unsigned char>(statusLine[7])))
+        head.version = (statusLine[5] - '0') * 10 + (statusLine[7] - '0');
+    for (auto c : statusLine.substr(codeStart + 1, 3)) {
+        if (c < '0' || c > '9')
+            throw runtime_error("Cannot parse HTTP response -> invalid status line");
+        head.status = head.status * 10 + (c - '0');
+    }
+    if (statusLineEnd != string_view_t::npos)
+        parse_header_fields(lines.substr(statusLineEnd + 1), head);
+    return head;
+}
+
+
+TEST_CASE("parse header fields") {
+    string const headersStr =
+        R"--(Date: Mon, 27 Jan 2017 12:28:53 GMT
+Server: Apache/2.2.14 (Win32)
+Last-Modified: Wed, 22 Jul 2009 19:15:56 GMT
+Content-Length: 88
+Content-Type: text/html
+X-Powered-By: PHP
+Connection: Closed)--";
+
+    response_head head;
+    parse_header_fields(headersStr, head);
+
+    CHECK(count_if(head.known.begin(), head.known.end(), [](uint16_t i) { return i != 0; }) == 6);
+    CHECK(head.contentLength == 88);
+    CHECK(head.get(header_field::content_length) == "88");
+    CHECK(head.get(header_field::date) == "Mon, 27 Jan 2017 12:28:53 GMT");
+    CHECK(!head.chunked());
+    REQUIRE(head.headers.size() == 7);
+    CHECK(head.headers[5].name == "X-Powered-By");
+    CHECK(head.headers.get("X-POWERED-BY") == "PHP");
+    CHECK(head.get(header_field::content_type) == "text/html");
+    CHECK(!head.has(header_field::location));
+    CHECK(!head.headers.has("x-cache"));
+}
+
+
+TEST_CASE("parse header fields strips line terminators") {
+    response_head head;
+    parse_header_fields("Content-Range: bytes 0-99/1000\r\nAccept-Ranges:  bytes \r\n\r\nIgnored: yes\r\n", head);
+
+    CHECK(head.headers.size() == 2);
+    CHECK(head.get(header_field::content_range) == "bytes 0-99/1000");
+    CHECK(head.get(header_field::accept_ranges) == "bytes");
+    CHECK(head.contentLength == -1);
+}
+
+
+TEST_CASE("parse response head") {
+    auto const head = parse_response_head("HTTP/1.1 301 Moved Permanently\r\n"
+                                          "Location: /there\r\n"
+                                          "Transfer-Encoding: chunked\r\n\r\n");
+    CHECK(head.status == 301);
+    CHECK(head.version == 11);
+    CHECK(head.get(header_field::location) == "/there");
+    CHECK(head.chunked());
+    auto moved = head;
+    auto const headers = move(moved.headers);
+    CHECK(!moved.has(header_field::location));
+    CHECK(moved.get(header_field::location).empty());
+    CHECK(parse_response_head("HTTP/1.1 204\r\n\r\n").status == 204);
+    CHECK(parse_response_head("HTTP/1.0 200 OK\r\n\r\n").version == 10);
+    CHECK_THROWS_AS(parse_response_head("HTTP/1.1 2x0 OK\r\n\r\n"), runtime_error);
+    CHECK_THROWS_AS(parse_response_head("HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n"),
+                    runtime_error);
+    CHECK(find_header_field("ETag", 4) == header_field::etag);
+    CHECK(find_header_field("Age", 3) == header_field::age);
+    CHECK(find_header_field("Agf", 3) == header_field::unknown);
+}
+
+} //ns detail
+
+} //ns srl
+
+} //ns gdg
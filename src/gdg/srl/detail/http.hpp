@@ -0,0 +1,300 @@
+#ifndef GDG_SRL_DETAIL_HTTP_HPP_
+#define GDG_SRL_DETAIL_HTTP_HPP_
+
+#include "gdg/srl/alias.hpp"
+#include "gdg/srl/detail/header_fields.hpp"
+#include "gdg/srl/detail/receive_buffer.hpp"
+#include "gdg/srl/response_body.hpp"
+#include "gdg/srl/response_headers.hpp"
+#include "gdg/srl/socket_options.hpp"
+#include "gdg/srl/timings.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gdg {
+
+namespace srl {
+
+namespace detail {
+
+/** Socket of every connection: TCP, or a Unix domain socket for "unix:" hosts
+ */
+using socket_t = net::generic::stream_protocol::socket;
+
+
+/** Prefix of hosts that name a Unix domain socket, as in "unix:/run/sidecar.sock"
+ */
+constexpr char unixSocketPrefix[] = "unix:";
+
+
+/** True if host names a Unix domain socket
+ */
+bool is_unix_socket_host(string_view_t host);
+
+
+/** Builds a GET request for resource in host.
+
+    The Host header of a Unix domain socket host is localhost.
+
+    @extraHeaders[in] additional header lines, each one terminated in \r\n
+    @keepAlive[in] if false, the request asks the server to close the connection
+ */
+std::string build_request(string_view_t host,
+                          string_view_t resource,
+                          string_view_t extraHeaders = "",
+                          bool keepAlive = false);
+
+
+/** Builds the head of a request with method for resource in host, as \ref build_request
+    does for GET
+ */
+std::string build_request_head(string_view_t method,
+                               string_view_t host,
+                               string_view_t resource,
+                               string_view_t extraHeaders,
+                               bool keepAlive);
+
+
+/** Status line and headers of a response.
+
+    The fields in \ref header_field are found at parse time, and the index of
+    each one in headers kept in a fixed slot.
+ */
+struct response_head {
+    /** HTTP version of the status line times ten: 11 for HTTP/1.1, 10 for HTTP/1.0 */
+    int version = 11;
+    int status = 0;
+    /** Content-Length, or -1 without it */
+    std::int64_t contentLength = -1;
+    /** All the fields, well-known or not, in the order they came */
+    response_headers headers;
+    /** Index in headers of each well-known field plus one, by header_field, zero if it
+        did not come. The last one of a repeated field is kept */
+    std::array<std::uint16_t, headerFieldCount> known{};
+
+    /** False for every field once headers are moved out */
+    bool has(header_field field) const {
+        auto const index = known[static_cast<std::size_t>(field)];
+        return index != 0 && index <= headers.size();
+    }
+
+    /** Value of field, empty if it did not come */
+    string_view_t get(header_field field) const {
+        return has(field) ? headers[known[static_cast<std::size_t>(field)] - 1u].value : string_view_t();
+    }
+
+    /** True if the body comes with a transfer coding, which can only be chunked */
+    bool chunked() const { return has(header_field::transfer_encoding); }
+};
+
+
+/** Parses header lines, ended in \r\n or \n, until an empty line or the end of lines,
+    as \ref response_headers does. Throws std::runtime_error if Content-Length is not a length
+ */
+void parse_header_fields(string_view_t lines, response_head & head);
+
+
+/** Parses a status line and its header lines.
+    Throws std::runtime_error if the status line is not valid
+ */
+response_head parse_response_head(string_view_t head);
+
+
+/** True if the connection can take another request after this response: unless it says
+    Connection: close in HTTP/1.1, and only if it says Connection: keep-alive in HTTP/1.0
+ */
+bool keeps_connection_open(response_head const & head);
+
+
+/** Splits "name:port" in name and port. Without a port, port is "http".
+
+    IPv6 addresses go in brackets to carry a port, as in "[::1]:8080". A host with more
+    than one colon and no brackets is taken as a bare IPv6 address without port.
+ */
+std::pair<std::string, std::string> split_host_port(std::string const & host);
+
+
+/** True for the statuses of redirects that repeat the request at Location: 301, 302, 303, 307 and 308
+ */
+bool is_redirect(int status);
+
+
+/** Host and resource of the target of a redirect from resource in host, as in RFC 3986 section 5.
+
+    location may be an absolute http URL, a network path (//host/path), an absolute
+    path or a path relative to resource. Dot segments are removed and the fragment dropped.
+    Throws std::invalid_argument for other schemes than http.
+ */
+std::pair<std::string, std::string> resolve_location(std::string const & host,
+                                                     std::string const & resource,
+                                                     string_view_t location);
+
+
+/** Sets options on s, opened and not connected yet.
+
+    @tcp[in] false for Unix domain sockets, which only get the buffer sizes
+ */
+void apply_socket_options(socket_t & s, socket_options const & options, bool tcp);
+
+
+/** Sets the options that only last once the connection is established (TCP_QUICKACK)
+ */
+void apply_connected_socket_options(socket_t & s, socket_options const & options, bool tcp);
+
+
+/** Time given to each connection attempt before starting the next one, as in RFC 8305
+ */
+constexpr std::chrono::milliseconds connectionAttemptDelay{250};
+
+
+/** Orders endpoints alternating their address families, starting with the family of the
+    first endpoint, and keeping the order within each family (RFC 8305, section 4).
+ */
+std::vector<ip::tcp::endpoint> interleave_address_families(std::vector<ip::tcp::endpoint> endpoints);
+
+
+/** Connects s to endpoints with Happy Eyeballs (RFC 8305).
+
+    Endpoints are tried in the order of \ref interleave_address_families. Each attempt
+    starts when the previous one fails or after attemptDelay, whatever happens first,
+    without cancelling the attempts in progress. The first connection established wins
+    and the other attempts are cancelled. Throws the error of the last attempt if all fail.
+
+    @options[in] set on the socket of every attempt before connecting
+ */
+void async_connect_endpoints(net::io_service & io,
+                             socket_t & s,
+                             std::vector<ip::tcp::endpoint> const & endpoints,
+                             net::yield_context yield,
+                             socket_options const & options = {},
+                             std::chrono::steady_clock::duration attemptDelay = connectionAttemptDelay);
+
+
+/** Resolves host, which may carry a port as in "localhost:8080", to its endpoints
+ */
+std::vector<ip::tcp::endpoint> async_resolve_host(net::io_service & io,
+                                                  std::string const & host,
+                                                  net::yield_context yield);
+
+
+/** Resolves host and connects socket to the first endpoint that accepts the connection,
+    with \ref async_connect_endpoints
+
+    host may carry a port, as in "localhost:8080", or name a Unix domain socket, as in
+    "unix:/run/sidecar.sock", which is connected without resolution.
+
+    @timings[in,out] if not null, resolution and connection are marked on it
+    @options[in] set on the socket as it is created
+ */
+void async_connect_host(net::io_service & io,
+                        socket_t & s,
+                        std::string const & host,
+                        net::yield_context yield,
+                        request_timings * timings = nullptr,
+                        socket_options const & options = {});
+
+
+/** Executor of the coroutine of yield, its strand. yield_context has it since asio 1.24
+    (boost 1.80). Before, only the handler that resumes the coroutine has it
+ */
+inline net::any_io_executor coroutine_executor(net::yield_context const & yield) {
+#if (defined(BOOST_ASIO_VERSION) && BOOST_ASIO_VERSION >= 102400) || (defined(ASIO_VERSION) && ASIO_VERSION >= 102400)
+    return yield.get_executor();
+#else
+    return yield.handler_.get_executor();
+#endif
+}
+
+
+/** Closes the socket of a request once its time is out, so that the read or write pending
+    on it fails instead of waiting for a server that stopped answering.
+
+    Its timer runs in the strand of the coroutine of yield, the only one that may use the
+    socket. Destroying it stops the timer.
+ */
+class socket_deadline {
+public:
+    socket_deadline(net::io_service & io, std::chrono::steady_clock::duration timeOut, net::yield_context yield);
+
+    ~socket_deadline();
+
+    socket_deadline(socket_deadline const &) = delete;
+    socket_deadline & operator=(socket_deadline const &) = delete;
+
+    /** s is closed at the timeout instead of the socket watched before. At once if the time is out
+     */
+    void watch(socket_t & s);
+
+    /** True once the time is out, when the failure of the request is a timeout whatever it
+        was. Also before the timer runs, which a loop that never waits on the socket can check
+     */
+    bool expired() const;
+
+private:
+    struct state;
+    std::shared_ptr<state> state_;
+    net::steady_timer timer_;
+};
+
+
+/** Reads the status line and headers of a response.
+
+    Body bytes read past the headers are left in buf.
+ */
+response_head async_read_response_head(socket_t & s,
+                                       receive_streambuf & buf,
+                                       net::yield_context yield);
+
+
+/** Reads exactly sizeInBytes of body into dest, consuming first what is already in buf.
+
+    Throws if the connection is closed before the whole body is read.
+ */
+void async_read_fixed_body_into(socket_t & s,
+                                receive_streambuf & buf,
+                                byte_t * dest,
+                                std::size_t sizeInBytes,
+                                net::yield_context yield);
+
+
+response_body async_read_fixed_body(socket_t & s,
+                                    receive_streambuf & buf,
+                                    std::size_t sizeInBytes,
+                                    net::yield_context yield);
+
+
+/** Reads a chunked body passing the data of each chunk to sink as it arrives
+ */
+void async_read_chunked_body(socket_t & s,
+                             receive_streambuf & buf,
+                             std::function<void(byte_t const *, std::size_t)> const & sink,
+                             net::yield_context yield);
+
+
+response_body async_read_chunked_body(socket_t & s,
+                                      receive_streambuf & buf,
+                                      net::yield_context yield);
+
+
+/** Reads a body of contentLength bytes, or a chunked one. Small bodies stay inline
+ */
+response_body async_read_body(socket_t & s,
+                              receive_streambuf & buf,
+                              bool readInChunks,
+                              net::yield_context yield,
+                              std::size_t contentLength = 0);
+
+} //ns detail
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
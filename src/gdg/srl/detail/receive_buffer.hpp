@@ -0,0 +1,110 @@
+#ifndef GDG_SRL_DETAIL_RECEIVE_BUFFER_HPP_
+#define GDG_SRL_DETAIL_RECEIVE_BUFFER_HPP_
+
+#include "gdg/srl/alias.hpp"
+#include <cstddef>
+#include <limits>
+#include <new>
+
+namespace gdg {
+
+namespace srl {
+
+namespace detail {
+
+/** Bytes that an \ref arena_allocator hands out before going to the heap.
+
+    Allocations are carved one after the other. Only the last one is given back to
+    the arena when freed, which is what a growing buffer needs.
+ */
+struct receive_arena {
+    //The streambuf starts with 128 bytes and grows to 512 for its first read: a response
+    //that arrives in one read fits, with room for its head to grow once more
+    static constexpr std::size_t capacity = 2048;
+
+    alignas(std::max_align_t) unsigned char bytes[capacity];
+    std::size_t used = 0;
+};
+
+
+/** Allocator that takes memory from a \ref receive_arena while it has room, and from the
+    heap afterwards
+ */
+template <typename T>
+class arena_allocator {
+public:
+    using value_type = T;
+
+    explicit arena_allocator(receive_arena & arena) noexcept : arena_(&arena) {}
+
+    template <typename U>
+    arena_allocator(arena_allocator<U> const & other) noexcept : arena_(other.arena_) {}
+
+    T * allocate(std::size_t n) {
+        auto const bytes = n * sizeof(T);
+        auto const start = (arena_->used + alignof(T) - 1) / alignof(T) * alignof(T);
+        if (bytes <= receive_arena::capacity && start <= receive_arena::capacity - bytes) {
+            arena_->used = start + bytes;
+            return reinterpret_cast<T *>(arena_->bytes + start);
+        }
+        return static_cast<T *>(::operator new(bytes));
+    }
+
+    void deallocate(T * p, std::size_t n) noexcept {
+        auto const bytes = reinterpret_cast<unsigned char *>(p);
+        if (bytes < arena_->bytes || bytes >= arena_->bytes + receive_arena::capacity) {
+            ::operator delete(p);
+            return;
+        }
+        if (bytes + n * sizeof(T) == arena_->bytes + arena_->used)
+            arena_->used = static_cast<std::size_t>(bytes - arena_->bytes);
+    }
+
+    template <typename U>
+    bool operator==(arena_allocator<U> const & other) const noexcept { return arena_ == other.arena_; }
+
+    template <typename U>
+    bool operator!=(arena_allocator<U> const & other) const noexcept { return arena_ != other.arena_; }
+
+private:
+    template <typename U>
+    friend class arena_allocator;
+
+    receive_arena * arena_;
+};
+
+
+/** Streambuf of a \ref receive_buffer, as taken by the functions that read responses.
+    Reads of asio take it, and not the receive_buffer, as a streambuf
+ */
+using receive_streambuf = net::basic_streambuf<arena_allocator<char>>;
+
+
+/** Buffer in which a response is received.
+
+    A streambuf whose memory comes first from an arena inside the object, so that a small
+    response, head and body, is received without allocating: the head is parsed and the
+    body copied out of the same bytes. It is not movable, as the arena is in the object.
+ */
+class receive_buffer : private receive_arena, public receive_streambuf {
+public:
+    receive_buffer()
+        : receive_arena(),
+          receive_streambuf(std::numeric_limits<std::size_t>::max(), arena_allocator<char>(*this)) {
+    }
+
+    /** True while the bytes received are in the arena */
+    bool is_inline() const {
+        auto const received = net::buffer_cast<unsigned char const *>(data());
+        return received >= bytes && received < bytes + receive_arena::capacity;
+    }
+};
+
+} //ns detail
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef GDG_SRL_DETAIL_UNIQUE_FD_HPP_
+#define GDG_SRL_DETAIL_UNIQUE_FD_HPP_
+
+#include <cerrno>
+#include <system_error>
+#include <unistd.h>
+
+namespace gdg {
+
+namespace srl {
+
+namespace detail {
+
+/** Owns a file descriptor
+ */
+class unique_fd {
+public:
+    explicit unique_fd(int fd) : fd_(fd) {}
+
+    unique_fd(unique_fd const &) = delete;
+    unique_fd & operator=(unique_fd const &) = delete;
+
+    ~unique_fd() {
+        if (fd_ != -1)
+            ::close(fd_);
+    }
+
+    int get() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+
+/** Throws the error in errno as a std::system_error
+ */
+[[noreturn]] inline void throw_errno(char const * what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+} //ns detail
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,447 @@
+#include "gdg/srl/endpoint_set.hpp"
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+
+namespace {
+
+
+class round_robin_selector : public endpoint_selector {
+public:
+    size_t select(vector<endpoint_load> const & endpoints) override {
+        return next_++ % endpoints.size();
+    }
+
+private:
+    size_t next_ = 0;
+};
+
+
+class least_outstanding_selector : public endpoint_selector {
+public:
+    size_t select(vector<endpoint_load> const & endpoints) override {
+        size_t best = 0;
+        for (size_t i = 1; i < endpoints.size(); ++i) {
+            if (endpoints[i].outstanding < endpoints[best].outstanding)
+                best = i;
+        }
+        return best;
+    }
+};
+
+
+//Two different indexes taken at random out of size, which is over one
+pair<size_t, size_t> two_choices(size_t size, mt19937_64 & generator) {
+    auto const first = uniform_int_distribution<size_t>(0, size - 1)(generator);
+    //The second among the others, so that the two choices differ
+    auto const second = (first + 1 + uniform_int_distribution<size_t>(0, size - 2)(generator)) % size;
+    return {first, second};
+}
+
+
+class power_of_two_choices_selector : public endpoint_selector {
+public:
+    size_t select(vector<endpoint_load> const & endpoints) override {
+        if (endpoints.size() == 1)
+            return 0;
+        auto const choices = two_choices(endpoints.size(), generator_);
+        return endpoints[choices.second].outstanding < endpoints[choices.first].outstanding
+            ? choices.second : choices.first;
+    }
+
+private:
+    mt19937_64 generator_{random_device{}()};
+};
+
+
+class power_of_two_latency_selector : public endpoint_selector {
+public:
+    size_t select(vector<endpoint_load> const & endpoints) override {
+        if (endpoints.size() == 1)
+            return 0;
+        //Endpoints without responses yet are taken as the average of the others, so
+        //that they are neither shunned nor flooded
+        double total = 0;
+        size_t measured = 0;
+        for (auto const & endpoint : endpoints) {
+            if (endpoint.latency > endpoint_load{}.latency) {
+                total += chrono::duration<double>(endpoint.latency).count();
+                ++measured;
+            }
+        }
+        auto const unknown = measured ? total / measured : 1.0;
+        auto const cost = [unknown](endpoint_load const & endpoint) {
+            auto const latency = endpoint.latency > endpoint_load{}.latency
+                ? chrono::duration<double>(endpoint.latency).count() : unknown;
+            return latency * (endpoint.outstanding + 1);
+        };
+        auto const choices = two_choices(endpoints.size(), generator_);
+        return cost(endpoints[choices.second]) < cost(endpoints[choices.first]) ? choices.second : choices.first;
+    }
+
+private:
+    mt19937_64 generator_{random_device{}()};
+};
+
+
+vector<string> endpoint_hosts(vector<ip::tcp::endpoint> const & endpoints) {
+    if (endpoints.empty())
+        throw invalid_argument("An endpoint set needs at least one endpoint");
+    vector<string> hosts;
+    for (auto const & endpoint : endpoints) {
+        auto const address = endpoint.address().to_string();
+        hosts.push_back((endpoint.address().is_v6() ? "[" + address + "]" : address)
+                        + ":" + to_string(endpoint.port()));
+    }
+    return hosts;
+}
+
+
+} //anon namespace
+
+
+namespace gdg {
+
+namespace srl {
+
+
+unique_ptr<endpoint_selector> make_endpoint_selector(endpoint_policy policy) {
+    switch (policy) {
+    case endpoint_policy::least_outstanding:
+        return make_unique<least_outstanding_selector>();
+    case endpoint_policy::power_of_two_choices:
+        return make_unique<power_of_two_choices_selector>();
+    case endpoint_policy::power_of_two_latency:
+        return make_unique<power_of_two_latency_selector>();
+    case endpoint_policy::round_robin:
+        break;
+    }
+    return make_unique<round_robin_selector>();
+}
+
+
+endpoint_set::endpoint_set(endpoint_options options)
+    : options_(move(options)),
+      hosts_(endpoint_hosts(options_.endpoints)),
+      health_(options_.endpoints.size()),
+      selector_(options_.selector ? options_.selector() : make_endpoint_selector(options_.policy)),
+      generator_(random_device{}()) {
+    for (auto const & endpoint : options_.endpoints) {
+        endpoint_load load;
+        load.endpoint = endpoint;
+        loads_.push_back(load);
+    }
+}
+
+
+size_t endpoint_set::acquire(clock::time_point now) {
+    lock_guard<mutex> lock(mtx_);
+    candidates_.clear();
+    candidateIndexes_.clear();
+    //Endpoints in slow start are offered in proportion to their weight
+    uniform_real_distribution<double> draw(0, 1);
+    bool slowStarting = false;
+    for (size_t i = 0; i < loads_.size(); ++i) {
+        auto current = load(i, now);
+        if (current.ejected)
+            continue;
+        if (current.weight < 1 && draw(generator_) >= current.weight) {
+            slowStarting = true;
+            continue;
+        }
+        candidates_.push_back(move(current));
+        candidateIndexes_.push_back(i);
+    }
+    //All the healthy endpoints are in slow start and lost the draw
+    for (size_t i = 0; candidates_.empty() && slowStarting && i < loads_.size(); ++i) {
+        auto current = load(i, now);
+        if (!current.ejected) {
+            candidates_.push_back(move(current));
+            candidateIndexes_.push_back(i);
+        }
+    }
+    size_t index = 0;
+    if (!candidates_.empty())
+        index = candidateIndexes_[selector_->select(candidates_) % candidates_.size()];
+    ++loads_[index].outstanding;
+    return index;
+}
+
+
+void endpoint_set::release(size_t index) {
+    lock_guard<mutex> lock(mtx_);
+    --loads_[index].outstanding;
+}
+
+
+void endpoint_set::release_succeeded(size_t index, clock::duration latency) {
+    lock_guard<mutex> lock(mtx_);
+    auto & endpoint = loads_[index];
+    --endpoint.outstanding;
+    health_[index].consecutiveErrors = 0;
+    if (endpoint.latency == clock::duration::zero()) {
+        endpoint.latency = latency;
+        return;
+    }
+    auto const weight = options_.latencyWeight;
+    chrono::duration<double> const average = chrono::duration<double>(endpoint.latency) * (1 - weight)
+        + chrono::duration<double>(latency) * weight;
+    endpoint.latency = chrono::duration_cast<clock::duration>(average);
+}
+
+
+void endpoint_set::release_failed(size_t index, clock::time_point now) {
+    lock_guard<mutex> lock(mtx_);
+    auto & endpoint = loads_[index];
+    auto & endpointHealth = health_[index];
+    --endpoint.outstanding;
+    auto const & ejection = options_.ejection;
+    if (!ejection.consecutiveErrors || ++endpointHealth.consecutiveErrors < ejection.consecutiveErrors
+        || endpointHealth.ejectedUntil > now)
+        return;
+    size_t ejected = 0;
+    for (auto const & other : health_)
+        ejected += other.ejectedUntil > now;
+    //Past the limit, the endpoint is ejected once another one comes back
+    if (ejected + 1 >= loads_.size() || ejected + 1 > ejection.maxEjectedRatio * loads_.size())
+        return;
+    ++endpoint.ejections;
+    endpointHealth.consecutiveErrors = 0;
+    endpointHealth.ejectedUntil = now + ejection.ejectionTime;
+}
+
+
+ip::tcp::endpoint const & endpoint_set::endpoint(size_t index) const {
+    //Endpoints never change: no lock needed
+    return loads_[index].endpoint;
+}
+
+
+string const & endpoint_set::host(size_t index) const {
+    return hosts_[index];
+}
+
+
+vector<endpoint_load> endpoint_set::loads(clock::time_point now) const {
+    lock_guard<mutex> lock(mtx_);
+    vector<endpoint_load> result;
+    for (size_t i = 0; i < loads_.size(); ++i)
+        result.push_back(load(i, now));
+    return result;
+}
+
+
+endpoint_load endpoint_set::load(size_t index, clock::time_point now) const {
+    auto result = loads_[index];
+    auto const ejectedUntil = health_[index].ejectedUntil;
+    result.ejected = ejectedUntil > now;
+    result.weight = 1;
+    if (result.ejected)
+        result.weight = 0;
+    else if (result.ejections && now - ejectedUntil < options_.slowStart)
+        result.weight = max(0.1, chrono::duration<double>(now - ejectedUntil) / options_.slowStart);
+    return result;
+}
+
+
+resolved_endpoints::resolved_endpoints(endpoint_options options, clock::duration ttl)
+    : options_(move(options)),
+      ttl_(ttl) {
+}
+
+
+shared_ptr<endpoint_set> resolved_endpoints::find(string const & host, clock::time_point now) const {
+    lock_guard<mutex> lock(mtx_);
+    auto const it = hosts_.find(host);
+    return it != hosts_.end() && now < it->second.expires ? it->second.endpoints : nullptr;
+}
+
+
+shared_ptr<endpoint_set> resolved_endpoints::latest(string const & host) const {
+    lock_guard<mutex> lock(mtx_);
+    auto const it = hosts_.find(host);
+    return it != hosts_.end() ? it->second.endpoints : nullptr;
+}
+
+
+shared_ptr<endpoint_set> resolved_endpoints::update(string const & host,
+                                                    vector<ip::tcp::endpoint> addresses,
+                                                    clock::time_point now) {
+    lock_guard<mutex> lock(mtx_);
+    auto const it = hosts_.find(host);
+    if (it == hosts_.end() || it->second.addresses != addresses) {
+        auto options = options_;
+        options.endpoints = addresses;
+        //Made before the entry, which is left as it was if addresses is empty
+        auto endpoints = make_shared<endpoint_set>(move(options));
+        hosts_[host] = {move(addresses), move(endpoints), now + ttl_};
+        return hosts_[host].endpoints;
+    }
+    it->second.expires = now + ttl_;
+    return it->second.endpoints;
+}
+
+
+namespace {
+
+endpoint_options local_endpoints(size_t count, endpoint_policy policy) {
+    endpoint_options options;
+    options.policy = policy;
+    for (size_t i = 0; i < count; ++i)
+        options.endpoints.emplace_back(ip::address_v4::loopback(), static_cast<unsigned short>(8000 + i));
+    return options;
+}
+
+} //anon namespace
+
+
+TEST_CASE("endpoint set spreads requests by its policy") {
+    endpoint_set roundRobin(local_endpoints(3, endpoint_policy::round_robin));
+    CHECK(roundRobin.host(2) == "127.0.0.1:8002");
+    CHECK(roundRobin.acquire() == 0);
+    CHECK(roundRobin.acquire() == 1);
+    CHECK(roundRobin.acquire() == 2);
+    CHECK(roundRobin.acquire() == 0);
+    CHECK(roundRobin.loads()[0].outstanding == 2);
+    roundRobin.release(0);
+    CHECK(roundRobin.loads()[0].outstanding == 1);
+
+    endpoint_set leastOutstanding(local_endpoints(3, endpoint_policy::least_outstanding));
+    CHECK(leastOutstanding.acquire() == 0);
+    CHECK(leastOutstanding.acquire() == 1);
+    leastOutstanding.release(0);
+    CHECK(leastOutstanding.acquire() == 0);
+    CHECK(leastOutstanding.acquire() == 2);
+
+    //Two choices never take the busiest of two endpoints
+    endpoint_set twoChoices(local_endpoints(2, endpoint_policy::power_of_two_choices));
+    for (int i = 0; i < 10; ++i) {
+        auto const index = twoChoices.acquire();
+        auto const loads = twoChoices.loads();
+        CHECK(loads[index].outstanding <= loads[1 - index].outstanding + 1);
+    }
+
+    CHECK_THROWS_AS(endpoint_set(endpoint_options{}), invalid_argument);
+
+    struct last_selector : endpoint_selector {
+        size_t select(vector<endpoint_load> const & endpoints) override { return endpoints.size() - 1; }
+    };
+    auto custom = local_endpoints(3, endpoint_policy::round_robin);
+    custom.selector = [] { return make_unique<last_selector>(); };
+    endpoint_set customSet(custom);
+    CHECK(customSet.acquire() == 2);
+    CHECK(customSet.acquire() == 2);
+
+    auto v6 = local_endpoints(1, endpoint_policy::round_robin);
+    v6.endpoints[0] = ip::tcp::endpoint(ip::address_v6::loopback(), 80);
+    CHECK(endpoint_set(v6).host(0) == "[::1]:80");
+}
+
+
+TEST_CASE("endpoint set ejects failing endpoints and slow starts them back") {
+    auto options = local_endpoints(3, endpoint_policy::least_outstanding);
+    options.ejection.consecutiveErrors = 2;
+    options.ejection.ejectionTime = 10s;
+    options.ejection.maxEjectedRatio = 0.5;
+    options.slowStart = 10s;
+    endpoint_set endpoints(options);
+    auto const start = endpoint_set::clock::now();
+
+    //A success in between starts the count again
+    endpoints.release_failed(endpoints.acquire(start), start);
+    CHECK(endpoints.acquire(start) == 0);
+    endpoints.release_succeeded(0, 5ms);
+    endpoints.release_failed(endpoints.acquire(start), start);
+    CHECK(!endpoints.loads(start)[0].ejected);
+    endpoints.release_failed(endpoints.acquire(start), start);
+    auto loads = endpoints.loads(start);
+    CHECK(loads[0].ejected);
+    CHECK(loads[0].ejections == 1);
+    CHECK(loads[0].latency == chrono::milliseconds(5));
+    for (int i = 0; i < 10; ++i) {
+        auto const index = endpoints.acquire(start);
+        CHECK(index != 0);
+        endpoints.release(index);
+    }
+
+    //At most half of them ejected
+    for (int i = 0; i < 2; ++i) {
+        CHECK(endpoints.acquire(start) == 1);
+        endpoints.release_failed(1, start);
+    }
+    CHECK(!endpoints.loads(start)[1].ejected);
+
+    //Back after the ejection, with a share growing to all of its requests
+    auto const back = start + 10s;
+    CHECK(!endpoints.loads(back)[0].ejected);
+    CHECK(endpoints.loads(back)[0].weight == 0.1);
+    CHECK(endpoints.loads(back + 5s)[0].weight == 0.5);
+    CHECK(endpoints.loads(back + 10s)[0].weight == 1);
+    size_t taken = 0;
+    for (int i = 0; i < 1000; ++i) {
+        auto const index = endpoints.acquire(back);
+        taken += index == 0;
+        endpoints.release(index);
+    }
+    CHECK(taken > 0);
+    CHECK(taken < 500);
+}
+
+
+TEST_CASE("endpoint set weighs latency in two choices") {
+    auto options = local_endpoints(2, endpoint_policy::power_of_two_latency);
+    options.latencyWeight = 0.5;
+    endpoint_set endpoints(options);
+    //Until both are measured they cost the same and are taken at random
+    for (int i = 0; i < 40; ++i) {
+        auto const index = endpoints.acquire();
+        endpoints.release_succeeded(index, index ? 20ms : 90ms);
+    }
+    CHECK(endpoints.loads()[0].latency == chrono::milliseconds(90));
+    CHECK(endpoints.loads()[1].latency == chrono::milliseconds(20));
+
+    auto single = local_endpoints(1, endpoint_policy::power_of_two_latency);
+    single.latencyWeight = 0.5;
+    endpoint_set averaged(single);
+    averaged.release_succeeded(averaged.acquire(), 10ms);
+    averaged.release_succeeded(averaged.acquire(), 30ms);
+    CHECK(averaged.loads()[0].latency == chrono::milliseconds(20));
+
+    //The fast endpoint takes requests until its queue costs as much as the slow one
+    for (int i = 0; i < 4; ++i)
+        CHECK(endpoints.acquire() == 1);
+    CHECK(endpoints.acquire() == 0);
+}
+
+
+TEST_CASE("resolved endpoints keep their set while the addresses do not change") {
+    resolved_endpoints resolved({}, 10s);
+    auto const start = resolved_endpoints::clock::now();
+    CHECK(!resolved.find("backend", start));
+    auto const addresses = local_endpoints(2, endpoint_policy::round_robin).endpoints;
+    auto const endpoints = resolved.update("backend", addresses, start);
+    CHECK(endpoints->size() == 2);
+    CHECK(resolved.find("backend", start + 5s) == endpoints);
+    CHECK(!resolved.find("backend", start + 10s));
+    CHECK(resolved.latest("backend") == endpoints);
+
+    CHECK(resolved.update("backend", addresses, start + 10s) == endpoints);
+    CHECK(resolved.find("backend", start + 15s) == endpoints);
+    auto const moved = resolved.update("backend", local_endpoints(3, endpoint_policy::round_robin).endpoints);
+    CHECK(moved != endpoints);
+    CHECK(moved->size() == 3);
+    CHECK_THROWS_AS(resolved.update("nowhere", {}), invalid_argument);
+}
+
+
+} //ns srl
+
+} //ns gdg
@@ -0,0 +1,215 @@
+#ifndef GDG_SRL_ENDPOINT_SET_HPP_
+#define GDG_SRL_ENDPOINT_SET_HPP_
+
+#include "gdg/srl/alias.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace gdg {
+
+namespace srl {
+
+/** How an \ref endpoint_set picks the endpoint of each request
+ */
+enum class endpoint_policy {
+    /** Each endpoint in turn */
+    round_robin,
+    /** The endpoint with fewest requests outstanding, the first of them on ties */
+    least_outstanding,
+    /** The one with fewest requests outstanding of two endpoints taken at random */
+    power_of_two_choices,
+    /** The one with the lowest latency times requests outstanding of two endpoints taken
+        at random. Latency is the moving average of endpoint_load::latency */
+    power_of_two_latency
+};
+
+
+/** What an \ref endpoint_selector knows of each endpoint
+ */
+struct endpoint_load {
+    ip::tcp::endpoint endpoint;
+    /** Requests to the endpoint not over yet */
+    std::size_t outstanding = 0;
+    /** Exponentially weighted moving average of the latency of its responses. Zero
+        until the first one */
+    std::chrono::steady_clock::duration latency = std::chrono::steady_clock::duration::zero();
+    /** Left out of the requests after too many errors in a row. Selectors never see
+        ejected endpoints */
+    bool ejected = false;
+    /** Times the endpoint was ejected */
+    std::uint64_t ejections = 0;
+    /** Share of its requests the endpoint takes, under 1 during the slow start that
+        follows an ejection */
+    double weight = 1;
+};
+
+
+/** Picks the endpoint of each request. Implement it to plug a policy of your own
+    into \ref endpoint_options.
+ */
+class endpoint_selector {
+public:
+    virtual ~endpoint_selector() = default;
+
+    /** Index in endpoints, never empty, of the endpoint of the next request.
+        Calls are serialized by the \ref endpoint_set that owns the selector
+     */
+    virtual std::size_t select(std::vector<endpoint_load> const & endpoints) = 0;
+};
+
+
+/** Selector implementing policy
+ */
+std::unique_ptr<endpoint_selector> make_endpoint_selector(endpoint_policy policy);
+
+
+/** When an \ref endpoint_set stops sending requests to an endpoint that fails
+ */
+struct outlier_ejection_options {
+    /** Failures in a row that eject an endpoint. Zero to never eject */
+    unsigned consecutiveErrors = 5;
+    /** Time an endpoint stays ejected */
+    std::chrono::steady_clock::duration ejectionTime = std::chrono::seconds(30);
+    /** Most endpoints ejected at once, as a share of all of them. One always stays */
+    double maxEjectedRatio = 0.5;
+};
+
+
+/** Endpoints of a host known in advance, as given by service discovery, and how requests
+    are spread among them
+ */
+struct endpoint_options {
+    std::vector<ip::tcp::endpoint> endpoints;
+    endpoint_policy policy = endpoint_policy::round_robin;
+    /** If set, makes the selector used instead of policy */
+    std::function<std::unique_ptr<endpoint_selector>()> selector;
+    /** Weight of each response in the moving average of the latency */
+    double latencyWeight = 0.3;
+    outlier_ejection_options ejection;
+    /** Time an endpoint back from an ejection takes to get its full share of requests,
+        which grows linearly from a tenth. Zero to give it at once */
+    std::chrono::steady_clock::duration slowStart = std::chrono::seconds(0);
+};
+
+
+/** Endpoints of a host that is not resolved, with the requests outstanding to each one
+    and their health.
+
+    An endpoint is ejected after options.ejection.consecutiveErrors failures in a row,
+    and comes back after options.ejection.ejectionTime with a slow start.
+
+    Thread safe.
+ */
+class endpoint_set {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /** Throws std::invalid_argument if options has no endpoints */
+    explicit endpoint_set(endpoint_options options);
+
+    endpoint_set(endpoint_set const &) = delete;
+    endpoint_set & operator=(endpoint_set const &) = delete;
+
+    /** Picks the endpoint of a request, counted as outstanding until it is released
+        @return its index
+     */
+    std::size_t acquire(clock::time_point now = clock::now());
+
+    /** Ends a request that neither succeeded nor failed, as a cancelled one */
+    void release(std::size_t index);
+
+    /** Ends a request answered after latency */
+    void release_succeeded(std::size_t index, clock::duration latency);
+
+    /** Ends a request that failed, which counts towards the ejection of its endpoint */
+    void release_failed(std::size_t index, clock::time_point now = clock::now());
+
+    std::size_t size() const { return hosts_.size(); }
+
+    ip::tcp::endpoint const & endpoint(std::size_t index) const;
+
+    /** The endpoint as a host ("address:port"), under which its connections are pooled */
+    std::string const & host(std::size_t index) const;
+
+    std::vector<endpoint_load> loads(clock::time_point now = clock::now()) const;
+
+private:
+    struct health {
+        unsigned consecutiveErrors = 0;
+        //Slow start begins when the ejection is over
+        clock::time_point ejectedUntil;
+    };
+
+    //Endpoint index as it is at now, with its ejection and weight. Called with the lock held
+    endpoint_load load(std::size_t index, clock::time_point now) const;
+
+    endpoint_options const options_;
+    std::vector<std::string> const hosts_;
+    mutable std::mutex mtx_;
+    std::vector<endpoint_load> loads_;
+    std::vector<health> health_;
+    std::unique_ptr<endpoint_selector> selector_;
+    std::mt19937_64 generator_;
+    //Endpoints offered to the selector, kept to not allocate on every request
+    std::vector<endpoint_load> candidates_;
+    std::vector<std::size_t> candidateIndexes_;
+};
+
+
+/** Endpoint sets of the hosts a client resolves to spread their requests, each one
+    trusted for a time to live after its resolution.
+
+    Thread safe.
+ */
+class resolved_endpoints {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /** @options[in] policy, ejection and slow start of every host. Its endpoints are not used */
+    resolved_endpoints(endpoint_options options, clock::duration ttl);
+
+    resolved_endpoints(resolved_endpoints const &) = delete;
+    resolved_endpoints & operator=(resolved_endpoints const &) = delete;
+
+    /** Endpoints of host if it was resolved less than ttl ago, else nullptr */
+    std::shared_ptr<endpoint_set> find(std::string const & host, clock::time_point now = clock::now()) const;
+
+    /** Endpoints of host however old, nullptr if it was never resolved */
+    std::shared_ptr<endpoint_set> latest(std::string const & host) const;
+
+    /** Sets the addresses host resolved to. If they did not change, its endpoint set
+        is kept with its loads and health.
+        Throws std::invalid_argument if addresses is empty
+     */
+    std::shared_ptr<endpoint_set> update(std::string const & host,
+                                         std::vector<ip::tcp::endpoint> addresses,
+                                         clock::time_point now = clock::now());
+
+private:
+    struct resolution {
+        std::vector<ip::tcp::endpoint> addresses;
+        std::shared_ptr<endpoint_set> endpoints;
+        clock::time_point expires;
+    };
+
+    endpoint_options const options_;
+    clock::duration const ttl_;
+    mutable std::mutex mtx_;
+    std::map<std::string, resolution> hosts_;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
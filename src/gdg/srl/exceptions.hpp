@@ -17,6 +17,10 @@ struct bad_request_exception : std::runtime_error {
     bad_request_exception(int eerrorCode) : std::runtime_error("Bad request"), errorCode(eerrorCode) {}
 };
 
+struct cancelled_exception : std::runtime_error {
+    cancelled_exception() : std::runtime_error("cancelled") {}
+};
+
 
 } //ns srl
 
@@ -0,0 +1,356 @@
+#include "gdg/srl/srl.hpp"
+#include "gdg/srl/exceptions.hpp"
+#include "gdg/srl/detail/http.hpp"
+#include "gdg/srl/detail/unique_fd.hpp"
+#include "gdg/srl/testing/http_server.hpp"
+#include "gdg/srl/testing/temp_file.hpp"
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+namespace {
+
+
+using detail::unique_fd;
+using detail::throw_errno;
+
+
+void write_all(int fd, byte_t const * data, size_t size, off_t & offset) {
+    while (size) {
+        auto const written = ::pwrite(fd, data, size, offset);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw_errno("pwrite");
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+
+//Reserves the blocks of the body so that the file does not fragment while it grows.
+//The size of the file is kept: it grows only with the bytes written, so that a partial
+//file is never mistaken for a complete one when it is resumed
+void preallocate(int fd, off_t offset, size_t size) {
+#if defined(__linux__)
+    if (size && ::fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, size) == -1
+        && errno != EOPNOTSUPP && errno != ENOSYS)
+        throw_errno("fallocate");
+#else
+    (void)fd; (void)offset; (void)size;
+#endif
+}
+
+
+//Moves size bytes of body from the socket to fd at offset, until the deadline
+void async_copy_fixed_body(detail::socket_t & socket,
+                           detail::receive_streambuf & buf,
+                           int fd,
+                           size_t size,
+                           off_t & offset,
+                           detail::socket_deadline const & deadline,
+                           net::yield_context yield) {
+    //Body bytes that arrived together with the headers
+    auto const buffered = min(buf.size(), size);
+    write_all(fd, net::buffer_cast<byte_t const *>(buf.data()), buffered, offset);
+    buf.consume(buffered);
+    size -= buffered;
+
+#if defined(__linux__)
+    //The rest goes socket -> pipe -> file inside the kernel
+    int pipeFds[2];
+    if (::pipe2(pipeFds, O_CLOEXEC) == -1)
+        throw_errno("pipe2");
+    unique_fd pipeRead(pipeFds[0]), pipeWrite(pipeFds[1]);
+    socket.native_non_blocking(true);
+    size_t constexpr maxSpliceSize = 64 * 1024;
+    while (size) {
+        //While the socket has data the loop does not wait on it: check the time
+        if (deadline.expired())
+            throw timeout_exception{};
+        auto const moved = ::splice(socket.native_handle(), nullptr, pipeWrite.get(), nullptr,
+                                    min(size, maxSpliceSize),
+                                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved == -1) {
+            if (errno == EAGAIN) {
+                socket.async_wait(net::socket_base::wait_read, yield);
+                continue;
+            }
+            if (errno == EINTR)
+                continue;
+            throw_errno("splice");
+        }
+        if (moved == 0)
+            throw runtime_error("Connection closed before the end of the response body");
+        size -= moved;
+        auto inPipe = static_cast<size_t>(moved);
+        while (inPipe) {
+            auto const written = ::splice(pipeRead.get(), nullptr, fd, &offset,
+                                          inPipe, SPLICE_F_MOVE);
+            if (written == -1) {
+                if (errno == EINTR)
+                    continue;
+                throw_errno("splice");
+            }
+            inPipe -= written;
+        }
+    }
+#else
+    byte_t chunk[64 * 1024];
+    while (size) {
+        if (deadline.expired())
+            throw timeout_exception{};
+        boost::system::error_code ec{};
+        auto const bytesRead =
+            socket.async_read_some(net::buffer(chunk, min(size, sizeof(chunk))), yield[ec]);
+        if (ec == net::error::eof)
+            throw runtime_error("Connection closed before the end of the response body");
+        if (ec)
+            throw boost::system::system_error{ec};
+        write_all(fd, chunk, bytesRead, offset);
+        size -= bytesRead;
+    }
+#endif
+}
+
+
+pair<int, size_t> http_get_to_file(net::io_service & io,
+                                   string const & host,
+                                   string const & resource,
+                                   string const & path,
+                                   bool resume,
+                                   chrono::steady_clock::duration timeOut,
+                                   net::yield_context yield) {
+    unique_fd file(::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+    if (file.get() == -1)
+        throw_errno("open");
+    off_t offset = 0;
+    if (resume) {
+        struct stat st;
+        if (::fstat(file.get(), &st) == -1)
+            throw_errno("fstat");
+        offset = st.st_size;
+    }
+
+    detail::socket_t socket(io);
+    detail::socket_deadline deadline(io, timeOut, yield);
+    deadline.watch(socket);
+    try {
+        detail::async_connect_host(io, socket, host, yield);
+        deadline.watch(socket);
+        string const request =
+            detail::build_request(host, resource,
+                                  offset ? "Range: bytes=" + to_string(offset) + "-\r\n" : "");
+        net::async_write(socket, net::buffer(request), yield);
+        detail::receive_buffer buf;
+        auto const head = detail::async_read_response_head(socket, buf, yield);
+
+        using detail::header_field;
+        auto const range = head.get(header_field::content_range);
+        if (head.status == 416 && offset) {
+            //The partial file is already complete if its size is the size of the resource
+            if (range == "bytes */" + to_string(offset))
+                return {200, static_cast<size_t>(offset)};
+            throw bad_request_exception(head.status);
+        }
+        if (head.status == 206 && offset) {
+            auto const expectedStart = "bytes " + to_string(offset) + "-";
+            if (range.compare(0, expectedStart.size(), expectedStart) != 0)
+                throw runtime_error("Range response does not resume the partial file");
+        }
+        else if (head.status == 200) {
+            //The server sent the whole resource: start over
+            offset = 0;
+            if (::ftruncate(file.get(), 0) == -1)
+                throw_errno("ftruncate");
+        }
+        else {
+            throw bad_request_exception(head.status);
+        }
+
+        if (head.chunked()) {
+            //Chunk framing has to be parsed in user space
+            detail::async_read_chunked_body(socket, buf,
+                                            [&file, &offset](byte_t const * data, size_t size) {
+                                                write_all(file.get(), data, size, offset);
+                                            },
+                                            yield);
+        }
+        else {
+            if (head.contentLength < 0)
+                throw runtime_error
+                    ("Cannot parse HTTP response -> "
+                     "not supported: missing both content-length and transfer-encoding headers");
+            auto const contentLength = static_cast<size_t>(head.contentLength);
+            preallocate(file.get(), offset, contentLength);
+            async_copy_fixed_body(socket, buf, file.get(), contentLength, offset, deadline, yield);
+        }
+        if (deadline.expired())
+            throw timeout_exception{};
+    }
+    catch (...) {
+        //Keep only the bytes written, to be resumed, and drop the blocks preallocated after them
+        if (::ftruncate(file.get(), offset) == -1)
+            throw_errno("ftruncate");
+        //The socket was closed by the timeout, whatever the read failed with
+        if (deadline.expired())
+            throw timeout_exception{};
+        throw;
+    }
+    //Drop blocks preallocated past the end of the body, if any
+    if (::ftruncate(file.get(), offset) == -1)
+        throw_errno("ftruncate");
+    return {200, static_cast<size_t>(offset)};
+}
+
+} //anon namespace
+
+
+namespace gdg {
+
+namespace srl {
+
+
+future<pair<int, size_t>> async_http_get_to_file(string_view_t host,
+                                                 string_view_t resource,
+                                                 string_view_t path,
+                                                 bool resume,
+                                                 chrono::steady_clock::duration timeOut) {
+    return async_http_get_to_file(get_default_loop(),
+                                  host, resource, path, resume, timeOut);
+}
+
+
+future<pair<int, size_t>> async_http_get_to_file(net::io_service & io,
+                                                 string_view_t host,
+                                                 string_view_t resource,
+                                                 string_view_t path,
+                                                 bool resume,
+                                                 chrono::steady_clock::duration timeOut) {
+    promise<pair<int, size_t>> result_promise;
+    auto result = result_promise.get_future();
+    net::spawn
+        (io,
+         [&io, hoststr = string(host), resourcestr = string(resource), pathstr = string(path),
+          resume, timeOut, result_promise = move(result_promise)]
+         (net::yield_context yield) mutable {
+            try {
+                result_promise.set_value(http_get_to_file(io, hoststr, resourcestr, pathstr,
+                                                          resume, timeOut, yield));
+            }
+            catch (...) {
+                result_promise.set_exception(current_exception());
+            }
+        });
+    return result;
+}
+
+
+TEST_CASE("async http get to file") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::temp_file const file;
+    for (auto const chunked : {false, true}) {
+        testing::http_server_options options;
+        options.bodySize = 300 * 1024;
+        options.chunked = chunked;
+        testing::http_server server(options);
+        auto const inMemory = async_http_get(svc, server.host(), "/", 8s).get();
+        auto const written = async_http_get_to_file(svc, server.host(), "/", file.path(), false, 8s).get();
+        CHECK(written.first == 200);
+        CHECK(written.second == options.bodySize);
+
+        ifstream in(file.path(), ios::binary);
+        vector<byte_t> const contents{istreambuf_iterator<char>(in), istreambuf_iterator<char>()};
+        CHECK(contents == inMemory.second);
+    }
+
+    //A server that stops answering fails the download at the timeout
+    testing::http_server_options silentOptions;
+    silentOptions.latency = 30s;
+    testing::http_server silent(silentOptions);
+    auto const start = chrono::steady_clock::now();
+    CHECK_THROWS_AS(async_http_get_to_file(svc, silent.host(), "/", file.path(), false, 100ms).get(),
+                    timeout_exception);
+    CHECK(chrono::steady_clock::now() - start < 5s);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("async http get to file resumes partial files") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    string body(100000, '\0');
+    for (size_t i = 0; i < body.size(); ++i)
+        body[i] = static_cast<char>('a' + i % 26);
+    string lastRequest;
+    testing::http_server_options options;
+    options.handler = [&body, &lastRequest](string const & request) {
+        lastRequest = request;
+        return testing::range_response(body, request);
+    };
+    testing::http_server server(options);
+    testing::temp_file const file;
+    auto const contents = [&file] {
+        ifstream in(file.path(), ios::binary);
+        return string{istreambuf_iterator<char>(in), istreambuf_iterator<char>()};
+    };
+
+    //A body cut short leaves only the bytes that came
+    testing::http_server_options cutOptions;
+    cutOptions.handler = [&body](string const &) {
+        return "HTTP/1.1 200 OK\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n"
+            + body.substr(0, 1000);
+    };
+    {
+        testing::http_server cut(cutOptions);
+        CHECK_THROWS(async_http_get_to_file(svc, cut.host(), "/", file.path(), false, 8s).get());
+    }
+    CHECK(contents() == body.substr(0, 1000));
+
+    //206: the rest of the body is appended
+    auto r = async_http_get_to_file(svc, server.host(), "/", file.path(), true, 8s).get();
+    CHECK(r.first == 200);
+    CHECK(r.second == body.size());
+    CHECK(lastRequest.find("Range: bytes=1000-\r\n") != string::npos);
+    CHECK(contents() == body);
+
+    //416: the file is already complete
+    r = async_http_get_to_file(svc, server.host(), "/", file.path(), true, 8s).get();
+    CHECK(r.second == body.size());
+    CHECK(lastRequest.find("Range: bytes=100000-\r\n") != string::npos);
+    CHECK(contents() == body);
+
+    //200: a server that ignores the range sends it all, and the file starts over
+    testing::http_server_options wholeOptions;
+    wholeOptions.bodySize = 3000;
+    testing::http_server whole(wholeOptions);
+    ofstream(file.path(), ios::binary) << string(5000, '\0');
+    r = async_http_get_to_file(svc, whole.host(), "/", file.path(), true, 8s).get();
+    CHECK(r.second == 3000);
+    //The canned body of the server is the same sequence of letters
+    CHECK(contents() == body.substr(0, 3000));
+    svc.stop();
+    t.join();
+}
+
+} //namespace srl
+
+} //namespace gdg
@@ -0,0 +1,126 @@
+#include "gdg/srl/prepared_request.hpp"
+#include "gdg/srl/url.hpp"
+#include "gdg/srl/detail/http.hpp"
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+
+namespace gdg {
+
+namespace srl {
+
+
+struct prepared_request::state {
+    state(string host, string resource, clock::duration endpointsTtl)
+        : host(move(host)),
+          resource(move(resource)),
+          keepAliveBytes(detail::build_request(this->host, this->resource, "", true)),
+          closeBytes(detail::build_request(this->host, this->resource, "", false)),
+          endpointsTtl(endpointsTtl) {
+    }
+
+    string const host;
+    string const resource;
+    string const keepAliveBytes;
+    string const closeBytes;
+    clock::duration const endpointsTtl;
+    mutex mtx;
+    endpoints resolved;
+    clock::time_point resolvedAt;
+};
+
+
+namespace {
+
+//Host and resource of an http url
+pair<string, string> http_target(string_view_t url) {
+    auto const parts = parse_url(url);
+    string scheme(parts.scheme);
+    transform(scheme.begin(), scheme.end(), scheme.begin(), [](unsigned char c) { return tolower(c); });
+    if ((!scheme.empty() && scheme != "http") || !parts.userinfo.empty())
+        throw invalid_argument("Cannot request " + string(url) + ": only http URLs without user are supported");
+    string resource(parts.resource);
+    if (parts.path.empty())
+        resource.insert(0, "/");
+    return {string(parts.authority), move(resource)};
+}
+
+} //anon namespace
+
+
+prepared_request::prepared_request(string_view_t url, clock::duration endpointsTtl) {
+    auto target = http_target(url);
+    state_ = make_shared<state>(move(target.first), move(target.second), endpointsTtl);
+}
+
+
+prepared_request::prepared_request(string_view_t host, string_view_t resource, clock::duration endpointsTtl)
+    : state_(make_shared<state>(string(host), resource.empty() ? string("/") : string(resource), endpointsTtl)) {
+}
+
+
+string const & prepared_request::host() const {
+    return state_->host;
+}
+
+
+string const & prepared_request::resource() const {
+    return state_->resource;
+}
+
+
+string const & prepared_request::bytes(bool keepAlive) const {
+    return keepAlive ? state_->keepAliveBytes : state_->closeBytes;
+}
+
+
+prepared_request::endpoints prepared_request::cached_endpoints() const {
+    lock_guard<mutex> lock(state_->mtx);
+    if (clock::now() - state_->resolvedAt >= state_->endpointsTtl)
+        return nullptr;
+    return state_->resolved;
+}
+
+
+void prepared_request::cache_endpoints(endpoints resolved) const {
+    lock_guard<mutex> lock(state_->mtx);
+    state_->resolved = move(resolved);
+    state_->resolvedAt = clock::now();
+}
+
+
+TEST_CASE("prepared request keeps its target, bytes and endpoints") {
+    prepared_request const request("http://localhost:8080?full");
+    CHECK(request.host() == "localhost:8080");
+    CHECK(request.resource() == "/?full");
+    CHECK(request.bytes(true) == detail::build_request("localhost:8080", "/?full", "", true));
+    CHECK(request.bytes(false) == detail::build_request("localhost:8080", "/?full", "", false));
+
+    CHECK(prepared_request("unix:/run/s.sock", "").resource() == "/");
+    CHECK_THROWS_AS(prepared_request("https://www.boost.org/"), invalid_argument);
+    CHECK_THROWS_AS(prepared_request("http://user@www.boost.org/"), invalid_argument);
+
+    CHECK(!request.cached_endpoints());
+    auto const copy = request;
+    copy.cache_endpoints(make_shared<vector<ip::tcp::endpoint> const>
+                         (1, ip::tcp::endpoint(ip::address_v4::loopback(), 8080)));
+    CHECK(request.cached_endpoints()->size() == 1);
+
+    prepared_request const expiring("http://localhost/", chrono::seconds(0));
+    expiring.cache_endpoints(make_shared<vector<ip::tcp::endpoint> const>());
+    CHECK(!expiring.cached_endpoints());
+}
+
+
+} //ns srl
+
+} //ns gdg
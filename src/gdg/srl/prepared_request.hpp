@@ -0,0 +1,67 @@
+#ifndef GDG_SRL_PREPARED_REQUEST_HPP_
+#define GDG_SRL_PREPARED_REQUEST_HPP_
+
+#include "gdg/srl/alias.hpp"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gdg {
+
+namespace srl {
+
+/** A GET parsed and serialized once, for requests repeated to the same resource, as in polling.
+
+    Keeps the host and resource, the bytes of the request and the endpoints the host
+    resolved to, so that repeating it through \ref client::async_http_get skips parsing,
+    serialization and, while the endpoints are fresh, resolution.
+
+    Copies share all of it. Thread safe.
+ */
+class prepared_request {
+public:
+    using clock = std::chrono::steady_clock;
+    using endpoints = std::shared_ptr<std::vector<ip::tcp::endpoint> const>;
+
+    /** Request to an http URL, as in "http://localhost:8080/health?full".
+
+        Throws std::invalid_argument if url is not valid (see \ref parse_url), its scheme
+        is not http or it carries user information.
+
+        @endpointsTtl[in] time the endpoints resolved are used before resolving the host again
+     */
+    explicit prepared_request(string_view_t url, clock::duration endpointsTtl = std::chrono::seconds(30));
+
+    /** Request to resource in host, taken as \ref async_http_get does */
+    prepared_request(string_view_t host,
+                     string_view_t resource,
+                     clock::duration endpointsTtl = std::chrono::seconds(30));
+
+    /** host[:port], or unix:path */
+    std::string const & host() const;
+
+    /** Path and query, "/" at least */
+    std::string const & resource() const;
+
+    /** Bytes of the request, asking the server to keep the connection open or to close it */
+    std::string const & bytes(bool keepAlive) const;
+
+    /** Endpoints of the host resolved less than endpointsTtl ago, null if there are none */
+    endpoints cached_endpoints() const;
+
+    /** Keeps the endpoints of the host, resolved now. Null forgets them, as when they fail */
+    void cache_endpoints(endpoints resolved) const;
+
+private:
+    struct state;
+    std::shared_ptr<state> state_;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,402 @@
+#include "gdg/srl/srl.hpp"
+#include "gdg/srl/exceptions.hpp"
+#include "gdg/srl/detail/http.hpp"
+#include "gdg/srl/testing/http_server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+using detail::header_field;
+
+namespace {
+
+
+struct content_range {
+    size_t first;
+    size_t last;
+    size_t total;
+};
+
+
+//Parses a Content-Range value such as "bytes 0-99/1000".
+//A range with unknown total length ("bytes 0-99/*") is not accepted.
+bool parse_content_range(string_view_t value, content_range & range) {
+    //sscanf needs the terminating null
+    string const terminated(value.data(), value.size());
+    unsigned long long first, last, total;
+    int consumed = 0;
+    if (sscanf(terminated.c_str(), "bytes %llu-%llu/%llu%n", &first, &last, &total, &consumed) != 3
+        || static_cast<size_t>(consumed) != value.size()
+        || first > last || last >= total)
+        return false;
+    range = {static_cast<size_t>(first), static_cast<size_t>(last), static_cast<size_t>(total)};
+    return true;
+}
+
+
+TEST_CASE("parse content range") {
+    content_range range{};
+    CHECK(parse_content_range("bytes 0-99/1000", range));
+    CHECK(range.first == 0);
+    CHECK(range.last == 99);
+    CHECK(range.total == 1000);
+
+    CHECK(!parse_content_range("bytes 0-99/*", range));
+    CHECK(!parse_content_range("bytes */1000", range));
+    CHECK(!parse_content_range("bytes 100-99/1000", range));
+    CHECK(!parse_content_range("bytes 0-1000/1000", range));
+    CHECK(!parse_content_range("items 0-99/1000", range));
+}
+
+
+string range_header(size_t first, size_t last) {
+    return "Range: bytes=" + to_string(first) + "-" + to_string(last) + "\r\n";
+}
+
+
+//Download shared by all the workers fetching segments
+struct ranged_download {
+    ranged_download(net::io_service & io,
+                    string host,
+                    string resource,
+                    ranged_download_options options,
+                    chrono::steady_clock::duration timeOut,
+                    promise<pair<int, vector<byte_t>>> result)
+        : io(io), host(move(host)), resource(move(resource)),
+          options(options), timeOut(timeOut), result(move(result)) {}
+
+    size_t segment_first(size_t segment) const {
+        return segment * options.segmentSize;
+    }
+
+    size_t segment_last(size_t segment) const {
+        return min(segment_first(segment) + options.segmentSize, body.size()) - 1;
+    }
+
+    void fail(exception_ptr e) {
+        lock_guard<mutex> lock(mtx);
+        if (!error)
+            error = e;
+        failed = true;
+    }
+
+    //The last worker to finish completes the result
+    void worker_done() {
+        unique_lock<mutex> lock(mtx);
+        if (--runningWorkers)
+            return;
+        lock.unlock();
+        if (error)
+            result.set_exception(error);
+        else
+            result.set_value({200, move(body)});
+    }
+
+    net::io_service & io;
+    string const host;
+    string const resource;
+    ranged_download_options const options;
+    chrono::steady_clock::duration const timeOut;
+    vector<byte_t> body;
+    size_t segments = 0;
+    atomic<size_t> nextSegment{1};
+    atomic<bool> failed{false};
+    mutex mtx;
+    size_t runningWorkers = 0;
+    exception_ptr error;
+    promise<pair<int, vector<byte_t>>> result;
+};
+
+
+//Fetches the range [first, last] into the download body through socket, connecting it first if needed.
+//The connection is kept alive for the next segment unless the server closes it.
+void fetch_range(ranged_download & download,
+                 detail::socket_t & socket,
+                 detail::receive_streambuf & buf,
+                 size_t first,
+                 size_t last,
+                 net::yield_context yield) {
+    detail::socket_deadline deadline(download.io, download.timeOut, yield);
+    deadline.watch(socket);
+    try {
+        if (!socket.is_open())
+            detail::async_connect_host(download.io, socket, download.host, yield);
+        deadline.watch(socket);
+        string const request = detail::build_request(download.host, download.resource,
+                                                     range_header(first, last), true);
+        net::async_write(socket, net::buffer(request), yield);
+        auto const head = detail::async_read_response_head(socket, buf, yield);
+        if (head.status != 206)
+            throw bad_request_exception(head.status);
+
+        content_range range{};
+        if (!head.has(header_field::content_range)
+            || !parse_content_range(head.get(header_field::content_range), range)
+            || range.first != first || range.last != last || range.total != download.body.size())
+            throw runtime_error("Range response does not match the requested segment");
+
+        detail::async_read_fixed_body_into(socket, buf, download.body.data() + first,
+                                           last - first + 1, yield);
+        if (deadline.expired())
+            throw timeout_exception{};
+
+        if (!detail::keeps_connection_open(head))
+            socket.close();
+    }
+    catch (...) {
+        //The socket was closed by the timeout, whatever the read failed with
+        if (deadline.expired())
+            throw timeout_exception{};
+        throw;
+    }
+}
+
+
+//Takes segments until there are none left, retrying each one up to maxSegmentRetries times
+void download_segments(shared_ptr<ranged_download> download,
+                       detail::socket_t & socket,
+                       detail::receive_streambuf & buf,
+                       net::yield_context yield) {
+    while (!download->failed) {
+        auto const segment = download->nextSegment++;
+        if (segment >= download->segments)
+            break;
+        for (int attempt = 0; !download->failed; ++attempt) {
+            try {
+                fetch_range(*download, socket, buf,
+                            download->segment_first(segment),
+                            download->segment_last(segment),
+                            yield);
+                break;
+            }
+            catch (...) {
+                boost::system::error_code ec;
+                socket.close(ec);
+                buf.consume(buf.size());
+                if (attempt >= download->options.maxSegmentRetries)
+                    download->fail(current_exception());
+            }
+        }
+    }
+    download->worker_done();
+}
+
+
+//Reads the rest of a response to a range request that the server answered in full
+vector<byte_t> read_full_body(detail::socket_t & socket,
+                              detail::receive_streambuf & buf,
+                              detail::response_head const & head,
+                              net::yield_context yield) {
+    if (head.chunked())
+        return detail::async_read_body(socket, buf, true, yield).release();
+    if (head.contentLength < 0)
+        throw runtime_error
+            ("Cannot parse HTTP response -> "
+             "not supported: missing both content-length and transfer-encoding headers");
+    return detail::async_read_body(socket, buf, false, yield, static_cast<size_t>(head.contentLength)).release();
+}
+
+//Requests the first segment, which tells whether the server supports ranges
+//and the total size. Returns true if that response already completed the download.
+bool download_first_segment(ranged_download & download,
+                            detail::socket_t & socket,
+                            detail::receive_streambuf & buf,
+                            net::yield_context yield) {
+    detail::socket_deadline deadline(download.io, download.timeOut, yield);
+    deadline.watch(socket);
+    try {
+        detail::async_connect_host(download.io, socket, download.host, yield);
+        deadline.watch(socket);
+        string const request =
+            detail::build_request(download.host, download.resource,
+                                  range_header(0, download.options.segmentSize - 1),
+                                  true);
+        net::async_write(socket, net::buffer(request), yield);
+        auto const head = detail::async_read_response_head(socket, buf, yield);
+
+        if (head.status == 416) {
+            //Nothing to download: the resource is empty
+            download.result.set_value({200, {}});
+            return true;
+        }
+        if (head.status == 200) {
+            auto body = read_full_body(socket, buf, head, yield);
+            if (deadline.expired())
+                throw timeout_exception{};
+            download.result.set_value({200, move(body)});
+            return true;
+        }
+
+        content_range range{};
+        bool const rangesSupported =
+            head.status == 206 && head.has(header_field::content_range)
+            && parse_content_range(head.get(header_field::content_range), range) && range.first == 0
+            && range.last == min(download.options.segmentSize, range.total) - 1
+            && head.get(header_field::accept_ranges) != "none";
+        if (!rangesSupported)
+            throw bad_request_exception(head.status);
+
+        download.body.resize(range.total);
+        download.segments =
+            (range.total + download.options.segmentSize - 1) / download.options.segmentSize;
+        detail::async_read_fixed_body_into(socket, buf, download.body.data(),
+                                           range.last + 1, yield);
+        if (deadline.expired())
+            throw timeout_exception{};
+        if (!detail::keeps_connection_open(head))
+            socket.close();
+        return false;
+    }
+    catch (...) {
+        if (deadline.expired())
+            throw timeout_exception{};
+        throw;
+    }
+}
+
+} //anon namespace
+
+
+namespace gdg {
+
+namespace srl {
+
+
+future<pair<int, vector<byte_t>>> async_http_get_ranged(string_view_t host,
+                                                        string_view_t resource,
+                                                        ranged_download_options options,
+                                                        chrono::steady_clock::duration timeOut) {
+    return async_http_get_ranged(get_default_loop(),
+                                 host, resource, options, timeOut);
+}
+
+
+future<pair<int, vector<byte_t>>> async_http_get_ranged(net::io_service & io,
+                                                        string_view_t host,
+                                                        string_view_t resource,
+                                                        ranged_download_options options,
+                                                        chrono::steady_clock::duration timeOut) {
+    if (!options.segmentSize || !options.parallelism)
+        throw invalid_argument("segmentSize and parallelism must be greater than zero");
+    promise<pair<int, vector<byte_t>>> result_promise;
+    auto result = result_promise.get_future();
+    auto download = make_shared<ranged_download>(io, string(host), string(resource),
+                                                 options, timeOut, move(result_promise));
+    net::spawn
+        (io,
+         [download](net::yield_context yield) {
+            auto & io = download->io;
+            detail::socket_t socket(io);
+            detail::receive_buffer buf;
+            for (int attempt = 0; ; ++attempt) {
+                try {
+                    if (download_first_segment(*download, socket, buf, yield))
+                        return;
+                    break;
+                }
+                catch (...) {
+                    boost::system::error_code ec;
+                    socket.close(ec);
+                    buf.consume(buf.size());
+                    if (attempt >= download->options.maxSegmentRetries) {
+                        download->result.set_exception(current_exception());
+                        return;
+                    }
+                }
+            }
+
+            //This coroutine keeps downloading segments through its connection,
+            //the rest of the workers open their own
+            auto const workers = min(download->options.parallelism, download->segments);
+            download->runningWorkers = workers;
+            for (size_t i = 1; i < workers; ++i) {
+                net::spawn(io,
+                           [download](net::yield_context yield) {
+                               detail::socket_t socket(download->io);
+                               detail::receive_buffer buf;
+                               download_segments(download, socket, buf, yield);
+                           });
+            }
+            download_segments(download, socket, buf, yield);
+        });
+    return result;
+}
+
+
+TEST_CASE("async http get ranged splits a loopback download in segments") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    string body(10000, '\0');
+    for (size_t i = 0; i < body.size(); ++i)
+        body[i] = static_cast<char>('a' + i * 7 % 26);
+    vector<byte_t> const expected(body.begin(), body.end());
+    ranged_download_options options;
+    options.segmentSize = 1000;
+    options.parallelism = 4;
+
+    testing::http_server_options serverOptions;
+    serverOptions.handler = [&body](string const & request) { return testing::range_response(body, request); };
+    testing::http_server server(serverOptions, 2);
+    auto const segmented = async_http_get_ranged(svc, server.host(), "/", options, 8s).get();
+    CHECK(segmented.first == 200);
+    CHECK(segmented.second == expected);
+    CHECK(server.requests() == 10);
+    //Each worker keeps its connection for its segments
+    CHECK(server.connections() <= 4);
+
+    //Ignores the Range header: the first response has it all
+    testing::http_server_options fullOptions;
+    fullOptions.handler = [&body](string const &) { return testing::range_response(body, ""); };
+    testing::http_server full(fullOptions);
+    auto const whole = async_http_get_ranged(svc, full.host(), "/", options, 8s).get();
+    CHECK(whole.second == expected);
+    CHECK(full.requests() == 1);
+
+    //The segment at 3000 fails twice and is requested again
+    atomic<int> failures{2};
+    testing::http_server_options failingOptions;
+    failingOptions.handler = [&](string const & request) {
+        if (request.find("bytes=3000-") != string::npos && failures-- > 0)
+            return string("HTTP/1.1 503 Unavailable\r\nContent-Length: 0\r\n\r\n");
+        return testing::range_response(body, request);
+    };
+    testing::http_server failing(failingOptions, 2);
+    CHECK(async_http_get_ranged(svc, failing.host(), "/", options, 8s).get().second == expected);
+    CHECK(failing.requests() == 12);
+
+    //Past maxSegmentRetries the download fails
+    failures = options.maxSegmentRetries + 1;
+    CHECK_THROWS_AS(async_http_get_ranged(svc, failing.host(), "/", options, 8s).get(),
+                    bad_request_exception);
+
+    //A server that closes each connection, in any case of the header, has its segments
+    //requested in new connections
+    for (auto const connection : {"close", "Close"}) {
+        testing::http_server_options closingOptions;
+        closingOptions.keepAlive = false;
+        closingOptions.handler = [&body, connection](string const & request) {
+            auto response = testing::range_response(body, request);
+            return response.insert(response.find("\r\n") + 2, string("Connection: ") + connection + "\r\n");
+        };
+        testing::http_server closing(closingOptions, 2);
+        auto once = options;
+        once.maxSegmentRetries = 0;
+        CHECK(async_http_get_ranged(svc, closing.host(), "/", once, 8s).get().second == expected);
+        CHECK(closing.connections() == 10);
+    }
+    svc.stop();
+    t.join();
+}
+
+} //namespace srl
+
+} //namespace gdg
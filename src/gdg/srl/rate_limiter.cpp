@@ -0,0 +1,182 @@
+#include "gdg/srl/rate_limiter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+
+namespace gdg {
+
+namespace srl {
+
+
+token_bucket::token_bucket(double rate, double burst, clock::time_point now)
+    : rate_(rate),
+      burst_(max(burst, 1.0)),
+      tokens_(burst_),
+      last_(now) {
+}
+
+
+token_bucket::clock::duration token_bucket::wait_for_token(clock::time_point now) {
+    refill(now);
+    if (rate_ <= 0 || tokens_ >= 1)
+        return clock::duration::zero();
+    chrono::duration<double> const wait((1 - tokens_) / rate_);
+    return chrono::duration_cast<clock::duration>(wait);
+}
+
+
+token_bucket::clock::duration token_bucket::reserve(clock::time_point now) {
+    auto const wait = wait_for_token(now);
+    if (rate_ > 0)
+        tokens_ -= 1;
+    return wait;
+}
+
+
+double token_bucket::tokens(clock::time_point now) const {
+    if (now <= last_)
+        return tokens_;
+    return min(burst_, tokens_ + chrono::duration<double>(now - last_).count() * rate_);
+}
+
+
+void token_bucket::refill(clock::time_point now) {
+    tokens_ = tokens(now);
+    last_ = max(last_, now);
+}
+
+
+rate_limiter::rate_limiter(rate_limiter_options options)
+    : options_(move(options)),
+      global_(options_.global.requestsPerSecond, options_.global.burst) {
+}
+
+
+rate_limiter::clock::duration rate_limiter::reserve(string const & host, clock::duration maxWait) {
+    auto const now = clock::now();
+    lock_guard<mutex> lock(mtx_);
+    auto bucket = host_bucket(host, now);
+    auto const wait = max(global_.wait_for_token(now),
+                          bucket ? bucket->wait_for_token(now) : clock::duration::zero());
+    if (wait > maxWait) {
+        ++stats_.rejected;
+        return clock::duration::max();
+    }
+    global_.reserve(now);
+    if (bucket)
+        bucket->reserve(now);
+    ++stats_.admitted;
+    if (wait > clock::duration::zero())
+        ++stats_.delayed;
+    stats_.wait.record(wait);
+    return wait;
+}
+
+
+bool rate_limiter::try_acquire(string const & host) {
+    auto const now = clock::now();
+    lock_guard<mutex> lock(mtx_);
+    auto bucket = host_bucket(host, now);
+    if (global_.wait_for_token(now) > clock::duration::zero()
+        || (bucket && bucket->wait_for_token(now) > clock::duration::zero()))
+        return false;
+    global_.reserve(now);
+    if (bucket)
+        bucket->reserve(now);
+    ++stats_.admitted;
+    stats_.wait.record(clock::duration::zero());
+    return true;
+}
+
+
+rate_limiter_stats rate_limiter::stats() const {
+    auto const now = clock::now();
+    lock_guard<mutex> lock(mtx_);
+    auto result = stats_;
+    result.globalTokens = global_.tokens(now);
+    for (auto const & host : hosts_)
+        result.hostTokens[host.first] = host.second.tokens(now);
+    return result;
+}
+
+
+token_bucket * rate_limiter::host_bucket(string const & host, clock::time_point now) {
+    auto it = hosts_.find(host);
+    if (it != hosts_.end())
+        return &it->second;
+    auto const configured = options_.hosts.find(host);
+    auto const & limit = configured != options_.hosts.end() ? configured->second : options_.perHost;
+    if (limit.requestsPerSecond <= 0)
+        return nullptr;
+    return &hosts_.emplace(host, token_bucket(limit.requestsPerSecond, limit.burst, now)).first->second;
+}
+
+
+TEST_CASE("token bucket reserves tokens ahead at its rate") {
+    auto const start = token_bucket::clock::now();
+    token_bucket bucket(10, 2, start);
+    CHECK(bucket.reserve(start) == chrono::seconds(0));
+    CHECK(bucket.reserve(start) == chrono::seconds(0));
+    CHECK(bucket.reserve(start) == chrono::milliseconds(100));
+    CHECK(bucket.reserve(start) == chrono::milliseconds(200));
+    CHECK(bucket.tokens(start) == -2);
+
+    //Refilled, but never over the burst
+    CHECK(abs(bucket.tokens(start + chrono::milliseconds(300)) - 1) < 1e-9);
+    CHECK(bucket.tokens(start + chrono::seconds(10)) == 2);
+
+    token_bucket unlimited(0, 1, start);
+    for (int i = 0; i < 10; ++i)
+        CHECK(unlimited.reserve(start) == chrono::seconds(0));
+}
+
+
+TEST_CASE("rate limiter waits for the tokens of the host and the global ones") {
+    rate_limiter_options options;
+    options.global = {100, 5};
+    options.perHost = {10, 1};
+    options.hosts["fast"] = {1000, 10};
+    rate_limiter limiter(options);
+
+    CHECK(limiter.reserve("a") == chrono::seconds(0));
+    auto const wait = limiter.reserve("a");
+    CHECK(wait > chrono::milliseconds(90));
+    CHECK(wait <= chrono::milliseconds(100));
+    CHECK(!limiter.try_acquire("a"));
+    CHECK(limiter.reserve("a", chrono::milliseconds(50)) == rate_limiter::clock::duration::max());
+
+    //The global bucket has 3 tokens left, then fast waits for it
+    CHECK(limiter.reserve("fast") == chrono::seconds(0));
+    CHECK(limiter.reserve("fast") == chrono::seconds(0));
+    CHECK(limiter.reserve("fast") == chrono::seconds(0));
+    CHECK(limiter.reserve("fast") > chrono::milliseconds(5));
+
+    auto stats = limiter.stats();
+    CHECK(stats.admitted == 6);
+    CHECK(stats.delayed == 2);
+    //The refusal of try_acquire is not one
+    CHECK(stats.rejected == 1);
+    CHECK(stats.wait.count() == 6);
+    CHECK(stats.hostTokens.size() == 2);
+    CHECK(stats.globalTokens < 0);
+
+    rate_limiter idle(options);
+    CHECK(idle.try_acquire("a"));
+    CHECK(!idle.try_acquire("a"));
+    stats = idle.stats();
+    CHECK(stats.admitted == 1);
+    CHECK(stats.rejected == 0);
+    CHECK(stats.wait.count() == 1);
+}
+
+
+} //ns srl
+
+} //ns gdg
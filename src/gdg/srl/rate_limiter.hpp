@@ -0,0 +1,144 @@
+#ifndef GDG_SRL_RATE_LIMITER_HPP_
+#define GDG_SRL_RATE_LIMITER_HPP_
+
+#include "gdg/srl/timings.hpp"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace gdg {
+
+namespace srl {
+
+/** Requests per second allowed, and how many may go at once after an idle period
+ */
+struct rate_limit {
+    /** Zero for no limit */
+    double requestsPerSecond = 0;
+    double burst = 1;
+};
+
+
+/** Limits of a \ref rate_limiter
+ */
+struct rate_limiter_options {
+    /** Limit of all the requests together */
+    rate_limit global;
+    /** Limit of the requests to each host */
+    rate_limit perHost;
+    /** Limit of the requests to each host, used instead of perHost */
+    std::map<std::string, rate_limit> hosts;
+
+    /** True if some limit is set */
+    bool limits_requests() const {
+        return global.requestsPerSecond > 0 || perHost.requestsPerSecond > 0 || !hosts.empty();
+    }
+};
+
+
+/** Tokens and waits of a \ref rate_limiter
+ */
+struct rate_limiter_stats {
+    /** Requests that got their tokens */
+    std::uint64_t admitted = 0;
+    /** Of admitted, those that had to wait for them */
+    std::uint64_t delayed = 0;
+    /** Requests that would have waited longer than they could */
+    std::uint64_t rejected = 0;
+    /** Wait of every admitted request, zero if it had its tokens at once */
+    latency_histogram wait;
+    /** Tokens in the global bucket. Negative while requests wait for tokens */
+    double globalTokens = 0;
+    /** Tokens in the bucket of each limited host */
+    std::map<std::string, double> hostTokens;
+};
+
+
+/** Token bucket: tokens come at a steady rate, up to burst of them.
+
+    Tokens may be reserved ahead, leaving the bucket in debt, so that the
+    caller knows at once how long to wait for its token.
+
+    Not thread safe.
+ */
+class token_bucket {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /** Bucket full of tokens */
+    token_bucket(double rate, double burst, clock::time_point now = clock::now());
+
+    /** Time until a token would be there for a reservation made at now */
+    clock::duration wait_for_token(clock::time_point now);
+
+    /** Takes a token, leaving the bucket in debt if none is left.
+        @return time until the token is there, zero if it was there already
+     */
+    clock::duration reserve(clock::time_point now);
+
+    /** Tokens at now, negative if in debt */
+    double tokens(clock::time_point now) const;
+
+private:
+    void refill(clock::time_point now);
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    clock::time_point last_;
+};
+
+
+/** Token buckets per host and global, in front of the requests of a \ref client.
+
+    A request takes a token from the bucket of its host and one from the global
+    bucket, and waits until both are there.
+
+    Thread safe.
+ */
+class rate_limiter {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit rate_limiter(rate_limiter_options options = {});
+
+    rate_limiter(rate_limiter const &) = delete;
+    rate_limiter & operator=(rate_limiter const &) = delete;
+
+    /** Reserves the tokens of a request to host.
+
+        @maxWait[in] longest wait the request accepts
+        @return time to wait for the tokens, or clock::duration::max() without taking any
+        tokens if the wait would be longer than maxWait
+     */
+    clock::duration reserve(std::string const & host, clock::duration maxWait = clock::duration::max());
+
+    /** Takes the tokens of a request to host only if they are there now.
+
+        Meant for extra requests, such as hedges, that are not made without tokens: a
+        refusal is not counted as rejected in the stats
+     */
+    bool try_acquire(std::string const & host);
+
+    rate_limiter_stats stats() const;
+
+private:
+    //Bucket of host, or nullptr if host is not limited. Called with the lock held
+    token_bucket * host_bucket(std::string const & host, clock::time_point now);
+
+    rate_limiter_options const options_;
+    mutable std::mutex mtx_;
+    token_bucket global_;
+    std::map<std::string, token_bucket> hosts_;
+    rate_limiter_stats stats_;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
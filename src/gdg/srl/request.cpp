@@ -0,0 +1,462 @@
+#include "gdg/srl/srl.hpp"
+#include "gdg/srl/exceptions.hpp"
+#include "gdg/srl/detail/http.hpp"
+#include "gdg/srl/detail/unique_fd.hpp"
+#include "gdg/srl/testing/http_server.hpp"
+#include "gdg/srl/testing/temp_file.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+namespace {
+
+
+using detail::unique_fd;
+using detail::throw_errno;
+using request_strand = net::strand<net::io_service::executor_type>;
+
+
+//Sends the first size bytes of fd
+void async_send_file(detail::socket_t & socket, int fd, size_t size, net::yield_context yield) {
+    off_t offset = 0;
+#if defined(__linux__)
+    //File -> socket inside the kernel
+    socket.native_non_blocking(true);
+    size_t constexpr maxSendSize = 1024 * 1024;
+    while (size) {
+        auto const sent = ::sendfile(socket.native_handle(), fd, &offset, min(size, maxSendSize));
+        if (sent == -1) {
+            if (errno == EAGAIN) {
+                socket.async_wait(net::socket_base::wait_write, yield);
+                continue;
+            }
+            if (errno == EINTR)
+                continue;
+            throw_errno("sendfile");
+        }
+        if (sent == 0)
+            throw runtime_error("File shorter than the request body");
+        size -= sent;
+    }
+#else
+    byte_t chunk[64 * 1024];
+    while (size) {
+        auto const bytesRead = ::pread(fd, chunk, min(size, sizeof(chunk)), offset);
+        if (bytesRead == -1) {
+            if (errno == EINTR)
+                continue;
+            throw_errno("pread");
+        }
+        if (bytesRead == 0)
+            throw runtime_error("File shorter than the request body");
+        net::async_write(socket, net::buffer(chunk, bytesRead), yield);
+        offset += bytesRead;
+        size -= bytesRead;
+    }
+#endif
+}
+
+
+//Sends the pieces of generator as chunks, then the last chunk
+void async_send_chunks(detail::socket_t & socket,
+                       body_generator const & generator,
+                       size_t chunkSize,
+                       net::yield_context yield) {
+    vector<byte_t> chunk(max<size_t>(chunkSize, 1));
+    for (;;) {
+        auto const size = min(generator(net::buffer(chunk), yield), chunk.size());
+        if (!size)
+            break;
+        char sizeLine[32];
+        auto const sizeLineLength = snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", size);
+        array<net::const_buffer, 3> const buffers{{net::buffer(sizeLine, sizeLineLength),
+                                                   net::buffer(chunk.data(), size),
+                                                   net::buffer("\r\n", 2)}};
+        net::async_write(socket, buffers, yield);
+    }
+    net::async_write(socket, net::buffer("0\r\n\r\n", 5), yield);
+}
+
+
+//Waits up to timeout for the answer to Expect: 100-continue.
+//@return true if the server answered with a final status, left in head, instead of 100 Continue
+bool async_await_continue(net::io_service & io,
+                          request_strand const & strand,
+                          detail::socket_t & socket,
+                          detail::receive_streambuf & buf,
+                          chrono::steady_clock::duration timeout,
+                          detail::response_head & head,
+                          net::yield_context yield) {
+    //The timer runs in the strand of the request: once the read is over it leaves the socket alone
+    struct wait_state {
+        bool waiting = true;
+        bool timedOut = false;
+    };
+    auto const state = make_shared<wait_state>();
+    net::steady_timer timer(io);
+    timer.expires_from_now(timeout);
+    timer.async_wait(net::bind_executor(strand, [state, &socket](boost::system::error_code ec) {
+                if (ec || !state->waiting)
+                    return;
+                state->timedOut = true;
+                socket.cancel(ec);
+            }));
+    boost::system::error_code ec;
+    net::async_read_until(socket, buf, "\r\n\r\n", yield[ec]);
+    state->waiting = false;
+    timer.cancel();
+    if (state->timedOut)
+        return false;
+    if (ec)
+        throw boost::system::system_error{ec};
+    //The head is in buf already
+    head = detail::async_read_response_head(socket, buf, yield);
+    return head.status != 100;
+}
+
+
+response http_request_coro(net::io_service & io,
+                           request_strand const & strand,
+                           http_request const & request,
+                           chrono::steady_clock::duration timeOut,
+                           net::yield_context yield) {
+    request_timings timings;
+    timings.mark_start();
+    auto const & body = request.body;
+    //The file is opened first, to fail before connecting and to know its size
+    unique_fd file(body.source == request_body::kind::file
+                   ? ::open(body.path.c_str(), O_RDONLY | O_CLOEXEC) : -1);
+    string headers = request.headers;
+    size_t fileSize = 0;
+    switch (body.source) {
+    case request_body::kind::none:
+        if (request.method == "POST" || request.method == "PUT")
+            headers += "Content-Length: 0\r\n";
+        break;
+    case request_body::kind::buffers:
+        headers += "Content-Length: " + to_string(net::buffer_size(body.buffers)) + "\r\n";
+        break;
+    case request_body::kind::file: {
+        if (file.get() == -1)
+            throw_errno("open");
+        struct stat st;
+        if (::fstat(file.get(), &st) == -1)
+            throw_errno("fstat");
+        fileSize = static_cast<size_t>(st.st_size);
+        headers += "Content-Length: " + to_string(fileSize) + "\r\n";
+        break;
+    }
+    case request_body::kind::chunked:
+        headers += "Transfer-Encoding: chunked\r\n";
+        break;
+    }
+    bool const expectContinue = request.expectContinue && body.source != request_body::kind::none;
+    if (expectContinue)
+        headers += "Expect: 100-continue\r\n";
+    auto const head = detail::build_request_head(request.method, request.host, request.resource,
+                                                 headers, false);
+
+    detail::socket_t socket(io);
+    detail::socket_deadline deadline(io, timeOut, yield);
+    deadline.watch(socket);
+    try {
+        detail::async_connect_host(io, socket, request.host, yield, &timings);
+        deadline.watch(socket);
+
+        detail::receive_buffer buf;
+        detail::response_head responseHead;
+        bool answered = false;
+        if (body.source == request_body::kind::buffers && !expectContinue) {
+            //Head and body in a single gather write
+            vector<net::const_buffer> buffers{net::buffer(head)};
+            buffers.insert(buffers.end(), body.buffers.begin(), body.buffers.end());
+            net::async_write(socket, buffers, yield);
+        }
+        else {
+            net::async_write(socket, net::buffer(head), yield);
+            if (expectContinue)
+                answered = async_await_continue(io, strand, socket, buf, request.continueTimeout,
+                                                responseHead, yield);
+            if (!answered) {
+                switch (body.source) {
+                case request_body::kind::none:
+                    break;
+                case request_body::kind::buffers:
+                    net::async_write(socket, body.buffers, yield);
+                    break;
+                case request_body::kind::file:
+                    async_send_file(socket, file.get(), fileSize, yield);
+                    break;
+                case request_body::kind::chunked:
+                    async_send_chunks(socket, body.generator, body.chunkSize, yield);
+                    break;
+                }
+            }
+        }
+        timings.mark_request_written();
+        if (deadline.expired())
+            throw timeout_exception{};
+
+        //A 100 Continue that came after the body was sent, or any other interim response, is skipped
+        while (!answered || responseHead.status / 100 == 1) {
+            responseHead = detail::async_read_response_head(socket, buf, yield);
+            answered = true;
+        }
+        timings.mark_first_byte();
+        if (deadline.expired())
+            throw timeout_exception{};
+        if (responseHead.status / 100 != 2)
+            throw bad_request_exception(responseHead.status);
+
+        response_body responseBody;
+        if (request.method != "HEAD" && responseHead.status != 204) {
+            if (responseHead.chunked()) {
+                responseBody = detail::async_read_body(socket, buf, true, yield);
+            }
+            else {
+                if (responseHead.contentLength < 0)
+                    throw runtime_error
+                        ("Cannot parse HTTP response -> "
+                         "not supported: missing both content-length and transfer-encoding headers");
+                if (responseHead.contentLength != 0)
+                    responseBody = detail::async_read_body(socket, buf, false, yield,
+                                                           static_cast<size_t>(responseHead.contentLength));
+            }
+        }
+        if (deadline.expired())
+            throw timeout_exception{};
+        timings.mark_completed();
+        response result{responseHead.status, move(responseBody)};
+        result.timings = timings;
+        result.headers = move(responseHead.headers);
+        return result;
+    }
+    catch (...) {
+        //The socket was closed by the timeout, whatever the request failed with
+        if (deadline.expired())
+            throw timeout_exception{};
+        throw;
+    }
+}
+
+} //anon namespace
+
+
+namespace gdg {
+
+namespace srl {
+
+
+request_body buffers_body(vector<net::const_buffer> buffers) {
+    request_body body;
+    body.source = request_body::kind::buffers;
+    body.buffers = move(buffers);
+    return body;
+}
+
+
+request_body string_body(string bytes) {
+    auto owner = make_shared<string const>(move(bytes));
+    auto body = buffers_body({net::buffer(*owner)});
+    body.owner = move(owner);
+    return body;
+}
+
+
+request_body file_body(string path) {
+    request_body body;
+    body.source = request_body::kind::file;
+    body.path = move(path);
+    return body;
+}
+
+
+request_body chunked_body(body_generator generator, size_t chunkSize) {
+    request_body body;
+    body.source = request_body::kind::chunked;
+    body.generator = move(generator);
+    body.chunkSize = chunkSize;
+    return body;
+}
+
+
+future<response> async_http_request(http_request request,
+                                    chrono::steady_clock::duration timeOut) {
+    return async_http_request(get_default_loop(), move(request), timeOut);
+}
+
+
+future<response> async_http_request(net::io_service & io,
+                                    http_request request,
+                                    chrono::steady_clock::duration timeOut) {
+    promise<response> result_promise;
+    auto result = result_promise.get_future();
+    auto strand = net::make_strand(io);
+    net::spawn
+        (strand,
+         [&io, strand, request = move(request), timeOut, result_promise = move(result_promise)]
+         (net::yield_context yield) mutable {
+            try {
+                result_promise.set_value(http_request_coro(io, strand, request, timeOut, yield));
+            }
+            catch (...) {
+                result_promise.set_exception(current_exception());
+            }
+        });
+    return result;
+}
+
+
+namespace {
+
+//Handler of a loopback server that answers each request with its body, keeping the request in lastRequest
+function<string(string const &)> echo_handler(string & lastRequest) {
+    return [&lastRequest](string const & request) {
+        lastRequest = request;
+        auto const body = request.substr(request.find("\r\n\r\n") + 4);
+        return "HTTP/1.1 201 Created\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+    };
+}
+
+
+http_request upload(string const & host, request_body body) {
+    http_request request;
+    request.method = "POST";
+    request.host = host;
+    request.resource = "/upload";
+    request.headers = "Content-Type: application/octet-stream\r\n";
+    request.body = move(body);
+    return request;
+}
+
+} //anon namespace
+
+
+TEST_CASE("async http request streams bodies from buffers, files and generators") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    string lastRequest;
+    testing::http_server_options options;
+    options.handler = echo_handler(lastRequest);
+    testing::http_server server(options);
+
+    string const first = "hello ", second = "world";
+    auto r = async_http_request(svc, upload(server.host(), buffers_body({net::buffer(first), net::buffer(second)})), 8s)
+        .get();
+    CHECK(r.first == 201);
+    CHECK(string(r.second.begin(), r.second.end()) == "hello world");
+    CHECK(lastRequest.find("POST /upload HTTP/1.1\r\n") == 0);
+    CHECK(lastRequest.find("Content-Length: 11\r\n") != string::npos);
+    CHECK(lastRequest.find("Content-Type: application/octet-stream\r\n") != string::npos);
+
+    auto put = upload(server.host(), string_body("owned"));
+    put.method = "PUT";
+    r = async_http_request(svc, put, 8s).get();
+    CHECK(string(r.second.begin(), r.second.end()) == "owned");
+
+    string contents(1024 * 1024 + 7, '\0');
+    for (size_t i = 0; i < contents.size(); ++i)
+        contents[i] = static_cast<char>(i * 31);
+    string missing;
+    {
+        testing::temp_file const file;
+        ofstream(file.path(), ios::binary) << contents;
+        r = async_http_request(svc, upload(server.host(), file_body(file.path())), 8s).get();
+        CHECK(string(r.second.begin(), r.second.end()) == contents);
+        missing = file.path();
+    }
+    CHECK_THROWS_AS(async_http_request(svc, upload(server.host(), file_body(missing)), 8s).get(), system_error);
+
+    //Pieces made on demand, some after waiting in the loop
+    int pieces = 0;
+    auto generator = [&svc, &pieces](net::mutable_buffer buffer, net::yield_context yield) -> size_t {
+        if (pieces == 3)
+            return 0;
+        net::steady_timer wait(svc);
+        wait.expires_from_now(1ms);
+        wait.async_wait(yield);
+        auto const piece = "piece" + to_string(pieces++);
+        return net::buffer_copy(buffer, net::buffer(piece));
+    };
+    r = async_http_request(svc, upload(server.host(), chunked_body(generator, 4)), 8s).get();
+    CHECK(string(r.second.begin(), r.second.end()) == "piecpiecpiec");
+    CHECK(lastRequest.find("Transfer-Encoding: chunked\r\n") != string::npos);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("async http request waits for 100 continue") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    string lastRequest;
+    testing::http_server_options options;
+    options.handler = echo_handler(lastRequest);
+    testing::http_server accepting(options);
+    auto request = upload(accepting.host(), string_body("payload"));
+    request.expectContinue = true;
+    auto r = async_http_request(svc, request, 8s).get();
+    CHECK(string(r.second.begin(), r.second.end()) == "payload");
+    CHECK(lastRequest.find("Expect: 100-continue\r\n") != string::npos);
+
+    options.continueStatus = 413;
+    testing::http_server refusing(options);
+    request.host = refusing.host();
+    int status = 0;
+    try {
+        async_http_request(svc, request, 8s).get();
+    }
+    catch (bad_request_exception const & e) {
+        status = e.errorCode;
+    }
+    CHECK(status == 413);
+    CHECK(refusing.requests() == 0);
+
+    //Sent anyway once the wait is over
+    options.continueStatus = 0;
+    testing::http_server ignoring(options);
+    request.host = ignoring.host();
+    request.continueTimeout = 20ms;
+    r = async_http_request(svc, request, 8s).get();
+    CHECK(string(r.second.begin(), r.second.end()) == "payload");
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("async http request times out on a server that stops answering") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server_options options;
+    options.latency = 30s;
+    testing::http_server silent(options);
+    auto const start = chrono::steady_clock::now();
+    CHECK_THROWS_AS(async_http_request(svc, upload(silent.host(), string_body("payload")), 300ms).get(),
+                    timeout_exception);
+    CHECK(chrono::steady_clock::now() - start < 5s);
+    svc.stop();
+    t.join();
+}
+
+
+} //ns srl
+
+} //ns gdg
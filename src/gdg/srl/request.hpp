@@ -0,0 +1,94 @@
+#ifndef GDG_SRL_REQUEST_HPP_
+#define GDG_SRL_REQUEST_HPP_
+
+#include "gdg/srl/alias.hpp"
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gdg {
+
+namespace srl {
+
+/** Writes the next piece of a chunked body in buffer.
+
+    Runs in the loop of the request, and may wait for the data in yield.
+    @return the bytes written, zero once the body is over
+ */
+using body_generator = std::function<std::size_t(net::mutable_buffer buffer, net::yield_context yield)>;
+
+
+/** Where the body of an \ref http_request comes from. Made by the functions below
+ */
+struct request_body {
+    enum class kind {
+        none,
+        /** buffers, sent with a single gather write after the head */
+        buffers,
+        /** The file at path, sent with sendfile where there is one */
+        file,
+        /** The pieces of generator, sent with chunked transfer-encoding */
+        chunked
+    };
+
+    kind source = kind::none;
+    std::vector<net::const_buffer> buffers;
+    /** Owner of the bytes of buffers, if the body owns them */
+    std::shared_ptr<void const> owner;
+    std::string path;
+    body_generator generator;
+    /** Largest piece asked to generator */
+    std::size_t chunkSize = 64 * 1024;
+};
+
+
+/** Body sent from buffers, which are not copied: their bytes must outlive the request
+ */
+request_body buffers_body(std::vector<net::const_buffer> buffers);
+
+
+/** Body that owns bytes
+ */
+request_body string_body(std::string bytes);
+
+
+/** Body read from the file at path, opened when the request starts. On Linux it goes from
+    the file to the socket with sendfile, without passing through user space
+ */
+request_body file_body(std::string path);
+
+
+/** Body of unknown size, sent with chunked transfer-encoding as generator makes it
+ */
+request_body chunked_body(body_generator generator, std::size_t chunkSize = 64 * 1024);
+
+
+/** A request with any method, headers and body, for \ref async_http_request
+ */
+struct http_request {
+    std::string method = "GET";
+    /** The host machine, as in \ref async_http_get */
+    std::string host;
+    std::string resource = "/";
+    /** Header lines, each one terminated in \r\n. Host, Connection, Content-Length,
+        Transfer-Encoding and Expect are set from the rest of the request */
+    std::string headers;
+    request_body body;
+    /** Send Expect: 100-continue and wait for the server to take the body before sending it,
+        so that a body the server refuses is not sent at all */
+    bool expectContinue = false;
+    /** Time waited for 100 Continue before sending the body anyway, for the servers that
+        ignore the expectation */
+    std::chrono::steady_clock::duration continueTimeout = std::chrono::seconds(1);
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
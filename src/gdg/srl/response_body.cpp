@@ -0,0 +1,198 @@
+#include "gdg/srl/response_body.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+
+
+namespace gdg {
+
+namespace srl {
+
+constexpr size_t response_body::inlineCapacity;
+
+
+response_body::response_body(size_t size) {
+    resize(size);
+}
+
+
+response_body::response_body(vector<byte_t> bytes) noexcept
+    : heap_(move(bytes)), onHeap_(true) {
+}
+
+
+response_body::response_body(response_body const & other)
+    : size_(other.size_), onHeap_(other.onHeap_) {
+    if (onHeap_)
+        heap_ = other.heap_;
+    else if (size_)
+        memcpy(inline_, other.inline_, size_);
+}
+
+
+response_body::response_body(response_body && other) noexcept
+    : heap_(move(other.heap_)), size_(other.size_), onHeap_(other.onHeap_) {
+    if (!onHeap_ && size_)
+        memcpy(inline_, other.inline_, size_);
+    other.size_ = 0;
+    other.onHeap_ = false;
+}
+
+
+response_body & response_body::operator=(response_body const & other) {
+    if (this != &other)
+        *this = response_body(other);
+    return *this;
+}
+
+
+response_body & response_body::operator=(response_body && other) noexcept {
+    if (this == &other)
+        return *this;
+    if (other.onHeap_) {
+        heap_ = move(other.heap_);
+        size_ = 0;
+    }
+    else {
+        //The vector of a large body this held is not kept for a small one
+        vector<byte_t>().swap(heap_);
+        size_ = other.size_;
+        if (size_)
+            memcpy(inline_, other.inline_, size_);
+    }
+    onHeap_ = other.onHeap_;
+    other.size_ = 0;
+    other.onHeap_ = false;
+    return *this;
+}
+
+
+void response_body::resize(size_t size) {
+    if (!onHeap_ && size <= inlineCapacity) {
+        size_ = size;
+        return;
+    }
+    if (!onHeap_) {
+        heap_.reserve(size);
+        heap_.assign(inline_, inline_ + size_);
+        onHeap_ = true;
+        size_ = 0;
+    }
+    heap_.resize(size);
+}
+
+
+void response_body::append(byte_t const * bytes, size_t size) {
+    if (!size)
+        return;
+    if (!onHeap_ && size_ + size <= inlineCapacity) {
+        memcpy(inline_ + size_, bytes, size);
+        size_ += size;
+        return;
+    }
+    if (!onHeap_) {
+        heap_.reserve(max(size_ + size, 2 * inlineCapacity));
+        heap_.assign(inline_, inline_ + size_);
+        onHeap_ = true;
+        size_ = 0;
+    }
+    heap_.insert(heap_.end(), bytes, bytes + size);
+}
+
+
+vector<byte_t> response_body::release() {
+    vector<byte_t> bytes;
+    if (onHeap_)
+        bytes.swap(heap_);
+    else
+        bytes.assign(inline_, inline_ + size_);
+    size_ = 0;
+    onHeap_ = false;
+    return bytes;
+}
+
+
+bool operator==(response_body const & a, response_body const & b) {
+    return a.size() == b.size() && equal(a.begin(), a.end(), b.begin());
+}
+
+
+bool operator!=(response_body const & a, response_body const & b) {
+    return !(a == b);
+}
+
+
+TEST_CASE("response body keeps small bodies inline") {
+    response_body body;
+    CHECK(body.empty());
+    CHECK(body.is_inline());
+    string const json = R"({"status":"ok"})";
+    body.append(reinterpret_cast<byte_t const *>(json.data()), json.size());
+    CHECK(body.is_inline());
+    CHECK(string(body.begin(), body.end()) == json);
+
+    auto moved = move(body);
+    CHECK(moved.is_inline());
+    CHECK(string(moved.begin(), moved.end()) == json);
+    CHECK(body.empty());
+
+    response_body const copy = moved;
+    CHECK(copy == moved);
+    CHECK(moved.release() == vector<byte_t>(json.begin(), json.end()));
+    CHECK(moved.empty());
+    CHECK(copy != moved);
+
+    response_body sized(response_body::inlineCapacity);
+    CHECK(sized.is_inline());
+    CHECK(sized.size() == response_body::inlineCapacity);
+}
+
+
+TEST_CASE("response body moves large bodies to the heap") {
+    vector<byte_t> const bytes(response_body::inlineCapacity + 1, 'x');
+    response_body body;
+    body.append(bytes.data(), 10);
+    body.append(bytes.data() + 10, bytes.size() - 10);
+    CHECK(!body.is_inline());
+    CHECK(body.size() == bytes.size());
+    CHECK(body[response_body::inlineCapacity] == 'x');
+
+    auto const data = body.data();
+    auto moved = move(body);
+    //The bytes are taken, not copied
+    CHECK(moved.data() == data);
+    CHECK(body.empty());
+    CHECK(body.is_inline());
+
+    moved = response_body(vector<byte_t>{'o', 'k'});
+    CHECK(string(moved.begin(), moved.end()) == "ok");
+    moved = response_body(2);
+    CHECK(moved.is_inline());
+    CHECK(moved.size() == 2);
+
+    response_body grown;
+    grown.resize(3);
+    grown[0] = 'a';
+    grown.resize(2 * response_body::inlineCapacity);
+    CHECK(!grown.is_inline());
+    CHECK(grown[0] == 'a');
+    auto const released = grown.release();
+    CHECK(released.size() == 2 * response_body::inlineCapacity);
+    CHECK(grown.empty());
+
+    //Moved to a vector, as the bytes are released
+    moved = response_body(vector<byte_t>(bytes));
+    vector<byte_t> const converted = move(moved);
+    CHECK(converted == bytes);
+    CHECK(moved.empty());
+}
+
+} //ns srl
+
+} //ns gdg
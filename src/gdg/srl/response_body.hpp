@@ -0,0 +1,104 @@
+#ifndef GDG_SRL_RESPONSE_BODY_HPP_
+#define GDG_SRL_RESPONSE_BODY_HPP_
+
+#include "gdg/srl/alias.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace gdg {
+
+namespace srl {
+
+/** Body of a response.
+
+    Bodies of up to inlineCapacity bytes, as those of health checks and small JSON
+    documents, are kept inside the object without allocating. Larger ones go to a vector,
+    which moves with the body without copying its bytes.
+
+    The inline bytes make it about 550 bytes, whether the body is empty, small or large,
+    in every response and in the shared state of its future.
+ */
+class response_body {
+public:
+    static constexpr std::size_t inlineCapacity = 512;
+
+    using value_type = byte_t;
+    using size_type = std::size_t;
+    using iterator = byte_t *;
+    using const_iterator = byte_t const *;
+
+    response_body() noexcept {}
+
+    /** Body of size bytes, to be written through data() */
+    explicit response_body(std::size_t size);
+
+    /** Body that takes the bytes of a vector */
+    response_body(std::vector<byte_t> bytes) noexcept;
+
+    response_body(response_body const & other);
+
+    response_body(response_body && other) noexcept;
+
+    response_body & operator=(response_body const & other);
+
+    response_body & operator=(response_body && other) noexcept;
+
+    std::size_t size() const { return onHeap_ ? heap_.size() : size_; }
+
+    bool empty() const { return !size(); }
+
+    byte_t * data() { return onHeap_ ? heap_.data() : inline_; }
+
+    byte_t const * data() const { return onHeap_ ? heap_.data() : inline_; }
+
+    byte_t & operator[](std::size_t i) { return data()[i]; }
+
+    byte_t operator[](std::size_t i) const { return data()[i]; }
+
+    iterator begin() { return data(); }
+
+    iterator end() { return data() + size(); }
+
+    const_iterator begin() const { return data(); }
+
+    const_iterator end() const { return data() + size(); }
+
+    /** True if the bytes are inside the object */
+    bool is_inline() const { return !onHeap_; }
+
+    /** Grows or shrinks the body to size bytes. New bytes are not initialized while
+        they fit inline */
+    void resize(std::size_t size);
+
+    void append(byte_t const * bytes, std::size_t size);
+
+    /** Moves the bytes out to a vector, without copying them if they were not inline.
+        The body is left empty
+     */
+    std::vector<byte_t> release();
+
+    /** As release(), so that a body moved to a vector, as the second of a response was
+        before, keeps compiling
+     */
+    operator std::vector<byte_t>() && { return release(); }
+
+private:
+    std::vector<byte_t> heap_;
+    std::size_t size_ = 0;
+    bool onHeap_ = false;
+    byte_t inline_[inlineCapacity];
+};
+
+
+bool operator==(response_body const & a, response_body const & b);
+
+
+bool operator!=(response_body const & a, response_body const & b);
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,197 @@
+#include "gdg/srl/response_headers.hpp"
+#include "gdg/srl/detail/header_fields.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+
+namespace {
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+//Offsets of the part of [begin, end) without surrounding whitespace
+pair<size_t, size_t> trimmed(char const * data, size_t begin, size_t end) {
+    while (begin < end && is_space(data[begin]))
+        ++begin;
+    while (end > begin && is_space(data[end - 1]))
+        --end;
+    return {begin, end};
+}
+
+
+bool equal_names(string_view_t a, string_view_t b) {
+    using gdg::srl::detail::header_hash::lower;
+    return a.size() == b.size()
+        && equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return lower(x) == lower(y); });
+}
+
+} //anon namespace
+
+
+namespace gdg {
+
+namespace srl {
+
+constexpr size_t response_headers::npos;
+
+
+response_headers::response_headers(string_view_t lines) {
+    //The lines end before the empty line
+    size_t linesSize = 0;
+    size_t lineCount = 0;
+    while (linesSize < lines.size()) {
+        auto lineEnd = lines.find('\n', linesSize);
+        lineEnd = lineEnd == string_view_t::npos ? lines.size() : lineEnd + 1;
+        auto const line = trimmed(lines.data(), linesSize, lineEnd);
+        if (line.first == line.second)
+            break;
+        linesSize = lineEnd;
+        ++lineCount;
+    }
+    if (linesSize > UINT32_MAX)
+        throw length_error("Header lines too long");
+
+    //One allocation for the lines and the index after them
+    buffer_.reserve(linesSize + lineCount * sizeof(entry));
+    buffer_.assign(lines.data(), linesSize);
+    linesSize_ = linesSize;
+    size_t lineStart = 0;
+    while (lineStart < linesSize) {
+        auto lineEnd = buffer_.find('\n', lineStart);
+        lineEnd = lineEnd == string::npos ? linesSize : lineEnd + 1;
+        auto const separator = buffer_.find(':', lineStart);
+        auto const nameEnd = separator < lineEnd ? separator : lineEnd;
+        auto const name = trimmed(buffer_.data(), lineStart, nameEnd);
+        auto const value = separator < lineEnd
+            ? trimmed(buffer_.data(), separator + 1, lineEnd)
+            : make_pair(lineEnd, lineEnd);
+        entry const e{static_cast<uint32_t>(name.first), static_cast<uint32_t>(name.second - name.first),
+                      static_cast<uint32_t>(value.first), static_cast<uint32_t>(value.second - value.first)};
+        buffer_.append(reinterpret_cast<char const *>(&e), sizeof(e));
+        lineStart = lineEnd;
+    }
+    size_ = lineCount;
+}
+
+
+response_headers::response_headers(response_headers && other) noexcept
+    : buffer_(move(other.buffer_)), linesSize_(other.linesSize_), size_(other.size_) {
+    other.buffer_.clear();
+    other.linesSize_ = 0;
+    other.size_ = 0;
+}
+
+
+response_headers & response_headers::operator=(response_headers && other) noexcept {
+    if (this == &other)
+        return *this;
+    buffer_ = move(other.buffer_);
+    linesSize_ = other.linesSize_;
+    size_ = other.size_;
+    other.buffer_.clear();
+    other.linesSize_ = 0;
+    other.size_ = 0;
+    return *this;
+}
+
+
+response_headers::entry response_headers::entry_at(size_t i) const {
+    entry e;
+    memcpy(&e, buffer_.data() + linesSize_ + i * sizeof(entry), sizeof(entry));
+    return e;
+}
+
+
+response_headers::field response_headers::operator[](size_t i) const {
+    auto const e = entry_at(i);
+    return {string_view_t(buffer_.data() + e.name, e.nameSize),
+            string_view_t(buffer_.data() + e.value, e.valueSize)};
+}
+
+
+size_t response_headers::find(string_view_t name, size_t from) const {
+    for (auto i = from; i < size_; ++i) {
+        auto const e = entry_at(i);
+        if (equal_names(string_view_t(buffer_.data() + e.name, e.nameSize), name))
+            return i;
+    }
+    return npos;
+}
+
+
+string_view_t response_headers::get(string_view_t name) const {
+    auto const i = find(name);
+    return i == npos ? string_view_t() : (*this)[i].value;
+}
+
+
+TEST_CASE("response headers") {
+    response_headers headers("ETag: \"5f3a\"\r\n"
+                             "Set-Cookie: a=1\r\n"
+                             "content-type:  text/html \r\n"
+                             "Set-Cookie: b=2\r\n"
+                             "Broken\r\n"
+                             "\r\n"
+                             "Ignored: yes\r\n");
+    REQUIRE(headers.size() == 5);
+    CHECK(headers[0].name == "ETag");
+    CHECK(headers[0].value == "\"5f3a\"");
+    CHECK(headers.get("Content-Type") == "text/html");
+    CHECK(headers.get("etag") == "\"5f3a\"");
+    CHECK(headers[4].name == "Broken");
+    CHECK(headers[4].value.empty());
+    CHECK(!headers.has("ignored"));
+    CHECK(headers.get("location").empty());
+    CHECK(headers.lines().size() == string_view_t("ETag: \"5f3a\"\r\nSet-Cookie: a=1\r\ncontent-type:  text/html \r\n"
+                                                  "Set-Cookie: b=2\r\nBroken\r\n").size());
+
+    auto const first = headers.find("set-cookie");
+    REQUIRE(first == 1);
+    auto const second = headers.find("set-cookie", first + 1);
+    REQUIRE(second == 3);
+    CHECK(headers[second].value == "b=2");
+    CHECK(headers.find("set-cookie", second + 1) == response_headers::npos);
+
+    CHECK(response_headers().empty());
+    CHECK(response_headers("\r\n").empty());
+    CHECK(response_headers("Age: 1").get("age") == "1");
+}
+
+
+TEST_CASE("response headers are moved and copied with their views") {
+    response_headers headers("Server: nginx/1.18.0\r\nCache-Control: public, max-age=3600\r\n\r\n");
+    auto const lines = headers.lines().data();
+    auto moved = move(headers);
+    //The buffer is taken, not copied
+    CHECK(moved.lines().data() == lines);
+    CHECK(moved.get("cache-control") == "public, max-age=3600");
+    //The moved-from headers are left without fields
+    CHECK(headers.empty());
+    CHECK(headers.lines().empty());
+    CHECK(!headers.has("server"));
+    CHECK(headers.get("server").empty());
+    headers = move(moved);
+    CHECK(headers.get("server") == "nginx/1.18.0");
+    CHECK(moved.empty());
+    CHECK(moved.get("server").empty());
+    moved = move(headers);
+    auto const copy = moved;
+    moved = response_headers("Age: 1\r\n");
+    CHECK(copy.get("server") == "nginx/1.18.0");
+    CHECK(moved.get("age") == "1");
+    CHECK(!moved.has("server"));
+}
+
+} //ns srl
+
+} //ns gdg
@@ -0,0 +1,90 @@
+#ifndef GDG_SRL_RESPONSE_HEADERS_HPP_
+#define GDG_SRL_RESPONSE_HEADERS_HPP_
+
+#include "gdg/srl/alias.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gdg {
+
+namespace srl {
+
+/** Header fields of a response, in the order they came.
+
+    The header lines are kept as they came in a single buffer, followed by an index
+    with the offsets of the name and value of each field, so that the fields take one
+    allocation however many they are, and moving them copies no bytes. Names and values
+    are views of the buffer, valid while the fields are neither changed nor destroyed.
+ */
+class response_headers {
+public:
+    struct field {
+        string_view_t name;
+        /** Without surrounding whitespace */
+        string_view_t value;
+    };
+
+    response_headers() = default;
+
+    response_headers(response_headers const &) = default;
+
+    /** Takes the buffer of other, which is left without fields */
+    response_headers(response_headers && other) noexcept;
+
+    response_headers & operator=(response_headers const &) = default;
+
+    response_headers & operator=(response_headers && other) noexcept;
+
+    /** Fields of header lines, ended in \r\n or \n, until an empty line or the end of
+        lines. A line without colon is a field without value
+     */
+    explicit response_headers(string_view_t lines);
+
+    /** Number of fields */
+    std::size_t size() const { return size_; }
+
+    bool empty() const { return !size_; }
+
+    /** The i-th field, i < size() */
+    field operator[](std::size_t i) const;
+
+    /** Index of the first field named name, in any case, from index from on.
+        npos if there is none. Repeated fields, as Set-Cookie, are found calling it again
+        after the last index found
+     */
+    std::size_t find(string_view_t name, std::size_t from = 0) const;
+
+    bool has(string_view_t name) const { return find(name) != npos; }
+
+    /** Value of the first field named name, in any case, empty if it did not come */
+    string_view_t get(string_view_t name) const;
+
+    /** The header lines as they came */
+    string_view_t lines() const { return string_view_t(buffer_.data(), linesSize_); }
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+private:
+    //Offsets in buffer_ of a field, stored after the lines
+    struct entry {
+        std::uint32_t name;
+        std::uint32_t nameSize;
+        std::uint32_t value;
+        std::uint32_t valueSize;
+    };
+
+    entry entry_at(std::size_t i) const;
+
+    std::string buffer_;
+    std::size_t linesSize_ = 0;
+    std::size_t size_ = 0;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,273 @@
+#include "gdg/srl/scheduler.hpp"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+
+namespace gdg {
+
+namespace srl {
+
+
+request_scheduler::request_scheduler(scheduler_options options)
+    : options_(move(options)) {
+}
+
+
+void request_scheduler::submit(string const & host, request_priority priority, start_function start) {
+    {
+        lock_guard<mutex> lock(mtx_);
+        auto it = hosts_.emplace(host, host_state{}).first;
+        if (options_.adaptiveLimit.algorithm != limit_algorithm::none && !limits_.count(host))
+            limits_.emplace(host, adaptive_limit(options_.adaptiveLimit));
+        if (!has_room(it)) {
+            auto & state = it->second;
+            //A host that had nothing queued does not get credit for the time it was idle
+            if (!state.queued)
+                state.pass = max(state.pass, pass_);
+            state.queues[static_cast<size_t>(priority)].push_back({move(start), clock::now(), sequence_++});
+            ++state.queued;
+            ++queued_;
+            return;
+        }
+        account_start(it, clock::duration::zero());
+    }
+    start(clock::duration::zero());
+}
+
+
+void request_scheduler::finish(string const & host) {
+    finish_request(host, nullptr, false);
+}
+
+
+void request_scheduler::finish(string const & host, clock::duration latency, bool dropped) {
+    finish_request(host, &latency, dropped);
+}
+
+
+void request_scheduler::finish_request(string const & host, clock::duration const * latency, bool dropped) {
+    vector<pair<start_function, clock::duration>> ready;
+    {
+        lock_guard<mutex> lock(mtx_);
+        auto it = hosts_.find(host);
+        if (it == hosts_.end())
+            return;
+        auto const limit = limits_.find(host);
+        if (latency && limit != limits_.end())
+            limit->second.on_sample(*latency, it->second.inFlight, dropped);
+        --it->second.inFlight;
+        --inFlight_;
+        queued_request next;
+        clock::duration waited;
+        while (pop_next(next, waited))
+            ready.emplace_back(move(next.start), waited);
+        if (!it->second.inFlight && !it->second.queued)
+            hosts_.erase(it);
+    }
+    //Outside the lock: starting a request may finish another one
+    for (auto & request : ready)
+        request.first(request.second);
+}
+
+
+scheduler_stats request_scheduler::stats() const {
+    lock_guard<mutex> lock(mtx_);
+    auto result = stats_;
+    result.inFlight = inFlight_;
+    result.queueDepth = queued_;
+    for (auto const & host : hosts_)
+        if (host.second.queued)
+            result.hostQueueDepth[host.first] = host.second.queued;
+    for (auto const & limit : limits_)
+        result.hostLimits[limit.first] = limit.second.limit();
+    return result;
+}
+
+
+size_t request_scheduler::limit_for(string const & host) const {
+    auto const it = options_.hostMaxInFlight.find(host);
+    auto const fixed = it != options_.hostMaxInFlight.end() ? it->second : options_.maxInFlightPerHost;
+    auto const adaptive = limits_.find(host);
+    if (adaptive == limits_.end())
+        return fixed;
+    return fixed ? min(fixed, adaptive->second.limit()) : adaptive->second.limit();
+}
+
+
+bool request_scheduler::has_room(host_iterator host) const {
+    if (options_.maxInFlight && inFlight_ >= options_.maxInFlight)
+        return false;
+    auto const limit = limit_for(host->first);
+    return !limit || host->second.inFlight < limit;
+}
+
+
+bool request_scheduler::pop_next(queued_request & next, clock::duration & waited) {
+    if (!queued_ || (options_.maxInFlight && inFlight_ >= options_.maxInFlight))
+        return false;
+    for (size_t priority = 0; priority < 3; ++priority) {
+        auto best = hosts_.end();
+        for (auto it = hosts_.begin(); it != hosts_.end(); ++it) {
+            auto const & queue = it->second.queues[priority];
+            if (queue.empty() || !has_room(it))
+                continue;
+            if (best == hosts_.end()) {
+                best = it;
+                continue;
+            }
+            auto const & bestQueue = best->second.queues[priority];
+            bool const earlier = queue.front().sequence < bestQueue.front().sequence;
+            if (options_.policy == queueing::fifo
+                ? earlier
+                : it->second.pass < best->second.pass
+                  || (it->second.pass == best->second.pass && earlier))
+                best = it;
+        }
+        if (best == hosts_.end())
+            continue;
+        auto & queue = best->second.queues[priority];
+        next = move(queue.front());
+        queue.pop_front();
+        --best->second.queued;
+        --queued_;
+        waited = clock::now() - next.since;
+        ++stats_.delayed;
+        account_start(best, waited);
+        return true;
+    }
+    return false;
+}
+
+
+void request_scheduler::account_start(host_iterator host, clock::duration waited) {
+    auto & state = host->second;
+    ++state.inFlight;
+    ++inFlight_;
+    ++stats_.started;
+    stats_.wait.record(waited);
+    auto const weight = options_.hostWeights.find(host->first);
+    pass_ = max(pass_, state.pass);
+    state.pass += 1.0 / (weight != options_.hostWeights.end() ? max(weight->second, 1u) : 1u);
+}
+
+
+TEST_CASE("scheduler queues requests over the limits of their host") {
+    scheduler_options options;
+    options.maxInFlightPerHost = 2;
+    options.hostMaxInFlight["b"] = 1;
+    request_scheduler scheduler(options);
+    vector<string> started;
+    auto submit = [&](string const & host) {
+        scheduler.submit(host, request_priority::normal,
+                         [&started, host](auto) { started.push_back(host); });
+    };
+
+    submit("a");
+    submit("a");
+    submit("a");
+    submit("b");
+    submit("b");
+    CHECK(started == vector<string>{"a", "a", "b"});
+    auto stats = scheduler.stats();
+    CHECK(stats.inFlight == 3);
+    CHECK(stats.queueDepth == 2);
+    CHECK(stats.hostQueueDepth == map<string, size_t>{{"a", 1}, {"b", 1}});
+
+    scheduler.finish("b");
+    CHECK(started.back() == "b");
+    scheduler.finish("a");
+    CHECK(started.back() == "a");
+    stats = scheduler.stats();
+    CHECK(stats.started == 5);
+    CHECK(stats.delayed == 2);
+    CHECK(stats.queueDepth == 0);
+    CHECK(stats.wait.count() == 5);
+}
+
+
+TEST_CASE("scheduler starts queued requests by priority within the global limit") {
+    scheduler_options options;
+    options.maxInFlight = 1;
+    request_scheduler scheduler(options);
+    vector<string> started;
+    auto submit = [&](string const & host, request_priority priority) {
+        scheduler.submit(host, priority, [&started, host](auto) { started.push_back(host); });
+    };
+
+    submit("first", request_priority::low);
+    submit("low", request_priority::low);
+    submit("normal", request_priority::normal);
+    submit("high", request_priority::high);
+    CHECK(started == vector<string>{"first"});
+    scheduler.finish("first");
+    scheduler.finish("high");
+    scheduler.finish("normal");
+    CHECK(started == vector<string>{"first", "high", "normal", "low"});
+}
+
+
+TEST_CASE("scheduler starts queued requests as the adaptive limit of their host grows") {
+    scheduler_options options;
+    options.adaptiveLimit.algorithm = limit_algorithm::aimd;
+    options.adaptiveLimit.initialLimit = 2;
+    request_scheduler scheduler(options);
+    size_t started = 0;
+    for (int i = 0; i < 5; ++i)
+        scheduler.submit("a", request_priority::normal, [&started](auto) { ++started; });
+    CHECK(started == 2);
+    CHECK(scheduler.stats().hostLimits.at("a") == 2);
+
+    //Fast requests with the limit in use: one more in flight after each
+    scheduler.finish("a", chrono::milliseconds(1), false);
+    CHECK(scheduler.stats().hostLimits.at("a") == 3);
+    CHECK(started == 4);
+    scheduler.finish("a", chrono::milliseconds(1), false);
+    CHECK(started == 5);
+
+    //A drop backs off, so the next request waits
+    scheduler.finish("a", chrono::milliseconds(1), true);
+    CHECK(scheduler.stats().hostLimits.at("a") == 3);
+    scheduler.submit("a", request_priority::normal, [&started](auto) { ++started; });
+    scheduler.submit("a", request_priority::normal, [&started](auto) { ++started; });
+    CHECK(started == 6);
+    CHECK(scheduler.stats().queueDepth == 1);
+}
+
+
+TEST_CASE("scheduler shares the global limit between hosts by weight") {
+    auto order = [](queueing policy) {
+        scheduler_options options;
+        options.maxInFlight = 1;
+        options.policy = policy;
+        options.hostWeights["b"] = 2;
+        request_scheduler scheduler(options);
+        string started;
+        auto submit = [&](char host) {
+            scheduler.submit(string(1, host), request_priority::normal,
+                             [&started, host](auto) { started += host; });
+        };
+        submit('x');
+        for (int i = 0; i < 4; ++i)
+            submit('a');
+        for (int i = 0; i < 4; ++i)
+            submit('b');
+        while (started.size() < 9)
+            scheduler.finish(string(1, started.back()));
+        return started;
+    };
+
+    CHECK(order(queueing::fifo) == "xaaaabbbb");
+    CHECK(order(queueing::weighted_fair) == "xabbabbaa");
+}
+
+
+} //ns srl
+
+} //ns gdg
@@ -0,0 +1,162 @@
+#ifndef GDG_SRL_SCHEDULER_HPP_
+#define GDG_SRL_SCHEDULER_HPP_
+
+#include "gdg/srl/adaptive_limit.hpp"
+#include "gdg/srl/timings.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace gdg {
+
+namespace srl {
+
+/** Class of a request. Queued requests of a higher class start first
+ */
+enum class request_priority { high, normal, low };
+
+
+/** Order in which queued requests to different hosts start
+ */
+enum class queueing {
+    /** In arrival order */
+    fifo,
+    /** Alternating hosts in proportion to their weights, so that a burst to
+        one host does not delay the requests to the others */
+    weighted_fair
+};
+
+
+/** Limits of a \ref request_scheduler
+ */
+struct scheduler_options {
+    /** Requests in flight at once to all hosts together. Zero for no limit */
+    std::size_t maxInFlight = 0;
+    /** Requests in flight at once to each host. Zero for no limit */
+    std::size_t maxInFlightPerHost = 0;
+    /** Limit of requests in flight to each host, used instead of maxInFlightPerHost */
+    std::map<std::string, std::size_t> hostMaxInFlight;
+    queueing policy = queueing::fifo;
+    /** Share of each host with queueing::weighted_fair. Hosts not listed weigh 1 */
+    std::map<std::string, unsigned> hostWeights;
+    /** Limit of requests in flight to each host adjusted from the latency and failures
+        of its requests. A fixed limit of the host, if any, caps it */
+    adaptive_limit_options adaptiveLimit;
+
+    /** True if some limit is set */
+    bool limits_requests() const {
+        return maxInFlight || maxInFlightPerHost || !hostMaxInFlight.empty()
+            || adaptiveLimit.algorithm != limit_algorithm::none;
+    }
+};
+
+
+/** Queues and wait times of a \ref request_scheduler
+ */
+struct scheduler_stats {
+    /** Requests started so far */
+    std::uint64_t started = 0;
+    /** Of started, those that had to wait in a queue */
+    std::uint64_t delayed = 0;
+    std::size_t inFlight = 0;
+    /** Requests waiting in the queues */
+    std::size_t queueDepth = 0;
+    /** Requests waiting, by host. Hosts without waiting requests are not listed */
+    std::map<std::string, std::size_t> hostQueueDepth;
+    /** Time every started request spent in a queue, zero if it started at once */
+    latency_histogram wait;
+    /** Current adaptive limit of each host. Empty without adaptive limits */
+    std::map<std::string, std::size_t> hostLimits;
+};
+
+
+/** Starts requests within limits of requests in flight per host and overall,
+    queueing the rest.
+
+    A queued request is just the function that starts it: it holds no coroutine
+    stack and no socket until it starts. Every started request must be followed
+    by \ref finish once it is over, which starts the next queued requests.
+
+    Thread safe.
+ */
+class request_scheduler {
+public:
+    /** Starts a request. Receives the time the request waited in a queue */
+    using start_function = std::function<void(std::chrono::steady_clock::duration waited)>;
+
+    explicit request_scheduler(scheduler_options options = {});
+
+    request_scheduler(request_scheduler const &) = delete;
+    request_scheduler & operator=(request_scheduler const &) = delete;
+
+    /** Calls start at once if host is within the limits, or queues it otherwise.
+     */
+    void submit(std::string const & host, request_priority priority, start_function start);
+
+    /** Tells that a request to host is over
+     */
+    void finish(std::string const & host);
+
+    /** Tells that a request to host is over, and adjusts the adaptive limit of host with it.
+
+        @latency[in] time from the start of the request to its end
+        @dropped[in] true if the request timed out, failed to connect or the host was overloaded
+     */
+    void finish(std::string const & host, std::chrono::steady_clock::duration latency, bool dropped);
+
+    scheduler_stats stats() const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct queued_request {
+        start_function start;
+        clock::time_point since;
+        std::uint64_t sequence;
+    };
+
+    struct host_state {
+        std::size_t inFlight = 0;
+        std::size_t queued = 0;
+        //Virtual time of weighted fair queueing: grows by 1 / weight with every start
+        double pass = 0;
+        std::array<std::deque<queued_request>, 3> queues;
+    };
+
+    using host_iterator = std::map<std::string, host_state>::iterator;
+
+    std::size_t limit_for(std::string const & host) const;
+
+    bool has_room(host_iterator host) const;
+
+    //Takes the next queued request that may start, if any. Called with the lock held
+    bool pop_next(queued_request & next, clock::duration & waited);
+
+    void account_start(host_iterator host, clock::duration waited);
+
+    void finish_request(std::string const & host, clock::duration const * latency, bool dropped);
+
+    scheduler_options const options_;
+    mutable std::mutex mtx_;
+    std::map<std::string, host_state> hosts_;
+    //Kept when the host has nothing in flight, unlike hosts_
+    std::map<std::string, adaptive_limit> limits_;
+    std::size_t inFlight_ = 0;
+    std::size_t queued_ = 0;
+    std::uint64_t sequence_ = 0;
+    double pass_ = 0;
+    scheduler_stats stats_;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef GDG_SRL_SOCKET_OPTIONS_HPP_
+#define GDG_SRL_SOCKET_OPTIONS_HPP_
+
+#include <chrono>
+
+namespace gdg {
+
+namespace srl {
+
+/** Options set on a socket when its connection is created.
+
+    Zero values keep the kernel default. Options that do not exist in the platform
+    are ignored, and TCP options are not set on Unix domain sockets. Setting an
+    option that the kernel rejects fails the connection.
+ */
+struct socket_options {
+    /** TCP_NODELAY: write the request at once instead of waiting to coalesce
+        small writes (Nagle's algorithm) */
+    bool noDelay = true;
+    /** SO_RCVBUF in bytes. Setting it disables receive buffer autotuning in Linux */
+    int receiveBufferSize = 0;
+    /** SO_SNDBUF in bytes */
+    int sendBufferSize = 0;
+    /** TCP_QUICKACK: acknowledge segments at once instead of delaying the acks. Linux only.
+        The kernel may go back to delayed acks later in the connection */
+    bool quickAck = false;
+    /** SO_BUSY_POLL: microseconds to busy poll the device queue waiting for data
+        instead of sleeping. Linux only. Raising it may need CAP_NET_ADMIN */
+    int busyPollMicroseconds = 0;
+    /** TCP_FASTOPEN_CONNECT: send the request in the SYN to servers that gave a
+        Fast Open cookie in a previous connection. Linux only */
+    bool fastOpen = false;
+    /** SO_KEEPALIVE: probe the connection after this much idle time. Zero disables probes */
+    std::chrono::seconds keepAliveIdle{0};
+    /** Time between keep-alive probes */
+    std::chrono::seconds keepAliveInterval{0};
+    /** Unanswered probes before the connection is dropped */
+    int keepAliveCount = 0;
+};
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -1,6 +1,20 @@
 #include "gdg/srl/srl.hpp"
+#include "gdg/srl/budget.hpp"
+#include "gdg/srl/cancellation.hpp"
 #include "gdg/srl/exceptions.hpp"
+#include "gdg/srl/detail/http.hpp"
+#include "gdg/srl/testing/http_server.hpp"
+#include "gdg/srl/url.hpp"
+#include <array>
+#include <atomic>
+#include <functional>
+#include <list>
 #include <unordered_map>
+#include <map>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <tuple>
 #include <boost/regex.hpp>
 #include <regex>
 #include <iostream>
@@ -17,168 +31,571 @@ using namespace gdg::srl;
 namespace {
 
 
-string build_request(gdg::srl::string_view_t host, gdg::srl::string_view_t resource) {
-    return "GET " + string(resource) + " HTTP/1.1\r\nHost: " + string(host)
-        + "\r\nConnection: close\r\n\r\n";
+//Class of the failure of a request as a \ref retry_on value, zero if it is none of them
+unsigned classify_failure(exception_ptr const & error) {
+    try {
+        rethrow_exception(error);
+    }
+    catch (timeout_exception const &) {
+        return retry_on_timeout;
+    }
+    catch (boost::system::system_error const & e) {
+        return e.code() == net::error::host_not_found ? retry_on{} : retry_on_connection_error;
+    }
+    catch (bad_request_exception const & e) {
+        if (e.errorCode == 429 || e.errorCode == 503)
+            return retry_on_overload;
+        return e.errorCode >= 500 ? retry_on_server_error : retry_on{};
+    }
+    catch (...) {
+        return 0;
+    }
 }
 
 
-TEST_CASE("build request") {
-    CHECK(build_request("www.vandal.net", "/") ==
-          "GET / HTTP/1.1\r\nHost: www.vandal.net\r\nConnection: close\r\n\r\n");
-
-    CHECK(build_request("www.publico.es", "/") ==
-          "GET / HTTP/1.1\r\nHost: www.publico.es\r\nConnection: close\r\n\r\n");
+//True if the failure of a request tells that its host is overloaded or unreachable
+bool signals_overload(exception_ptr const & error) {
+    return classify_failure(error) != 0;
+}
 
-    CHECK(build_request("www.boost.org", "/LICENSE_1_0.txt") ==
-          "GET /LICENSE_1_0.txt HTTP/1.1\r\nHost: www.boost.org\r\nConnection: close\r\n\r\n");
 
+//Wait before retry number retry, from 0, with full jitter
+chrono::steady_clock::duration backoff_delay(retry_options const & options, unsigned retry) {
+    thread_local mt19937_64 generator{random_device{}()};
+    auto const cap = static_cast<double>(options.maxBackoff.count());
+    auto ceiling = static_cast<double>(options.initialBackoff.count());
+    for (unsigned i = 0; i < retry && ceiling < cap; ++i)
+        ceiling *= options.multiplier;
+    ceiling = min(ceiling, cap);
+    uniform_real_distribution<double> jitter(0, max(ceiling, 0.0));
+    return chrono::steady_clock::duration(static_cast<chrono::steady_clock::rep>(jitter(generator)));
 }
 
 
-vector<gdg::srl::byte_t> async_read_fixed_body(gdg::srl::net::ip::tcp::socket & s,
-                                               gdg::srl::net::streambuf & buf,
-                                               size_t sizeInBytes,
-                                               gdg::srl::net::yield_context yield) {
-    boost::system::error_code ec{};
+//Lets a coroutine stop a request run by another coroutine of the same strand
+struct request_cancellation {
+    bool cancelled = false;
+    //Socket in use by the request, if any
+    detail::socket_t * socket = nullptr;
+    //Stops the attempts of a request that makes several at once
+    function<void()> onCancel;
 
-    auto bytesRead =
-        net::async_read
-        (s, buf,
-         net::transfer_exactly(sizeInBytes),
-         yield[ec]);
-    if (ec && ec != net::error::eof)
-        throw boost::system::system_error{ec};
+    //The operation pending in the socket fails, and so does the request
+    void cancel() {
+        cancelled = true;
+        boost::system::error_code ec;
+        if (socket)
+            socket->close(ec);
+        if (onCancel)
+            onCancel();
+    }
+};
 
-    istream is(&buf);
-    is >> noskipws;
-    vector<byte_t> result(sizeInBytes);
 
-    std::size_t i = 0;
-    copy_n(istream_iterator<byte_t>{is},
-           sizeInBytes, result.begin());
+//Points a cancellation to the socket of a request until the request is over
+class cancellation_registration {
+public:
+    explicit cancellation_registration(request_cancellation * cancellation)
+        : cancellation_(cancellation) {
+    }
 
-    return result;
+    ~cancellation_registration() {
+        if (cancellation_)
+            cancellation_->socket = nullptr;
+    }
+
+    //Throws if the request was cancelled before the socket could be closed
+    void track(detail::socket_t & socket) {
+        if (!cancellation_)
+            return;
+        if (cancellation_->cancelled)
+            throw cancelled_exception{};
+        cancellation_->socket = &socket;
+    }
+
+    bool cancelled() const { return cancellation_ && cancellation_->cancelled; }
+
+private:
+    request_cancellation * cancellation_;
+};
+
+
+//Where the requests to a host get their connections
+struct connection_route {
+    socket_options socketOptions;
+    shared_ptr<connection_pool> pool;
+    //If not null, the request to host and resource
+    shared_ptr<prepared_request const> prepared;
+    //If not null, the endpoints of host, which is not resolved
+    shared_ptr<endpoint_set> endpoints;
+    //If not null, where the endpoints of a host that is resolved are kept to balance it
+    shared_ptr<resolved_endpoints> resolved;
+};
+
+
+//Endpoint picked for a request, outstanding until the request is over
+class endpoint_lease {
+public:
+    explicit endpoint_lease(endpoint_set * endpoints)
+        : endpoints_(endpoints),
+          index_(endpoints ? endpoints->acquire() : 0),
+          start_(chrono::steady_clock::now()) {
+    }
+
+    ~endpoint_lease() {
+        if (endpoints_)
+            endpoints_->release(index_);
+    }
+
+    endpoint_lease(endpoint_lease const &) = delete;
+    endpoint_lease & operator=(endpoint_lease const &) = delete;
+
+    //Ends the request with its response
+    void succeeded() {
+        if (endpoints_)
+            endpoints_->release_succeeded(index_, chrono::steady_clock::now() - start_);
+        endpoints_ = nullptr;
+    }
+
+    //Ends the request with error. An answer other than a server error is no failure of the endpoint
+    void failed(exception_ptr const & error) {
+        if (!endpoints_)
+            return;
+        try {
+            rethrow_exception(error);
+        }
+        catch (bad_request_exception const & e) {
+            if (e.errorCode < 500) {
+                succeeded();
+                return;
+            }
+        }
+        catch (...) {
+        }
+        endpoints_->release_failed(index_);
+        endpoints_ = nullptr;
+    }
+
+    //Host under which the connections of the request are pooled: the endpoint if there is one
+    string const & pool_host(string const & host) const {
+        return endpoints_ ? endpoints_->host(index_) : host;
+    }
+
+    endpoint_set * endpoints() const { return endpoints_; }
+
+    ip::tcp::endpoint const & endpoint() const { return endpoints_->endpoint(index_); }
+
+private:
+    endpoint_set * endpoints_;
+    size_t index_;
+    chrono::steady_clock::time_point start_;
+};
+
+
+//Connects socket to host, through the endpoint leased or the endpoints cached by the
+//prepared request if there are
+void connect_host(net::io_service & io,
+                  detail::socket_t & socket,
+                  string const & host,
+                  connection_route const & route,
+                  endpoint_lease const & lease,
+                  net::yield_context yield,
+                  request_timings & timings) {
+    auto const & options = route.socketOptions;
+    if (lease.endpoints()) {
+        timings.mark_resolved();
+        detail::async_connect_endpoints(io, socket, {lease.endpoint()}, yield, options);
+        timings.mark_connected();
+        return;
+    }
+    auto const prepared = route.prepared.get();
+    if (!prepared || detail::is_unix_socket_host(host)) {
+        detail::async_connect_host(io, socket, host, yield, &timings, options);
+        return;
+    }
+    auto endpoints = prepared->cached_endpoints();
+    if (!endpoints) {
+        endpoints = make_shared<vector<ip::tcp::endpoint> const>(detail::async_resolve_host(io, host, yield));
+        prepared->cache_endpoints(endpoints);
+    }
+    timings.mark_resolved();
+    try {
+        detail::async_connect_endpoints(io, socket, *endpoints, yield, options);
+    }
+    catch (...) {
+        //The host may have moved: resolve it again next time
+        prepared->cache_endpoints(nullptr);
+        throw;
+    }
+    timings.mark_connected();
 }
 
 
-vector<byte_t> async_read_chunked_body(net::ip::tcp::socket & s,
-                                       net::streambuf & buf,
-                                       net::yield_context yield) {
-    size_t bytesRead{};
-    size_t chunkSize{};
-    istream is(&buf);
-    is >> noskipws;
-    boost::system::error_code ec{};
-    vector<byte_t> result;
-    while (true) {
-        //Read the chunk size into the buffer
-        bytesRead =
-            net::async_read_until(s, buf, "\r\n",
-                                  yield[ec]);
-
-        if (ec && ec != net::error::eof)
-            throw boost::system::system_error{ec};
-        string chunkSizeStr;
-
-        //Put chunk size in a string
-        getline(is, chunkSizeStr);
-
-        //Convert hex chunksize into a decimal number
-        chunkSize = stoi(chunkSizeStr,
-                         nullptr, 16);
-        if (!chunkSize) {
-            bytesRead = net::async_read
-                (s, buf,
-                 net::transfer_exactly(2),
-                 yield[ec]);
-            if (ec && ec != net::error::eof)
-                throw boost::system::system_error{ec};
-            break;
+response http_get(net::io_service & io,
+                  string const & host,
+                  string const & resource,
+                  chrono::steady_clock::duration timeOut,
+                  connection_route const & route,
+                  request_cancellation * cancellation,
+                  string * redirectLocation,
+                  net::yield_context yield) {
+    request_timings timings;
+    timings.mark_start();
+    auto const & pool = route.pool;
+    auto const prepared = route.prepared.get();
+    auto endpoints = route.endpoints;
+    if (!endpoints && route.resolved && !detail::is_unix_socket_host(host)) {
+        endpoints = route.resolved->find(host);
+        if (!endpoints)
+            endpoints = route.resolved->update(host, detail::async_resolve_host(io, host, yield));
+    }
+    endpoint_lease lease(endpoints.get());
+    auto const & poolHost = lease.pool_host(host);
+    auto socket = pool ? pool->try_acquire(poolHost) : nullptr;
+    bool reused = socket != nullptr;
+    if (!socket)
+        socket = make_unique<detail::socket_t>(io);
+    cancellation_registration registration(cancellation);
+    detail::socket_deadline deadline(io, timeOut, yield);
+
+    try {
+        registration.track(*socket);
+        deadline.watch(*socket);
+        if (reused) {
+            timings.mark_resolved();
+            timings.mark_connected();
+        }
+        else {
+            connect_host(io, *socket, host, route, lease, yield, timings);
+            //The connection may have been raced in sockets out of reach of the cancellation
+            registration.track(*socket);
+            deadline.watch(*socket);
         }
+        string built;
+        if (!prepared)
+            built = detail::build_request(host, resource, "", pool != nullptr);
+        auto const & request = prepared ? prepared->bytes(pool != nullptr) : built;
+
+        detail::receive_buffer buf;
+        detail::response_head head;
+        for (;;) {
+            try {
+                net::async_write(*socket, net::buffer(request), yield);
+                timings.mark_request_written();
+                head = detail::async_read_response_head(*socket, buf, yield);
+                break;
+            }
+            catch (boost::system::system_error const &) {
+                //The server may have closed a kept alive connection right as it was
+                //taken from the pool: try once more in a new connection
+                if (!reused || buf.size() || registration.cancelled() || deadline.expired())
+                    throw;
+                reused = false;
+                socket = make_unique<detail::socket_t>(io);
+                registration.track(*socket);
+                deadline.watch(*socket);
+                connect_host(io, *socket, host, route, lease, yield, timings);
+                registration.track(*socket);
+                deadline.watch(*socket);
+            }
+        }
+        timings.mark_first_byte();
+
+        using detail::header_field;
+        //A redirect followed is read to the end, so that its connection can take the next hop
+        bool const redirect = redirectLocation && detail::is_redirect(head.status)
+            && head.has(header_field::location);
+        if (head.status != 200 && !redirect)
+            throw bad_request_exception(head.status);
 
-        auto chunkBytesToRead = chunkSize;
-        //read exactly chunkSize
-        bytesRead = net::async_read
-            (s, buf,
-             net::transfer_exactly(chunkBytesToRead),
-             yield[ec]);
-        if (ec && ec != net::error::eof)
-            throw boost::system::system_error{ec};
-
-        copy_n(istream_iterator<char>{is},
-               chunkBytesToRead,
-               back_inserter(result));
-
-        //Read trailing \r\n after the data
-        bytesRead = net::async_read
-            (s, buf,
-             net::transfer_exactly(2),
-             yield[ec]);
-        if (ec && ec != net::error::eof)
-            throw boost::system::system_error{ec};
-
-        //Discard the \r\n after the data
-        is.ignore(2);
+        bool const readInChunks = head.chunked();
+
+        response_body body;
+        if (readInChunks) {
+            body = detail::async_read_body(*socket, buf, readInChunks, yield);
+        }
+        else {
+            if (head.contentLength < 0)
+                throw runtime_error
+                    ("Cannot parse HTTP response -> "
+                     "not supported: missing both content-length and transfer-encoding headers");
+            if (head.contentLength != 0)
+                body = detail::async_read_body(*socket, buf, readInChunks, yield,
+                                               static_cast<size_t>(head.contentLength));
+        }
+        if (deadline.expired())
+            throw timeout_exception{};
+        timings.mark_completed();
+        lease.succeeded();
+        response result{head.status, {}};
+        if (redirect) {
+            *redirectLocation = string(head.get(header_field::location));
+        }
+        else {
+            record_latency(host, timings);
+            result.second = move(body);
+        }
+        result.timings = timings;
+        if (pool) {
+            if (detail::keeps_connection_open(head))
+                pool->release(poolHost, move(socket));
+            else
+                pool->discard(poolHost);
+        }
+        result.headers = move(head.headers);
+        return result;
+    }
+    catch (...) {
+        boost::system::error_code ec;
+        socket->close(ec);
+        if (pool)
+            pool->discard(poolHost);
+        //Whatever the pending operation failed with, the cause is the cancellation
+        if (registration.cancelled())
+            throw cancelled_exception{};
+        //or the timeout, which closed the socket. A hung endpoint fails as well
+        auto const error = deadline.expired() ? make_exception_ptr(timeout_exception{}) : current_exception();
+        lease.failed(error);
+        rethrow_exception(error);
     }
-    return result;
 }
 
 
-vector<byte_t> async_read_body(net::ip::tcp::socket & s,
-                               net::streambuf & buf,
-                               bool readInChunks,
-                               net::yield_context yield,
-                               int contentLength = 0) {
-    vector<byte_t> result;
-    if (!readInChunks) {
-        result = async_read_fixed_body(s, buf, contentLength, yield);
+struct hedge_counters {
+    atomic<uint64_t> hedges{0};
+    atomic<uint64_t> hedgeWins{0};
+    atomic<uint64_t> budgetExhausted{0};
+};
+
+
+//Attempts of a hedged request, run in the strand of the request
+struct hedge_race {
+    explicit hedge_race(net::io_service & io) : wakeup(io) {}
+
+    //Cancelled by every attempt that finishes, to wake up the request
+    net::steady_timer wakeup;
+    array<request_cancellation, 2> cancellations;
+    size_t running = 0;
+    int winner = -1;
+    response result;
+    array<string, 2> locations;
+    exception_ptr error;
+};
+
+
+response hedged_http_get(net::io_service & io,
+                         string const & host,
+                         string const & resource,
+                         chrono::steady_clock::duration timeOut,
+                         connection_route const & route,
+                         hedging_options const & options,
+                         request_budget & budget,
+                         hedge_counters & counters,
+                         rate_limiter * limiter,
+                         request_cancellation * cancellation,
+                         string * redirectLocation,
+                         net::yield_context yield) {
+    using duration = chrono::steady_clock::duration;
+    budget.deposit();
+    auto const started = chrono::steady_clock::now();
+    auto const delay = options.delay > duration::zero()
+        ? options.delay
+        : chrono::duration_cast<duration>(total_latency_percentile(host, options.percentile, options.minSamples));
+    if (delay == duration::zero() || delay >= timeOut)
+        return http_get(io, host, resource, timeOut, route, cancellation, redirectLocation, yield);
+    if (cancellation && cancellation->cancelled)
+        throw cancelled_exception{};
+
+    auto race = make_shared<hedge_race>(io);
+    if (cancellation) {
+        cancellation->onCancel = [race] {
+            for (auto & attempt : race->cancellations)
+                attempt.cancel();
+            race->wakeup.cancel();
+        };
     }
-    else {
-        result = async_read_chunked_body(s, buf, yield);
+    auto const stopped = [cancellation] { return cancellation && cancellation->cancelled; };
+    //Spawned from yield, the attempts share the strand of the request
+    auto attempt = [&](size_t i, duration attemptTimeOut) {
+        ++race->running;
+        net::spawn(yield, [&io, race, i, host, resource, attemptTimeOut, route, redirectLocation]
+                   (net::yield_context attemptYield) {
+                try {
+                    auto fetched = http_get(io, host, resource, attemptTimeOut, route,
+                                            &race->cancellations[i],
+                                            redirectLocation ? &race->locations[i] : nullptr, attemptYield);
+                    if (race->winner < 0) {
+                        race->winner = static_cast<int>(i);
+                        race->result = move(fetched);
+                    }
+                }
+                catch (...) {
+                    if (!race->cancellations[i].cancelled)
+                        race->error = current_exception();
+                }
+                --race->running;
+                race->wakeup.cancel();
+            });
+    };
+
+    boost::system::error_code ec;
+    attempt(0, timeOut);
+    if (race->winner < 0 && race->running) {
+        race->wakeup.expires_from_now(delay);
+        race->wakeup.async_wait(yield[ec]);
     }
-    return result;
+    if (race->winner < 0 && race->running && !stopped()) {
+        bool allowed = budget.try_withdraw();
+        if (allowed && limiter && !limiter->try_acquire(host)) {
+            //Not sent, so not spent
+            budget.refund();
+            allowed = false;
+        }
+        if (allowed) {
+            ++counters.hedges;
+            attempt(1, timeOut - (chrono::steady_clock::now() - started));
+        }
+        else {
+            ++counters.budgetExhausted;
+        }
+    }
+    while (race->winner < 0 && race->running) {
+        race->wakeup.expires_at(net::steady_timer::time_point::max());
+        race->wakeup.async_wait(yield[ec]);
+    }
+    if (cancellation)
+        cancellation->onCancel = nullptr;
+    for (size_t i = 0; i < race->cancellations.size(); ++i) {
+        if (static_cast<int>(i) != race->winner)
+            race->cancellations[i].cancel();
+    }
+    if (race->winner < 0 && stopped())
+        throw cancelled_exception{};
+    if (race->winner < 0)
+        rethrow_exception(race->error);
+    if (race->winner == 1)
+        ++counters.hedgeWins;
+    if (redirectLocation)
+        *redirectLocation = move(race->locations[race->winner]);
+    return move(race->result);
 }
 
 
-unordered_map<string, string> get_headers(istream & input) {
-    static const regex spaces("\\s*");
-    string line;
-    unordered_map<string, string> headers;
+//Result of a request, completed by the request or by its cancellation, whichever comes first
+struct request_outcome {
+    promise<response> result;
+    atomic<bool> completed{false};
+    //If set, takes the future of result once it is ready, instead of the caller
+    function<void(future<response>)> onCompleted;
+    future<response> pending;
 
-    while (getline(input, line) && !regex_match(line, spaces)) {
-        auto const separatorIt = find(line.begin(), line.end(), ':');
-        auto fieldName = string(line.begin(), separatorIt);
-        transform(fieldName.begin(), fieldName.end(), fieldName.begin(), &::tolower);
-        headers[fieldName] =
-            string(find_if(next(separatorIt),
-                           line.end(),
-                           [](auto c) {
-                               return !isspace(c); }),
-                   line.end());
+    void set_value(response value) {
+        if (!completed.exchange(true)) {
+            result.set_value(move(value));
+            notify();
+        }
+    }
+
+    void set_exception(exception_ptr error) {
+        if (!completed.exchange(true)) {
+            result.set_exception(move(error));
+            notify();
+        }
+    }
+
+    void notify() {
+        if (onCompleted)
+            onCompleted(move(pending));
+    }
+};
+
+
+struct retry_counters {
+    atomic<uint64_t> retries{0};
+    atomic<uint64_t> recovered{0};
+    atomic<uint64_t> budgetExhausted{0};
+};
+
+
+//Runs attempt(timeOut) until it succeeds or its failure may not be retried. A cancel also
+//stops the wait before a retry
+template <class Attempt>
+response retrying_http_get(net::io_service & io,
+                           string const & host,
+                           chrono::steady_clock::duration timeOut,
+                           retry_options const & options,
+                           request_budget & budget,
+                           retry_counters & counters,
+                           rate_limiter * limiter,
+                           request_cancellation * cancellation,
+                           net::yield_context yield,
+                           Attempt attempt) {
+    using clock = chrono::steady_clock;
+    budget.deposit();
+    auto const deadline = clock::now() + timeOut;
+    for (unsigned retry = 0;; ++retry) {
+        auto const remaining = deadline - clock::now();
+        if (remaining <= clock::duration::zero())
+            throw timeout_exception{};
+        auto const attemptTimeOut = options.attemptTimeout > clock::duration::zero()
+            ? min(options.attemptTimeout, remaining)
+            : remaining;
+        clock::duration backoff;
+        try {
+            auto result = attempt(attemptTimeOut);
+            if (retry)
+                ++counters.recovered;
+            return result;
+        }
+        catch (...) {
+            if (retry >= options.maxRetries || !(options.retryOn & classify_failure(current_exception())))
+                throw;
+            backoff = backoff_delay(options, retry);
+            if (clock::now() + backoff >= deadline)
+                throw;
+            if (!budget.try_withdraw()) {
+                ++counters.budgetExhausted;
+                throw;
+            }
+            if (limiter) {
+                auto const tokenWait = limiter->reserve(host, deadline - clock::now());
+                if (tokenWait == clock::duration::max()) {
+                    budget.refund();
+                    throw;
+                }
+                backoff = max(backoff, tokenWait);
+            }
+            ++counters.retries;
+        }
+        if (cancellation && cancellation->cancelled)
+            throw cancelled_exception{};
+        net::steady_timer timer(io);
+        timer.expires_from_now(backoff);
+        if (cancellation)
+            cancellation->onCancel = [&timer] { timer.cancel(); };
+        boost::system::error_code ec;
+        timer.async_wait(yield[ec]);
+        if (cancellation) {
+            cancellation->onCancel = nullptr;
+            if (cancellation->cancelled)
+                throw cancelled_exception{};
+        }
     }
-    return headers;
 }
 
 
-TEST_CASE("get headers") {
-    string const headersStr =
-        R"--(Date: Mon, 27 Jan 2017 12:28:53 GMT
-Server: Apache/2.2.14 (Win32)
-Last-Modified: Wed, 22 Jul 2009 19:15:56 GMT
-Content-Length: 88
-Content-Type: text/html
-Connection: Closed)--";
+//Requests in flight through async_http_get_coalesced, by loop, host and resource
+struct coalescing_registry {
+    using key_type = tuple<net::io_service const *, string, string>;
 
-    istringstream headersStream(headersStr);
-    auto headers = get_headers(headersStream);
+    mutex mtx;
+    map<key_type, shared_future<pair<int, shared_body>>> inflight;
+};
 
-    CHECK(headers.size() == 6);
-    auto it = headers.find("content-length");
-    CHECK(it->second == "88");
 
-    auto it2 = headers.find("date");
-    CHECK(it2->second == "Mon, 27 Jan 2017 12:28:53 GMT");
+coalescing_registry & get_coalescing_registry() {
+    static coalescing_registry registry;
+    return registry;
 }
 
 } //anon namespace
@@ -204,103 +621,482 @@ net::io_service & get_default_loop() {
     return svc;
 }
 
-future<pair<int, vector<byte_t>>> async_http_get(string_view_t host,
-                                                 string_view_t resource,
-                                                 chrono::steady_clock::duration timeOut) {
+future<response> async_http_get(string_view_t host,
+                                string_view_t resource,
+                                chrono::steady_clock::duration timeOut) {
     return async_http_get(get_default_loop(),
                           host, resource, timeOut);
 }
 
 
-future<pair<int, vector<byte_t>>> async_http_get(net::io_service & io,
-                                                 string_view_t host,
-                                                 string_view_t resource,
-                                                 chrono::steady_clock::duration timeOut) {
-    promise<pair<int, vector<byte_t>>> result_promise;
-    auto result = result_promise.get_future();
-    net::spawn
-        (io,
-         [&io, hoststr=string(host), timeOut = timeOut,
-          result_promise = move(result_promise), host, resource]
-         (net::yield_context yield) mutable {
-            ip::tcp::socket socket(io);
+future<response> async_http_get(net::io_service & io,
+                                string_view_t host,
+                                string_view_t resource,
+                                chrono::steady_clock::duration timeOut) {
+    client_options options;
+    options.reuseConnections = false;
+    return client(io, move(options)).async_http_get(host, resource, timeOut);
+}
 
-            try {
-                atomic<bool> timeoutReached{false};
-                net::steady_timer timer(io);
-                timer.expires_from_now(timeOut);
-                timer.async_wait([&timeoutReached](auto ec) {
-                        if (ec != net::error::operation_aborted) {
-                            timeoutReached = true;
-                        }
-                    });
-                ip::tcp::resolver::query q(hoststr, "http");
-                ip::tcp::resolver resolver(io);
-                net::async_connect(socket, resolver.async_resolve(q, yield), yield);
-                string const request = build_request(host, resource);
 
+struct client::hedging_state {
+    hedging_state(hedging_options const & options)
+        : budget(options.budgetRatio, options.budgetBurst) {
+    }
 
-                net::async_write(socket, net::buffer(request), yield);
-                net::streambuf buf;
+    request_budget budget;
+    hedge_counters counters;
+};
 
-                net::async_read_until(socket, buf, "\r\n\r\n",
-                                      yield);
 
-                if (timeoutReached) {
-                    result_promise.set_exception(make_exception_ptr(timeout_exception{}));
-                    return;
-                }
-                istream response(&buf);
-                string httpVersion, retCode, retString;
-                response >> httpVersion >> retCode;
-                getline(response, retString);
-                auto retCodeInt = std::stoi(retCode);
-                if (retCodeInt != 200)
-                    throw bad_request_exception(retCodeInt);
-                string line;
-                getline(response, line);
-
-                auto const headers = get_headers(response);
-                bool const readInChunks = [&headers]() {
-                    if (headers.find("transfer-encoding") != headers.end())
-                        return true;
-                    else
-                        return false;
-                }();
-
-                if (readInChunks) {
-                    if (timeoutReached) {
-                        result_promise.set_exception(make_exception_ptr(timeout_exception{}));
-                        return;
-                    }
-                    result_promise.set_value({200, async_read_body(socket, buf, readInChunks, yield)});
+struct client::retry_state {
+    retry_state(retry_options const & options)
+        : budget(options.budgetRatio, options.budgetBurst) {
+    }
 
-                }
-                else {
-                    auto itContentLength = headers.find("content-length");
-                    if (itContentLength == headers.end())
-                        throw runtime_error
-                            ("Cannot parse HTTP response -> "
-                             "not supported: missing both content-length and transfer-encoding headers");
-                    if (stoi(itContentLength->second) == 0) {
-                        result_promise.set_value({200, {}});
+    request_budget budget;
+    retry_counters counters;
+};
+
+
+struct client::redirect_state {
+    using target = pair<string, string>;
+
+    redirect_state(redirect_options const & options)
+        : options(options) {
+    }
+
+    //Takes to where the permanent redirects remembered lead, up to maxHops of them.
+    //Returns the hops taken
+    unsigned follow_cached(target & to, unsigned maxHops) {
+        if (!options.cachePermanent)
+            return 0;
+        lock_guard<mutex> lock(mtx);
+        unsigned hops = 0;
+        for (auto it = permanent.find(to); hops < maxHops && it != permanent.end(); it = permanent.find(to)) {
+            recent.splice(recent.begin(), recent, it->second);
+            to = it->second->second;
+            ++hops;
+        }
+        cacheHits += hops;
+        return hops;
+    }
+
+    void remember(target from, target to) {
+        if (!options.cachePermanent || !options.maxCachedRedirects)
+            return;
+        lock_guard<mutex> lock(mtx);
+        auto const it = permanent.find(from);
+        if (it != permanent.end()) {
+            it->second->second = move(to);
+            recent.splice(recent.begin(), recent, it->second);
+            return;
+        }
+        if (permanent.size() >= options.maxCachedRedirects) {
+            permanent.erase(recent.back().first);
+            recent.pop_back();
+        }
+        recent.emplace_front(move(from), move(to));
+        permanent.emplace(recent.front().first, recent.begin());
+    }
+
+    redirect_options const options;
+    mutable mutex mtx;
+    //Redirects from the most recently used, and where each one is in it
+    list<pair<target, target>> recent;
+    map<target, list<pair<target, target>>::iterator> permanent;
+    atomic<uint64_t> followed{0};
+    atomic<uint64_t> cacheHits{0};
+};
+
+
+client::client(net::io_service & io, client_options options)
+    : io_(&io), options_(move(options)) {
+    if (options_.scheduler.limits_requests())
+        scheduler_ = make_shared<request_scheduler>(options_.scheduler);
+    if (options_.hedging.enabled)
+        hedging_ = make_shared<hedging_state>(options_.hedging);
+    if (options_.retry.maxRetries)
+        retry_ = make_shared<retry_state>(options_.retry);
+    if (options_.rateLimit.limits_requests())
+        rateLimiter_ = make_shared<rate_limiter>(options_.rateLimit);
+    if (options_.redirect.maxRedirects)
+        redirect_ = make_shared<redirect_state>(options_.redirect);
+    if (!options_.endpoints.empty()) {
+        auto endpoints = make_shared<endpoint_sets>();
+        for (auto const & host : options_.endpoints)
+            endpoints->emplace(host.first, make_shared<endpoint_set>(host.second));
+        endpoints_ = move(endpoints);
+    }
+    if (options_.balancing.enabled)
+        balancing_ = make_shared<resolved_endpoints>(options_.balancing.endpoints, options_.balancing.resolveTtl);
+    if (!options_.reuseConnections)
+        return;
+    pool_ = make_shared<connection_pool>(io, options_.pool);
+    for (auto const & hot : options_.pool.warmConnections)
+        prewarm_pool(hot.first, hot.second);
+}
+
+
+client::client(client_options options)
+    : client(get_default_loop(), move(options)) {
+}
+
+
+socket_options const & client::socket_options_for(string const & host) const {
+    auto const it = options_.hostSocket.find(host);
+    return it != options_.hostSocket.end() ? it->second : options_.socket;
+}
+
+
+future<void> client::prewarm(string const & host, size_t connections) {
+    if (!pool_)
+        throw logic_error("Cannot prewarm connections of a client that does not reuse connections");
+    return prewarm_pool(host, connections);
+}
+
+
+vector<endpoint_load> client::endpoint_stats(string const & host) const {
+    auto const endpoints = endpoint_set_of(host);
+    return endpoints ? endpoints->loads() : vector<endpoint_load>{};
+}
+
+
+shared_ptr<endpoint_set> client::endpoint_set_of(string const & host) const {
+    if (endpoints_) {
+        auto const it = endpoints_->find(host);
+        if (it != endpoints_->end())
+            return it->second;
+    }
+    return balancing_ ? balancing_->latest(host) : nullptr;
+}
+
+
+future<void> client::prewarm_pool(string const & host, size_t connections) {
+    auto const & socketOptions = socket_options_for(host);
+    auto const endpoints = endpoint_set_of(host);
+    if (!endpoints)
+        return pool_->prewarm(host, connections, socketOptions);
+    //Connections are pooled per endpoint: spread them among the endpoints
+    auto const perEndpoint = (connections + endpoints->size() - 1) / endpoints->size();
+    vector<future<void>> warming;
+    for (size_t i = 0; i < endpoints->size(); ++i)
+        warming.push_back(pool_->prewarm(endpoints->host(i), perEndpoint, socketOptions));
+    return async(launch::deferred, [warming = move(warming)]() mutable {
+            for (auto & warm : warming)
+                warm.get();
+        });
+}
+
+
+connection_pool_stats client::pool_stats() const {
+    return pool_ ? pool_->stats() : connection_pool_stats{};
+}
+
+
+scheduler_stats client::queue_stats() const {
+    return scheduler_ ? scheduler_->stats() : scheduler_stats{};
+}
+
+
+hedging_stats client::hedge_stats() const {
+    hedging_stats result;
+    if (!hedging_)
+        return result;
+    result.hedges = hedging_->counters.hedges;
+    result.hedgeWins = hedging_->counters.hedgeWins;
+    result.budgetExhausted = hedging_->counters.budgetExhausted;
+    return result;
+}
+
+
+retrying_stats client::retry_stats() const {
+    retrying_stats result;
+    if (!retry_)
+        return result;
+    result.retries = retry_->counters.retries;
+    result.recovered = retry_->counters.recovered;
+    result.budgetExhausted = retry_->counters.budgetExhausted;
+    return result;
+}
+
+
+rate_limiter_stats client::rate_limit_stats() const {
+    return rateLimiter_ ? rateLimiter_->stats() : rate_limiter_stats{};
+}
+
+
+redirecting_stats client::redirect_stats() const {
+    redirecting_stats result;
+    if (!redirect_)
+        return result;
+    result.followed = redirect_->followed;
+    result.cacheHits = redirect_->cacheHits;
+    lock_guard<mutex> lock(redirect_->mtx);
+    result.cached = redirect_->permanent.size();
+    return result;
+}
+
+
+future<response> client::async_http_get(string_view_t host,
+                                        string_view_t resource,
+                                        chrono::steady_clock::duration timeOut,
+                                        request_priority priority) {
+    return start_get(host, resource, timeOut, priority, nullptr, nullptr);
+}
+
+
+future<response> client::async_http_get(string_view_t host,
+                                        string_view_t resource,
+                                        chrono::steady_clock::duration timeOut,
+                                        cancellation_token const & cancellation,
+                                        request_priority priority) {
+    return start_get(host, resource, timeOut, priority, &cancellation, nullptr);
+}
+
+
+future<response> client::async_http_get(prepared_request const & request,
+                                        chrono::steady_clock::duration timeOut,
+                                        request_priority priority) {
+    return start_get(request.host(), request.resource(), timeOut, priority, nullptr,
+                     make_shared<prepared_request const>(request));
+}
+
+
+future<response> client::async_http_get(prepared_request const & request,
+                                        chrono::steady_clock::duration timeOut,
+                                        cancellation_token const & cancellation,
+                                        request_priority priority) {
+    return start_get(request.host(), request.resource(), timeOut, priority, &cancellation,
+                     make_shared<prepared_request const>(request));
+}
+
+
+void client::async_http_get(prepared_request const & request,
+                            chrono::steady_clock::duration timeOut,
+                            function<void(future<response>)> onCompleted,
+                            request_priority priority) {
+    start_get(request.host(), request.resource(), timeOut, priority, nullptr,
+              make_shared<prepared_request const>(request), move(onCompleted));
+}
+
+
+future<response> client::start_get(string_view_t host,
+                                   string_view_t resource,
+                                   chrono::steady_clock::duration timeOut,
+                                   request_priority priority,
+                                   cancellation_token const * cancellation,
+                                   shared_ptr<prepared_request const> prepared,
+                                   function<void(future<response>)> onCompleted) {
+    auto outcome = make_shared<request_outcome>();
+    auto result = outcome->result.get_future();
+    if (onCompleted) {
+        outcome->onCompleted = move(onCompleted);
+        outcome->pending = move(result);
+    }
+    if (cancellation && cancellation->cancelled()) {
+        outcome->set_exception(make_exception_ptr(cancelled_exception{}));
+        return result;
+    }
+    auto & io = *io_;
+    //The request runs in its strand, where its cancellation closes its sockets
+    auto strand = net::make_strand(io);
+    shared_ptr<request_cancellation> stop;
+    shared_ptr<cancellation_token const> token;
+    function<void()> unsubscribe;
+    if (cancellation) {
+        stop = make_shared<request_cancellation>();
+        token = make_shared<cancellation_token const>(*cancellation);
+        auto const id = cancellation->subscribe([outcome, strand, stop] {
+                outcome->set_exception(make_exception_ptr(cancelled_exception{}));
+                net::post(strand, [stop] { stop->cancel(); });
+            });
+        unsubscribe = [token, id] { token->unsubscribe(id); };
+    }
+    auto hoststr = string(host);
+    auto socketOptions = socket_options_for(hoststr);
+    auto get = [&io, strand, hoststr, resourcestr=string(resource), timeOut = timeOut,
+                socketOptions = move(socketOptions), pool = pool_,
+                hedging = hedging_, hedgingOptions = options_.hedging,
+                retry = retry_, retryOptions = options_.retry, limiter = rateLimiter_,
+                redirects = redirect_, prepared = move(prepared), endpoints = endpoints_, balancing = balancing_,
+                outcome, stop = move(stop), token = move(token), unsubscribe = move(unsubscribe)]
+        (chrono::steady_clock::duration waited, shared_ptr<request_scheduler> scheduler) mutable {
+        net::spawn
+            (strand,
+             [&io, hoststr = move(hoststr), resourcestr = move(resourcestr), timeOut = timeOut - waited,
+              socketOptions = move(socketOptions), pool = move(pool), scheduler = move(scheduler),
+              hedging = move(hedging), hedgingOptions = move(hedgingOptions),
+              retry = move(retry), retryOptions = move(retryOptions), limiter = move(limiter),
+              redirects = move(redirects), prepared = move(prepared), endpoints = move(endpoints),
+              balancing = move(balancing),
+              outcome = move(outcome), stop = move(stop), token = move(token),
+              unsubscribe = move(unsubscribe)]
+             (net::yield_context yield) mutable {
+                using clock = chrono::steady_clock;
+                auto const started = clock::now();
+                bool dropped = false;
+                //One hop, with its hedges and retries. location is set if it is a redirect
+                auto fetch = [&](string const & host, string const & resource,
+                                 clock::duration fetchTimeOut, string * location) {
+                    connection_route route{socketOptions, pool, nullptr, nullptr, balancing};
+                    //Redirects lead out of the prepared request
+                    if (prepared && host == prepared->host() && resource == prepared->resource())
+                        route.prepared = prepared;
+                    if (endpoints) {
+                        auto const it = endpoints->find(host);
+                        if (it != endpoints->end()) {
+                            route.endpoints = it->second;
+                            route.resolved = nullptr;
+                        }
                     }
-                    else {
-                        if (timeoutReached) {
-                            result_promise.set_exception(make_exception_ptr(timeout_exception{}));
-                            return;
+                    auto attempt = [&](clock::duration attemptTimeOut) {
+                        if (hedging)
+                            return hedged_http_get(io, host, resource, attemptTimeOut, route, hedgingOptions,
+                                                   hedging->budget, hedging->counters,
+                                                   limiter.get(), stop.get(), location, yield);
+                        return http_get(io, host, resource, attemptTimeOut, route, stop.get(), location, yield);
+                    };
+                    if (retry)
+                        return retrying_http_get(io, host, fetchTimeOut, retryOptions,
+                                                 retry->budget, retry->counters,
+                                                 limiter.get(), stop.get(), yield, attempt);
+                    return attempt(fetchTimeOut);
+                };
+                try {
+                    //Cancelled while it waited for its turn. The token is cancelled before
+                    //its callbacks run, so before the request that freed the turn is stopped
+                    if (outcome->completed || (token && token->cancelled()))
+                        throw cancelled_exception{};
+                    auto const deadline = started + timeOut;
+                    auto target = make_pair(hoststr, resourcestr);
+                    unsigned hops = 0;
+                    auto const maxHops = redirects ? redirects->options.maxRedirects : 0;
+                    for (;;) {
+                        if (redirects)
+                            hops += redirects->follow_cached(target, maxHops - hops);
+                        auto const remaining = deadline - clock::now();
+                        if (remaining <= clock::duration::zero())
+                            throw timeout_exception{};
+                        string location;
+                        auto fetched = fetch(target.first, target.second, remaining,
+                                             redirects ? &location : nullptr);
+                        if (!detail::is_redirect(fetched.first)) {
+                            outcome->set_value(move(fetched));
+                            break;
+                        }
+                        if (hops >= maxHops)
+                            throw bad_request_exception(fetched.first);
+                        pair<string, string> next;
+                        try {
+                            next = detail::resolve_location(target.first, target.second, location);
+                        }
+                        catch (invalid_argument const &) {
+                            throw bad_request_exception(fetched.first);
                         }
-                        result_promise.set_value
-                            ({200,async_read_body(socket, buf, readInChunks, yield,
-                                                  std::stoi(itContentLength->second))});
+                        ++hops;
+                        ++redirects->followed;
+                        if (fetched.first == 301 || fetched.first == 308)
+                            redirects->remember(target, next);
+                        target = move(next);
                     }
                 }
-                timer.cancel();
-                if (timeoutReached)
-                    result_promise.set_exception(make_exception_ptr(timeout_exception{}));
+                catch (...) {
+                    dropped = scheduler && signals_overload(current_exception());
+                    outcome->set_exception(current_exception());
+                }
+                if (unsubscribe)
+                    unsubscribe();
+                if (scheduler)
+                    scheduler->finish(hoststr, chrono::steady_clock::now() - started, dropped);
+            });
+    };
+    if (!scheduler_ && !rateLimiter_) {
+        get(chrono::steady_clock::duration::zero(), nullptr);
+        return result;
+    }
+    //The waiting request is just this function, shared by the closures that start it
+    auto waiting = make_shared<decltype(get)>(move(get));
+    auto const tokenWait = rateLimiter_ ? rateLimiter_->reserve(hoststr, timeOut)
+                                        : chrono::steady_clock::duration::zero();
+    if (tokenWait == chrono::steady_clock::duration::max()) {
+        //Without a token in time, the request fails as timed out at once, out of the scheduler
+        (*waiting)(timeOut, nullptr);
+        return result;
+    }
+    auto schedule = [waiting, scheduler = scheduler_, hoststr, priority]
+        (chrono::steady_clock::duration tokenWait) {
+        if (!scheduler) {
+            (*waiting)(tokenWait, nullptr);
+            return;
+        }
+        //Weak: the scheduler is alive while it starts the request, and owning it
+        //from its own queue would keep it alive forever
+        weak_ptr<request_scheduler> weakScheduler = scheduler;
+        scheduler->submit(hoststr, priority, [waiting, tokenWait, weakScheduler]
+                          (chrono::steady_clock::duration waited) {
+                (*waiting)(tokenWait + waited, weakScheduler.lock());
+            });
+    };
+    if (tokenWait == chrono::steady_clock::duration::zero()) {
+        schedule(tokenWait);
+        return result;
+    }
+    auto timer = make_shared<net::steady_timer>(io, tokenWait);
+    timer->async_wait([timer, schedule, tokenWait](boost::system::error_code const &) {
+            schedule(tokenWait);
+        });
+    return result;
+}
+
+
+shared_future<pair<int, shared_body>> async_http_get_coalesced(string_view_t host,
+                                                               string_view_t resource,
+                                                               chrono::steady_clock::duration timeOut) {
+    return async_http_get_coalesced(get_default_loop(),
+                                    host, resource, timeOut);
+}
+
+
+shared_future<pair<int, shared_body>> async_http_get_coalesced(net::io_service & io,
+                                                               string_view_t host,
+                                                               string_view_t resource,
+                                                               chrono::steady_clock::duration timeOut) {
+    auto & registry = get_coalescing_registry();
+    auto key = make_tuple(&io, string(host), string(resource));
+    promise<pair<int, shared_body>> result_promise;
+    shared_future<pair<int, shared_body>> result;
+    {
+        lock_guard<mutex> lock(registry.mtx);
+        auto it = registry.inflight.find(key);
+        if (it != registry.inflight.end())
+            return it->second;
+        result = result_promise.get_future().share();
+        registry.inflight.emplace(key, result);
+    }
+    //Spawn outside the lock: nothing else in the registry is touched until
+    //the request completes
+    net::spawn
+        (io,
+         [&io, &registry, key = move(key), timeOut = timeOut,
+          result_promise = move(result_promise)]
+         (net::yield_context yield) mutable {
+            auto unregister = [&registry, &key] {
+                lock_guard<mutex> lock(registry.mtx);
+                registry.inflight.erase(key);
+            };
+            try {
+                auto fetched = http_get(io, get<1>(key), get<2>(key), timeOut,
+                                        connection_route{}, nullptr, nullptr, yield);
+                //Unregister before completing, so that requests arriving after
+                //this point download fresh data instead of the finished result
+                unregister();
+                result_promise.set_value
+                    ({fetched.first,
+                      make_shared<vector<byte_t> const>(fetched.second.release())});
             }
             catch (...) {
-                socket.close();
+                unregister();
                 result_promise.set_exception(current_exception());
             }
         });
@@ -312,8 +1108,8 @@ TEST_CASE("async http get without timeout") {
     net::io_service svc;
     net::io_service::work wk{svc};
     thread t([&svc] { svc.run(); });
-    //CHECK_NOTHROW((async_http_get(svc, "http://fossilinsects.myspecies.info", "/", 8s).get()));
-    async_http_get(svc, "http://fossilinsects.myspecies.info", "/", 8s).get();
+    auto const url = parse_url("http://fossilinsects.myspecies.info/");
+    async_http_get(svc, url.authority, url.resource, 8s).get();
     svc.stop();
     t.join();
 }
@@ -333,6 +1129,731 @@ TEST_CASE("async http get timeouts") {
 }
 
 
+TEST_CASE("async http get from loopback server") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    {
+        testing::http_server_options options;
+        options.bodySize = 100000;
+        testing::http_server server(options);
+        auto const r = async_http_get(svc, server.host(), "/", 8s).get();
+        CHECK(r.first == 200);
+        CHECK(r.second.size() == 100000);
+        CHECK(r.second[27] == 'b');
+        CHECK(r.headers.get("Server") == "srl-test");
+        CHECK(r.headers.get("content-length") == "100000");
+    }
+    {
+        testing::http_server_options options;
+        options.bodySize = 100000;
+        options.chunked = true;
+        options.chunkSize = 1000;
+        testing::http_server server(options);
+        auto const r = async_http_get(svc, server.host(), "/", 8s).get();
+        CHECK(r.first == 200);
+        CHECK(r.second.size() == 100000);
+        CHECK(r.second[99999] == 'a' + 99999 % 26);
+        CHECK(r.headers.get("transfer-encoding") == "chunked");
+    }
+    {
+        testing::http_server_options options;
+        options.status = 404;
+        testing::http_server server(options);
+        CHECK_THROWS_AS(async_http_get(svc, server.host(), "/", 8s).get(), bad_request_exception);
+    }
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("async http get from loopback unix socket server") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server_options options;
+    options.bodySize = 100000;
+    options.unixSocketPath = "/tmp/srl-test-" + to_string(::getpid()) + ".sock";
+    {
+        testing::http_server server(options);
+        CHECK(server.host() == "unix:" + options.unixSocketPath);
+        auto const r = async_http_get(svc, server.host(), "/", 8s).get();
+        CHECK(r.first == 200);
+        CHECK(r.second.size() == 100000);
+        CHECK(r.second[27] == 'b');
+    }
+    CHECK_THROWS(async_http_get(svc, "unix:" + options.unixSocketPath, "/", 8s).get());
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client with socket options gets from loopback server") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server_options serverOptions;
+    serverOptions.bodySize = 100000;
+    testing::http_server server(serverOptions);
+
+    client_options options;
+    options.socket.receiveBufferSize = 64 * 1024;
+    options.hostSocket[server.host()].noDelay = false;
+    options.hostSocket[server.host()].quickAck = true;
+    client c(svc, options);
+    CHECK(c.socket_options_for(server.host()).quickAck);
+    CHECK(c.socket_options_for("www.boost.org").receiveBufferSize == 64 * 1024);
+
+    auto const r = c.async_http_get(server.host(), "/", 8s).get();
+    CHECK(r.first == 200);
+    CHECK(r.second.size() == 100000);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client hands ready futures to a completion callback") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server server;
+    testing::http_server_options failingOptions;
+    failingOptions.status = 503;
+    testing::http_server failing(failingOptions);
+    client c(svc);
+
+    mutex m;
+    vector<int> statuses;
+    promise<void> allDone;
+    auto const onCompleted = [&](future<response> result) {
+        int status = 0;
+        try {
+            status = result.get().first;
+        }
+        catch (bad_request_exception const & e) {
+            status = e.errorCode;
+        }
+        lock_guard<mutex> lock(m);
+        statuses.push_back(status);
+        if (statuses.size() == 4)
+            allDone.set_value();
+    };
+    for (int i = 0; i < 3; ++i)
+        c.async_http_get(prepared_request(server.host(), "/"), 8s, onCompleted);
+    c.async_http_get(prepared_request(failing.host(), "/"), 8s, onCompleted);
+    allDone.get_future().get();
+    sort(statuses.begin(), statuses.end());
+    CHECK(statuses == vector<int>{200, 200, 200, 503});
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client reuses kept alive loopback connections") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    for (bool chunked : {false, true}) {
+        testing::http_server_options serverOptions;
+        serverOptions.bodySize = 50000;
+        serverOptions.chunked = chunked;
+        testing::http_server server(serverOptions);
+        client c(svc);
+        for (int i = 0; i < 5; ++i) {
+            auto const r = c.async_http_get(server.host(), "/", 8s).get();
+            CHECK(r.second.size() == 50000);
+        }
+        CHECK(server.connections() == 1);
+        CHECK(server.requests() == 5);
+        CHECK(c.pool_stats().requests == 5);
+        CHECK(c.pool_stats().warmHits == 4);
+    }
+    {
+        //Without reuse, as async_http_get does, every request has its own connection
+        testing::http_server server;
+        client_options options;
+        options.reuseConnections = false;
+        client c(svc, options);
+        for (int i = 0; i < 3; ++i)
+            c.async_http_get(server.host(), "/", 8s).get();
+        CHECK(server.connections() == 3);
+        CHECK_THROWS_AS(c.prewarm(server.host(), 1), logic_error);
+    }
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client requests go through prewarmed loopback connections") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server server;
+    client c(svc);
+    c.prewarm(server.host(), 2).get();
+    CHECK(c.pool_stats().idleConnections == 2);
+
+    auto const r = c.async_http_get(server.host(), "/", 8s).get();
+    CHECK(r.first == 200);
+    CHECK(r.timings.connect() < 1ms);
+    CHECK(c.pool_stats().prewarmedHits == 1);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client queues loopback requests over the limit of the host") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server_options serverOptions;
+    serverOptions.latency = 20ms;
+    testing::http_server server(serverOptions);
+    client_options options;
+    options.scheduler.maxInFlightPerHost = 2;
+    client c(svc, options);
+
+    vector<future<response>> responses;
+    for (int i = 0; i < 6; ++i)
+        responses.push_back(c.async_http_get(server.host(), "/", 8s,
+                                             i < 5 ? request_priority::normal : request_priority::high));
+    CHECK(c.queue_stats().queueDepth == 4);
+    for (auto & r : responses)
+        CHECK(r.get().first == 200);
+    //Two requests in flight at most, so two connections are enough for all of them
+    CHECK(server.connections() == 2);
+    auto const stats = c.queue_stats();
+    CHECK(stats.started == 6);
+    CHECK(stats.delayed == 4);
+    CHECK(stats.wait.max() >= 20ms);
+
+    //Time spent in the queue counts against the timeout
+    options.scheduler.maxInFlightPerHost = 1;
+    client limited(svc, options);
+    auto first = limited.async_http_get(server.host(), "/", 8s);
+    auto queued = limited.async_http_get(server.host(), "/", 5ms);
+    CHECK(first.get().first == 200);
+    CHECK_THROWS_AS(queued.get(), timeout_exception);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client lowers the adaptive limit of an overloaded loopback host") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server_options serverOptions;
+    serverOptions.status = 503;
+    testing::http_server server(serverOptions);
+    client_options options;
+    options.scheduler.adaptiveLimit.algorithm = limit_algorithm::aimd;
+    options.scheduler.adaptiveLimit.initialLimit = 10;
+    client c(svc, options);
+
+    for (int i = 0; i < 3; ++i)
+        CHECK_THROWS_AS(c.async_http_get(server.host(), "/", 8s).get(), bad_request_exception);
+    //The limit is updated after the future is ready
+    for (int i = 0; i < 100 && c.queue_stats().inFlight; ++i)
+        this_thread::sleep_for(1ms);
+    CHECK(c.queue_stats().hostLimits.at(server.host()) == 7);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client hedges slow loopback requests within its budget") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    atomic<int> served{0};
+    testing::http_server_options serverOptions;
+    //Requests 1 and 3 stall. Two server threads, so that a stalled one does not block the hedge
+    serverOptions.handler = [&served](string const &) {
+        if (++served % 2)
+            this_thread::sleep_for(300ms);
+        return string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    };
+    testing::http_server server(serverOptions, 2);
+    client_options options;
+    options.hedging.enabled = true;
+    options.hedging.delay = 20ms;
+    options.hedging.budgetRatio = 0;
+    options.hedging.budgetBurst = 1;
+    client c(svc, options);
+
+    //The hedge answers first: a win tells it without timing a loaded machine
+    auto const r = c.async_http_get(server.host(), "/", 8s).get();
+    CHECK(r.second.size() == 2);
+    CHECK(c.hedge_stats().hedges == 1);
+    CHECK(c.hedge_stats().hedgeWins == 1);
+
+    //The budget is spent: the stalled request is not hedged
+    CHECK(c.async_http_get(server.host(), "/", 8s).get().first == 200);
+    CHECK(c.hedge_stats().hedges == 1);
+    CHECK(c.hedge_stats().budgetExhausted == 1);
+    CHECK(served == 3);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client keeps the hedge budget the rate limit refuses") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server_options serverOptions;
+    serverOptions.handler = [](string const & request) {
+        if (request.compare(0, 10, "GET /slow ") == 0)
+            this_thread::sleep_for(500ms);
+        return string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    };
+    testing::http_server server(serverOptions, 4);
+    client_options options;
+    options.hedging.enabled = true;
+    options.hedging.delay = 150ms;
+    options.hedging.budgetRatio = 0;
+    options.hedging.budgetBurst = 1;
+    //A token every 100ms
+    options.rateLimit.perHost = {10, 1};
+    client c(svc, options);
+
+    //The other request takes the token of 100ms: none is left for the hedge at 150ms
+    auto slow = c.async_http_get(server.host(), "/slow", 8s);
+    auto other = c.async_http_get(server.host(), "/", 8s);
+    CHECK(slow.get().first == 200);
+    CHECK(other.get().first == 200);
+    CHECK(c.hedge_stats().hedges == 0);
+    CHECK(c.hedge_stats().budgetExhausted == 1);
+    auto const admitted = c.rate_limit_stats().admitted;
+    CHECK(c.rate_limit_stats().rejected == 0);
+
+    //Alone, the request leaves a token for its hedge, paid by the budget given back
+    CHECK(c.async_http_get(server.host(), "/slow", 8s).get().first == 200);
+    CHECK(c.hedge_stats().hedges == 1);
+    CHECK(c.rate_limit_stats().admitted == admitted + 2);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("retry backoff grows exponentially with full jitter") {
+    retry_options options;
+    options.initialBackoff = 10ms;
+    options.maxBackoff = 50ms;
+    chrono::steady_clock::duration longest{0};
+    for (int i = 0; i < 200; ++i) {
+        CHECK(backoff_delay(options, 0) <= 10ms);
+        CHECK(backoff_delay(options, 2) <= 40ms);
+        auto const capped = backoff_delay(options, 30);
+        CHECK(capped <= 50ms);
+        longest = max(longest, capped);
+    }
+    CHECK(longest > 10ms);
+}
+
+
+TEST_CASE("client retries failed loopback requests within its budget") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    atomic<int> served{0};
+    atomic<int> failures{2};
+    atomic<int> failureStatus{503};
+    testing::http_server_options serverOptions;
+    serverOptions.handler = [&](string const &) {
+        ++served;
+        if (failures-- > 0)
+            return "HTTP/1.1 " + to_string(failureStatus) + " Failed\r\nContent-Length: 0\r\n\r\n";
+        return string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    };
+    testing::http_server server(serverOptions);
+    client_options options;
+    options.retry.maxRetries = 3;
+    options.retry.initialBackoff = 1ms;
+    options.retry.budgetRatio = 0;
+    options.retry.budgetBurst = 3;
+    client c(svc, options);
+
+    CHECK(c.async_http_get(server.host(), "/", 8s).get().second.size() == 2);
+    CHECK(served == 3);
+    CHECK(c.retry_stats().retries == 2);
+    CHECK(c.retry_stats().recovered == 1);
+
+    //Not a retried class of failure
+    failures = 1;
+    failureStatus = 404;
+    CHECK_THROWS_AS(c.async_http_get(server.host(), "/", 8s).get(), bad_request_exception);
+    CHECK(served == 4);
+
+    //One retry left in the budget
+    failures = 3;
+    failureStatus = 429;
+    CHECK_THROWS_AS(c.async_http_get(server.host(), "/", 8s).get(), bad_request_exception);
+    CHECK(served == 6);
+    CHECK(c.retry_stats().retries == 3);
+    CHECK(c.retry_stats().budgetExhausted == 1);
+
+    //A cancel stops the wait before the retry
+    options.retry.initialBackoff = 10s;
+    options.retry.maxBackoff = 10s;
+    options.scheduler.maxInFlightPerHost = 1;
+    client waiting(svc, options);
+    failures = 100;
+    failureStatus = 503;
+    auto const before = served.load();
+    cancellation_token token;
+    auto waited = waiting.async_http_get(server.host(), "/", 30s, token);
+    while (served == before)
+        this_thread::sleep_for(1ms);
+    this_thread::sleep_for(20ms);
+    auto const cancelled = chrono::steady_clock::now();
+    token.cancel();
+    CHECK_THROWS_AS(waited.get(), cancelled_exception);
+    while (waiting.queue_stats().inFlight)
+        this_thread::sleep_for(1ms);
+    CHECK(chrono::steady_clock::now() - cancelled < 1s);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client paces loopback requests at the rate limit of the host") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server server;
+    client_options options;
+    options.rateLimit.perHost = {20, 1};
+    client c(svc, options);
+
+    auto const start = chrono::steady_clock::now();
+    vector<future<response>> responses;
+    for (int i = 0; i < 5; ++i)
+        responses.push_back(c.async_http_get(server.host(), "/", 8s));
+    //Tokens for the sixth request come 200ms later, more than it can wait
+    CHECK_THROWS_AS(c.async_http_get(server.host(), "/", 100ms).get(), timeout_exception);
+    for (auto & r : responses)
+        CHECK(r.get().first == 200);
+    CHECK(chrono::steady_clock::now() - start >= 190ms);
+    auto const stats = c.rate_limit_stats();
+    CHECK(stats.admitted == 5);
+    CHECK(stats.delayed == 4);
+    CHECK(stats.rejected == 1);
+    CHECK(stats.wait.max() >= 190ms);
+    CHECK(server.requests() == 5);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client follows loopback redirects through the same connection") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    string self;
+    testing::http_server_options serverOptions;
+    serverOptions.handler = [&self](string const & request) {
+        auto const redirect = [](int status, string const & location) {
+            return "HTTP/1.1 " + to_string(status) + " Moved\r\nLocation: " + location
+                + "\r\nContent-Length: 0\r\n\r\n";
+        };
+        if (request.compare(0, 13, "GET /dir/old ") == 0)
+            return redirect(301, "new");
+        if (request.find("/old HTTP/1.1\r\n") != string::npos)
+            return redirect(308, "/dir/new");
+        if (request.compare(0, 14, "GET /absolute ") == 0)
+            return redirect(302, "http://" + self + "/dir/new");
+        if (request.compare(0, 10, "GET /loop ") == 0)
+            return redirect(302, "/loop");
+        return string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    };
+    testing::http_server server(serverOptions);
+    self = server.host();
+    client_options options;
+    options.redirect.maxRedirects = 3;
+    client c(svc, options);
+
+    auto r = c.async_http_get(server.host(), "/dir/old", 8s).get();
+    CHECK(r.first == 200);
+    CHECK(string(r.second.begin(), r.second.end()) == "ok");
+    CHECK(server.requests() == 2);
+    CHECK(server.connections() == 1);
+    CHECK(c.redirect_stats().followed == 1);
+    CHECK(c.redirect_stats().cached == 1);
+
+    //The permanent redirect is not asked again
+    CHECK(c.async_http_get(server.host(), "/dir/old", 8s).get().first == 200);
+    CHECK(server.requests() == 3);
+    CHECK(c.redirect_stats().cacheHits == 1);
+
+    CHECK(c.async_http_get(server.host(), "/absolute", 8s).get().first == 200);
+    CHECK(server.requests() == 5);
+    CHECK(c.redirect_stats().cached == 1);
+
+    CHECK_THROWS_AS(c.async_http_get(server.host(), "/loop", 8s).get(), bad_request_exception);
+    CHECK(server.requests() == 9);
+    CHECK(server.connections() == 1);
+
+    options.redirect.maxRedirects = 0;
+    client strict(svc, options);
+    CHECK_THROWS_AS(strict.async_http_get(server.host(), "/dir/old", 8s).get(), bad_request_exception);
+    CHECK(strict.redirect_stats().followed == 0);
+
+    //The redirect used least recently is forgotten first
+    options.redirect.maxRedirects = 3;
+    options.redirect.maxCachedRedirects = 2;
+    client bounded(svc, options);
+    for (auto resource : {"/a/old", "/b/old", "/a/old", "/c/old"})
+        CHECK(bounded.async_http_get(server.host(), resource, 8s).get().first == 200);
+    CHECK(bounded.redirect_stats().cached == 2);
+    CHECK(bounded.redirect_stats().cacheHits == 1);
+    auto const requests = server.requests();
+    CHECK(bounded.async_http_get(server.host(), "/a/old", 8s).get().first == 200);
+    CHECK(server.requests() == requests + 1);
+    CHECK(bounded.async_http_get(server.host(), "/b/old", 8s).get().first == 200);
+    CHECK(server.requests() == requests + 3);
+    CHECK(bounded.redirect_stats().cached == 2);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client cancels loopback requests in flight and queued") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server_options serverOptions;
+    serverOptions.latency = 2s;
+    testing::http_server server(serverOptions, 2);
+    client_options options;
+    options.scheduler.maxInFlightPerHost = 1;
+    client c(svc, options);
+
+    cancellation_token token;
+    auto const start = chrono::steady_clock::now();
+    auto inFlight = c.async_http_get(server.host(), "/", 8s, token);
+    auto queued = c.async_http_get(server.host(), "/", 8s, token);
+    while (!server.requests())
+        this_thread::sleep_for(1ms);
+    CHECK(c.queue_stats().queueDepth == 1);
+    token.cancel();
+    CHECK_THROWS_AS(inFlight.get(), cancelled_exception);
+    CHECK_THROWS_AS(queued.get(), cancelled_exception);
+    CHECK(chrono::steady_clock::now() - start < 1s);
+
+    //Made with a cancelled token: fails without a request
+    CHECK_THROWS_AS(c.async_http_get(server.host(), "/", 8s, token).get(), cancelled_exception);
+    //The socket was closed and the slots given back
+    while (c.queue_stats().inFlight)
+        this_thread::sleep_for(1ms);
+    CHECK(c.pool_stats().idleConnections == 0);
+    CHECK(server.requests() == 1);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client polls a prepared loopback request") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    string lastRequest;
+    testing::http_server_options serverOptions;
+    serverOptions.handler = [&lastRequest](string const & request) {
+        lastRequest = request;
+        return string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    };
+    testing::http_server server(serverOptions);
+    prepared_request const request("http://" + server.host() + "/health?full#ignored");
+    CHECK(request.resource() == "/health?full");
+
+    client_options options;
+    options.reuseConnections = false;
+    client c(svc, options);
+    CHECK(!request.cached_endpoints());
+    for (int i = 0; i < 3; ++i) {
+        auto const r = c.async_http_get(request, 8s).get();
+        CHECK(r.first == 200);
+        CHECK(r.second.size() == 2);
+        CHECK(request.cached_endpoints());
+        CHECK(lastRequest == request.bytes(false));
+    }
+    CHECK(server.connections() == 3);
+
+    client reusing(svc);
+    CHECK(reusing.async_http_get(request, 8s).get().first == 200);
+    CHECK(lastRequest == request.bytes(true));
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client spreads loopback requests among the endpoints of a host") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    mutex mtx;
+    vector<string> requests;
+    testing::http_server_options serverOptions;
+    serverOptions.handler = [&mtx, &requests](string const & request) {
+        lock_guard<mutex> lock(mtx);
+        requests.push_back(request);
+        return string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    };
+    testing::http_server first(serverOptions);
+    testing::http_server second(serverOptions);
+
+    client_options options;
+    options.endpoints["backend"].endpoints = {
+        ip::tcp::endpoint(ip::address_v4::loopback(), first.port()),
+        ip::tcp::endpoint(ip::address_v4::loopback(), second.port())
+    };
+    client c(svc, options);
+    for (int i = 0; i < 4; ++i)
+        CHECK(c.async_http_get("backend", "/", 8s).get().first == 200);
+    CHECK(first.requests() == 2);
+    CHECK(second.requests() == 2);
+    //One connection per endpoint, reused
+    CHECK(first.connections() == 1);
+    CHECK(second.connections() == 1);
+    for (auto const & request : requests)
+        CHECK(request.find("Host: backend\r\n") != string::npos);
+
+    auto const loads = c.endpoint_stats("backend");
+    REQUIRE(loads.size() == 2);
+    CHECK(loads[0].outstanding == 0);
+    CHECK(loads[1].outstanding == 0);
+    CHECK(c.endpoint_stats(first.host()).empty());
+
+    c.prewarm("backend", 4).get();
+    //Accepted by the servers in their own threads
+    for (int i = 0; i < 100 && first.connections() + second.connections() < 4; ++i)
+        this_thread::sleep_for(1ms);
+    CHECK(first.connections() == 2);
+    CHECK(second.connections() == 2);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("client ejects failing loopback endpoints") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server healthy;
+    testing::http_server_options failingOptions;
+    failingOptions.handler = [](string const &) {
+        return string("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n");
+    };
+    testing::http_server failing(failingOptions);
+
+    client_options options;
+    auto & backend = options.endpoints["backend"];
+    backend.endpoints = {
+        ip::tcp::endpoint(ip::address_v4::loopback(), healthy.port()),
+        ip::tcp::endpoint(ip::address_v4::loopback(), failing.port())
+    };
+    backend.ejection.consecutiveErrors = 2;
+    client c(svc, options);
+    for (int i = 0; i < 4; ++i) {
+        try {
+            c.async_http_get("backend", "/", 8s).get();
+        }
+        catch (bad_request_exception const & e) {
+            CHECK(e.errorCode == 503);
+        }
+    }
+    CHECK(failing.requests() == 2);
+    auto const loads = c.endpoint_stats("backend");
+    CHECK(!loads[0].ejected);
+    CHECK(loads[0].latency > chrono::steady_clock::duration::zero());
+    CHECK(loads[1].ejected);
+    CHECK(loads[1].ejections == 1);
+    for (int i = 0; i < 4; ++i)
+        CHECK(c.async_http_get("backend", "/", 8s).get().first == 200);
+    CHECK(healthy.requests() == 6);
+    CHECK(failing.requests() == 2);
+
+    //Hosts that are resolved are balanced among their addresses
+    client_options balancedOptions;
+    balancedOptions.balancing.enabled = true;
+    client balanced(svc, balancedOptions);
+    CHECK(balanced.endpoint_stats(healthy.host()).empty());
+    CHECK(balanced.async_http_get(healthy.host(), "/", 8s).get().first == 200);
+    REQUIRE(balanced.endpoint_stats(healthy.host()).size() == 1);
+    CHECK(balanced.endpoint_stats(healthy.host())[0].outstanding == 0);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("async http get timeouts with slow loopback server") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server_options options;
+    options.latency = 200ms;
+    testing::http_server server(options);
+    CHECK_THROWS_AS(async_http_get(svc, server.host(), "/", 50ms).get(), timeout_exception);
+    CHECK(async_http_get(svc, server.host(), "/", 8s).get().first == 200);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("async http get times out on a loopback server that stops answering") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    //Accepts the request and stays silent
+    testing::http_server_options silentOptions;
+    silentOptions.latency = 30s;
+    testing::http_server silent(silentOptions);
+    auto start = chrono::steady_clock::now();
+    CHECK_THROWS_AS(async_http_get(svc, silent.host(), "/", 100ms).get(), timeout_exception);
+    CHECK(chrono::steady_clock::now() - start < 5s);
+
+    //Stalls in the middle of the body of a kept alive connection
+    testing::http_server_options stalledOptions;
+    stalledOptions.handler = [](string const &) {
+        return string("HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\nfirst bytes");
+    };
+    testing::http_server stalled(stalledOptions);
+    client_options options;
+    options.retry.maxRetries = 1;
+    options.retry.attemptTimeout = 100ms;
+    options.retry.initialBackoff = 1ms;
+    options.retry.retryOn |= retry_on_timeout;
+    client c(svc, options);
+    start = chrono::steady_clock::now();
+    CHECK_THROWS_AS(c.async_http_get(stalled.host(), "/", 20s).get(), timeout_exception);
+    CHECK(chrono::steady_clock::now() - start < 5s);
+    CHECK(c.retry_stats().retries == 1);
+    svc.stop();
+    t.join();
+}
+
+
+TEST_CASE("async http get coalesced shares in flight loopback request") {
+    net::io_service svc;
+    net::io_service::work wk{svc};
+    thread t([&svc] { svc.run(); });
+    testing::http_server_options options;
+    options.bodySize = 1000;
+    options.latency = 100ms;
+    testing::http_server server(options);
+    auto first = async_http_get_coalesced(svc, server.host(), "/", 8s);
+    auto second = async_http_get_coalesced(svc, server.host(), "/", 8s);
+    auto other = async_http_get_coalesced(svc, server.host(), "/other", 8s);
+    CHECK(first.get().second == second.get().second);
+    CHECK(first.get().second != other.get().second);
+    CHECK(first.get().second->size() == 1000);
+    CHECK(server.requests() == 2);
+    svc.stop();
+    t.join();
+}
+
 
 } //namespace srl
 
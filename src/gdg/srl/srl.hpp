@@ -2,8 +2,25 @@
 #define GDG_SRL_HPP_
 
 #include "gdg/srl/alias.hpp"
+#include "gdg/srl/cancellation.hpp"
+#include "gdg/srl/connection_pool.hpp"
+#include "gdg/srl/endpoint_set.hpp"
+#include "gdg/srl/prepared_request.hpp"
+#include "gdg/srl/rate_limiter.hpp"
+#include "gdg/srl/request.hpp"
+#include "gdg/srl/response_body.hpp"
+#include "gdg/srl/response_headers.hpp"
+#include "gdg/srl/scheduler.hpp"
+#include "gdg/srl/socket_options.hpp"
+#include "gdg/srl/timings.hpp"
+#include <cstdint>
+#include <functional>
 #include <future>
+#include <map>
+#include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
 namespace gdg {
 
@@ -16,6 +33,23 @@ namespace srl {
 net::io_service & get_default_loop();
 
 
+/** Result of \ref async_http_get: status code in first, body in second. Small bodies
+    are kept inside the response, see \ref response_body.
+
+    second was a std::vector<byte_t>. Code that kept it as a vector moves it out with
+    std::move(r.second), or r.second.release(), without copying a large body.
+
+    timings holds the duration of each phase of the request, and headers its
+    header fields, as ETag, Content-Type or Cache-Control.
+ */
+struct response : std::pair<int, response_body> {
+    using std::pair<int, response_body>::pair;
+
+    request_timings timings;
+    response_headers headers;
+};
+
+
 /** Gets a resource from a given host through http asynchronously in a given loop.
 
     @host[in] the host machine. No effort will be done to remove trailing slashes
@@ -24,11 +58,19 @@ net::io_service & get_default_loop();
     @io the default io_service in which to run the async call. Default is get_default_loop()
 
     Currently the library is just successful when a 200 error code is returned.
-    Any other return code will result in an exception.
+    Redirects are followed as set by \ref redirect_options. Any other return code
+    will result in an exception.
+
+    The phase timings of every successful request are added to the latency
+    stats of its host, see \ref snapshot_latency_stats.
 
-    @return a future with a pair status code, vector of byte_t containing the response body
+    The request is made by a \ref client with default options, except that the
+    connection is not reused: the server is asked to close it after the response.
+
+    @return a future with a response: status code, response body
+    phase timings and headers
  */
-std::future<std::pair<int, std::vector<byte_t>>>
+std::future<response>
 async_http_get(net::io_service & io,
                string_view_t host,
                string_view_t resource = "/",
@@ -38,12 +80,466 @@ async_http_get(net::io_service & io,
 /**
  * @overload
 */
-std::future<std::pair<int, std::vector<byte_t>>>
+std::future<response>
 async_http_get(string_view_t host,
                string_view_t resource = "/",
                std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30));
 
 
+/** Hedging of the requests of a \ref client: if a request gets no response in
+    some time, a copy of it is sent and the first response wins.
+
+    Only for idempotent requests to replicated hosts, since the host may receive
+    the same request twice.
+ */
+struct hedging_options {
+    bool enabled = false;
+    /** Time without response after which the copy is sent. Zero to take it from percentile */
+    std::chrono::steady_clock::duration delay = std::chrono::steady_clock::duration::zero();
+    /** Percentile of the latency of the host (see \ref total_latency_percentile) used as delay */
+    double percentile = 95;
+    /** Successful requests to the host recorded before percentile is trusted.
+        Until then no copy is sent */
+    std::uint64_t minSamples = 20;
+    /** Copies allowed per request over time, which bounds the extra load */
+    double budgetRatio = 0.05;
+    /** Copies allowed in a burst */
+    double budgetBurst = 10;
+};
+
+
+/** Hedges sent by a \ref client
+ */
+struct hedging_stats {
+    /** Copies of requests sent */
+    std::uint64_t hedges = 0;
+    /** Of hedges, those that answered before the original request */
+    std::uint64_t hedgeWins = 0;
+    /** Copies not sent because the budget was spent, or the rate limit had no token for them */
+    std::uint64_t budgetExhausted = 0;
+};
+
+
+/** Failures after which a request may be retried. Combine them with |
+ */
+enum retry_on : unsigned {
+    /** Connection refused, reset or closed before the response, except unknown hosts */
+    retry_on_connection_error = 1,
+    retry_on_timeout = 2,
+    /** 429 and 503 responses */
+    retry_on_overload = 4,
+    /** 5xx responses other than 503 */
+    retry_on_server_error = 8
+};
+
+
+/** Retries of the requests of a \ref client. Only for idempotent requests.
+
+    The wait before retry n (from 0) is random between zero and
+    min(maxBackoff, initialBackoff * multiplier^n) ("full jitter"), so that
+    clients failing at once do not retry at once. Waits run in the event loop.
+ */
+struct retry_options {
+    /** Retries after the first attempt. Zero disables retries */
+    unsigned maxRetries = 0;
+    /** Failures retried, see \ref retry_on */
+    unsigned retryOn = retry_on_connection_error | retry_on_overload;
+    std::chrono::steady_clock::duration initialBackoff = std::chrono::milliseconds(50);
+    std::chrono::steady_clock::duration maxBackoff = std::chrono::seconds(5);
+    double multiplier = 2;
+    /** Timeout of each attempt. Zero to give each attempt what remains of the request timeout.
+        Set it below the request timeout for timeouts to be retried */
+    std::chrono::steady_clock::duration attemptTimeout = std::chrono::steady_clock::duration::zero();
+    /** Retries allowed per request over time, which caps the retry amplification */
+    double budgetRatio = 0.1;
+    /** Retries allowed in a burst */
+    double budgetBurst = 10;
+};
+
+
+/** Retries made by a \ref client
+ */
+struct retrying_stats {
+    std::uint64_t retries = 0;
+    /** Requests that succeeded after a retry */
+    std::uint64_t recovered = 0;
+    /** Failures not retried because the budget was spent */
+    std::uint64_t budgetExhausted = 0;
+};
+
+
+/** Redirects followed by a \ref client.
+
+    Every hop is a GET, and goes through a pooled connection to its host, so
+    hops within a host take the connection of the previous one.
+ */
+struct redirect_options {
+    /** Hops followed before the redirect fails with bad_request_exception. Zero
+        makes redirects fail at once, as any status other than 200 */
+    unsigned maxRedirects = 5;
+    /** Remember the targets of 301 and 308 responses and go straight to them */
+    bool cachePermanent = true;
+    /** Permanent redirects remembered. When it is full, the one used least recently is forgotten */
+    std::size_t maxCachedRedirects = 1024;
+};
+
+
+/** Redirects followed by a \ref client
+ */
+struct redirecting_stats {
+    /** Hops made after a redirect response */
+    std::uint64_t followed = 0;
+    /** Hops skipped thanks to a permanent redirect remembered */
+    std::uint64_t cacheHits = 0;
+    /** Permanent redirects remembered now */
+    std::uint64_t cached = 0;
+};
+
+
+/** Client side load balancing of the hosts a \ref client resolves
+ */
+struct balancing_options {
+    /** Spread the requests to each host not in client_options::endpoints among the
+        addresses it resolves to, instead of connecting to the first one that answers */
+    bool enabled = false;
+    /** Policy, outlier ejection and slow start of every host. Its endpoints are not used */
+    endpoint_options endpoints;
+    /** Time the addresses of a host are used before it is resolved again */
+    std::chrono::steady_clock::duration resolveTtl = std::chrono::seconds(30);
+};
+
+
+/** Options of a \ref client
+ */
+struct client_options {
+    /** Socket options of every connection */
+    socket_options socket;
+    /** Socket options of the connections to each host, used instead of socket */
+    std::map<std::string, socket_options> hostSocket;
+    /** Keep connections open after each response and use them again for later
+        requests to the same host */
+    bool reuseConnections = true;
+    /** Idle connections and pre-warming, when connections are reused */
+    connection_pool_options pool;
+    /** Limits of requests in flight, and queueing of the requests over them */
+    scheduler_options scheduler;
+    /** Copies of slow requests */
+    hedging_options hedging;
+    /** Retries of failed requests */
+    retry_options retry;
+    /** Requests per second per host and overall. Requests over them wait for their turn */
+    rate_limiter_options rateLimit;
+    /** Redirects followed */
+    redirect_options redirect;
+    /** Endpoints of hosts that are not resolved, and how requests to each host are spread
+        among them. Connections are pooled per endpoint, the Host header stays the host */
+    std::map<std::string, endpoint_options> endpoints;
+    /** Balancing of the other hosts among their addresses. Their connections are
+        pooled per address too */
+    balancing_options balancing;
+};
+
+
+/** Makes requests in an event loop with a set of options.
+
+    The options are copied by each request when it starts, so a request
+    does not need the client to stay alive. Copies of a client share its
+    connection pool. The hosts in options.pool.warmConnections are pre-warmed
+    when the client is created.
+
+    Copies of a client also share its \ref request_scheduler, so that the limits
+    in options.scheduler hold for all the requests made through them, and its
+    hedging and retry budgets and its rate limits. Hedges and retries are not
+    counted by the scheduler: they run within the slot of their request.
+ */
+class client {
+public:
+    explicit client(net::io_service & io, client_options options = {});
+
+    /** Client in the default loop, see \ref get_default_loop */
+    explicit client(client_options options = {});
+
+    /** Gets a resource like \ref async_http_get, with the options of this client.
+
+        Requests first wait for the tokens of options().rateLimit, on a timer of
+        the loop, and fail with timeout_exception at once if they would wait past
+        timeOut. Then requests over the limits of options().scheduler wait in a
+        queue of their priority class. The time waited counts against timeOut.
+        Retries take tokens too, and hedges are only sent if their tokens are there.
+
+        Redirects are followed within the same timeOut, retries and hedges apply to
+        each hop. The limits, socket options and stats of the original host are the
+        ones that apply to every hop.
+     */
+    std::future<response>
+    async_http_get(string_view_t host,
+                   string_view_t resource = "/",
+                   std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30),
+                   request_priority priority = request_priority::normal);
+
+    /** Gets a resource like the overload above, unless cancellation is cancelled first.
+
+        On cancel the future fails with cancelled_exception right away, whether the
+        request is in flight or waits for its turn. The sockets of a request in flight
+        are closed in the loop, and a request that waits gives up its turn when it gets it.
+     */
+    std::future<response>
+    async_http_get(string_view_t host,
+                   string_view_t resource,
+                   std::chrono::steady_clock::duration timeOut,
+                   cancellation_token const & cancellation,
+                   request_priority priority = request_priority::normal);
+
+    /** Gets a prepared request like \ref async_http_get. The request bytes and, while they
+        are fresh, the endpoints of the host are taken from request instead of built again.
+     */
+    std::future<response>
+    async_http_get(prepared_request const & request,
+                   std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30),
+                   request_priority priority = request_priority::normal);
+
+    /** Gets a prepared request until cancellation is cancelled, see the overloads above
+     */
+    std::future<response>
+    async_http_get(prepared_request const & request,
+                   std::chrono::steady_clock::duration timeOut,
+                   cancellation_token const & cancellation,
+                   request_priority priority = request_priority::normal);
+
+    /** Gets a prepared request like \ref async_http_get, and hands its future, once ready,
+        to onCompleted instead of returning it. onCompleted runs in a thread of the loop and
+        should not block it: it is for callers that keep many requests in flight without a
+        thread waiting on each, as load generators
+     */
+    void async_http_get(prepared_request const & request,
+                        std::chrono::steady_clock::duration timeOut,
+                        std::function<void(std::future<response>)> onCompleted,
+                        request_priority priority = request_priority::normal);
+
+    /** Socket options of the connections to host
+     */
+    socket_options const & socket_options_for(std::string const & host) const;
+
+    /** Opens connections to host, and keeps that many ready from then on.
+        Throws std::logic_error if the client does not reuse connections.
+        If host has endpoints in options().endpoints, the connections are spread among them.
+
+        @return a future ready once the connections are established or failed
+     */
+    std::future<void> prewarm(std::string const & host, std::size_t connections);
+
+    /** How requests found their connections. All zeros if connections are not reused
+     */
+    connection_pool_stats pool_stats() const;
+
+    /** Queue depth and wait times. All zeros if options().scheduler sets no limit
+     */
+    scheduler_stats queue_stats() const;
+
+    /** Hedges sent. All zeros if options().hedging is not enabled
+     */
+    hedging_stats hedge_stats() const;
+
+    /** Retries made. All zeros if options().retry.maxRetries is zero
+     */
+    retrying_stats retry_stats() const;
+
+    /** Tokens left and waits for them. All zeros if options().rateLimit sets no limit
+     */
+    rate_limiter_stats rate_limit_stats() const;
+
+    /** Redirects followed. All zeros if options().redirect.maxRedirects is zero
+     */
+    redirecting_stats redirect_stats() const;
+
+    /** Requests outstanding to each endpoint of host, with its latency and health.
+        Empty if host has no endpoints in options().endpoints and was not balanced
+        through options().balancing
+     */
+    std::vector<endpoint_load> endpoint_stats(std::string const & host) const;
+
+    net::io_service & io() const { return *io_; }
+
+    client_options const & options() const { return options_; }
+
+private:
+    std::future<response> start_get(string_view_t host,
+                                    string_view_t resource,
+                                    std::chrono::steady_clock::duration timeOut,
+                                    request_priority priority,
+                                    cancellation_token const * cancellation,
+                                    std::shared_ptr<prepared_request const> prepared,
+                                    std::function<void(std::future<response>)> onCompleted = nullptr);
+
+    std::future<void> prewarm_pool(std::string const & host, std::size_t connections);
+
+    std::shared_ptr<endpoint_set> endpoint_set_of(std::string const & host) const;
+
+    net::io_service * io_;
+    client_options options_;
+    std::shared_ptr<connection_pool> pool_;
+    std::shared_ptr<request_scheduler> scheduler_;
+    struct hedging_state;
+    std::shared_ptr<hedging_state> hedging_;
+    struct retry_state;
+    std::shared_ptr<retry_state> retry_;
+    std::shared_ptr<rate_limiter> rateLimiter_;
+    struct redirect_state;
+    std::shared_ptr<redirect_state> redirect_;
+    using endpoint_sets = std::map<std::string, std::shared_ptr<endpoint_set>>;
+    std::shared_ptr<endpoint_sets const> endpoints_;
+    std::shared_ptr<resolved_endpoints> balancing_;
+};
+
+
+/** Immutable response body, shared by every caller of a coalesced request.
+ */
+using shared_body = std::shared_ptr<std::vector<byte_t> const>;
+
+
+/** Gets a resource like \ref async_http_get, coalescing identical requests in flight.
+
+    @host[in] the host machine. No effort will be done to remove trailing slashes
+    @resource[in] the resource
+    @timeOut[in] max timeout. Default is 30s
+    @io the default io_service in which to run the async call. Default is get_default_loop()
+
+    If a GET for the same host and resource is already in flight in io, the call
+    does not open a new connection: it attaches to that request and shares its result.
+    The timeout of the request that started the download is the one that applies.
+    Once the request completes, later calls start a new download.
+
+    @return a shared future with a pair status code, body shared between all attached callers
+ */
+std::shared_future<std::pair<int, shared_body>>
+async_http_get_coalesced(net::io_service & io,
+                         string_view_t host,
+                         string_view_t resource = "/",
+                         std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30));
+
+
+/**
+ * @overload
+*/
+std::shared_future<std::pair<int, shared_body>>
+async_http_get_coalesced(string_view_t host,
+                         string_view_t resource = "/",
+                         std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30));
+
+
+/** Tuning of \ref async_http_get_ranged
+ */
+struct ranged_download_options {
+    /** Bytes requested in each range request */
+    std::size_t segmentSize = 1024 * 1024;
+    /** Connections downloading segments at the same time */
+    std::size_t parallelism = 4;
+    /** Times a failed segment is requested again before the download fails */
+    int maxSegmentRetries = 2;
+};
+
+
+/** Gets a resource splitting it in byte ranges downloaded in parallel.
+
+    @host[in] the host machine. No effort will be done to remove trailing slashes
+    @resource[in] the resource
+    @options[in] segment size, parallelism and retries
+    @timeOut[in] max timeout of each range request. Default is 30s
+    @io the default io_service in which to run the async call. Default is get_default_loop()
+
+    The first segment is requested with a ranged GET. If the server answers 206
+    the total size is taken from Content-Range and the rest of segments are
+    fetched through up to options.parallelism keep-alive connections, written
+    straight into a single preallocated body. If the server ignores the range
+    and answers 200, the body is read from that response as \ref async_http_get does.
+
+    @return a future with a pair status code (200 on success), vector of byte_t containing the whole body
+ */
+std::future<std::pair<int, std::vector<byte_t>>>
+async_http_get_ranged(net::io_service & io,
+                      string_view_t host,
+                      string_view_t resource = "/",
+                      ranged_download_options options = {},
+                      std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30));
+
+
+/**
+ * @overload
+*/
+std::future<std::pair<int, std::vector<byte_t>>>
+async_http_get_ranged(string_view_t host,
+                      string_view_t resource = "/",
+                      ranged_download_options options = {},
+                      std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30));
+
+
+/** Gets a resource and stores its body in a file, without holding it in memory.
+
+    @host[in] the host machine. No effort will be done to remove trailing slashes
+    @resource[in] the resource
+    @path[in] the file to write. It is created if it does not exist
+    @resume[in] if true and the file is not empty, only the bytes past its end are
+    requested. If the server does not honor the range, the file is rewritten from the start
+    @timeOut[in] max timeout. Default is 30s
+    @io the default io_service in which to run the async call. Default is get_default_loop()
+
+    On Linux fixed length bodies are moved from the socket to the file with splice
+    and their blocks are reserved with fallocate. Chunked bodies are written as
+    the chunks are parsed.
+
+    @return a future with a pair status code (200 on success), size of the file
+ */
+std::future<std::pair<int, std::size_t>>
+async_http_get_to_file(net::io_service & io,
+                       string_view_t host,
+                       string_view_t resource,
+                       string_view_t path,
+                       bool resume = false,
+                       std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30));
+
+
+/**
+ * @overload
+*/
+std::future<std::pair<int, std::size_t>>
+async_http_get_to_file(string_view_t host,
+                       string_view_t resource,
+                       string_view_t path,
+                       bool resume = false,
+                       std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30));
+
+
+/** Sends a request with any method and body, and reads its response.
+
+    @request[in] method, target, headers and body
+    @timeOut[in] max timeout. Default is 30s
+    @io the default io_service in which to run the async call. Default is get_default_loop()
+
+    The request goes in a connection of its own. Its body is streamed as it is sent,
+    never held whole in memory unless it was given so: buffers are sent with a gather
+    write together with the head, files with sendfile on Linux and generated bodies
+    with chunked transfer-encoding.
+
+    With request.expectContinue, a server that answers a final status instead of
+    100 Continue does not get the body.
+
+    @return a future with the response. It fails with bad_request_exception if the
+    status is not 2xx
+ */
+std::future<response>
+async_http_request(net::io_service & io,
+                   http_request request,
+                   std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30));
+
+
+/**
+ * @overload
+*/
+std::future<response>
+async_http_request(http_request request,
+                   std::chrono::steady_clock::duration timeOut = std::chrono::seconds(30));
+
+
 
 } //ns srl
 
@@ -0,0 +1,300 @@
+#ifndef GDG_SRL_TESTING_HTTP_SERVER_HPP_
+#define GDG_SRL_TESTING_HTTP_SERVER_HPP_
+
+#include "gdg/srl/alias.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <pthread.h>
+#include <time.h>
+#endif
+
+namespace gdg {
+
+namespace srl {
+
+namespace testing {
+
+/** Responses served by \ref http_server
+ */
+struct http_server_options {
+    int status = 200;
+    /** Size of the body of every response */
+    std::size_t bodySize = 0;
+    /** Send the body with chunked transfer-encoding instead of Content-Length */
+    bool chunked = false;
+    std::size_t chunkSize = 16 * 1024;
+    /** Time waited before answering each request */
+    std::chrono::microseconds latency{0};
+    /** If false, the connection is closed after each response */
+    bool keepAlive = true;
+    /** If set, builds the whole raw response to each request (head and body),
+        replacing the canned response described by the options above */
+    std::function<std::string(std::string const & request)> handler;
+    /** If set, the server listens in a Unix domain socket at this path instead of loopback TCP */
+    std::string unixSocketPath;
+    /** Answer to Expect: 100-continue: 100 to take the body, a final status to refuse it
+        and close the connection, or zero to ignore the expectation */
+    int continueStatus = 100;
+};
+
+
+/** Response to request with body, as a handler of \ref http_server that serves ranges:
+    206 with the bytes of a single "Range: bytes=first-last" or "Range: bytes=first-" header,
+    416 if the range starts past the body, and 200 with all of it without a Range header
+ */
+inline std::string range_response(std::string const & body, std::string const & request) {
+    std::string lowered(request);
+    std::transform(lowered.begin(), lowered.end(), lowered.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    auto const rangePos = lowered.find("\r\nrange: bytes=");
+    unsigned long long first = 0;
+    unsigned long long last = ULLONG_MAX;
+    int const parsed = rangePos == std::string::npos
+        ? 0 : std::sscanf(lowered.c_str() + rangePos + 15, "%llu-%llu", &first, &last);
+    if (parsed < 1 || first > last)
+        return "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Length: "
+            + std::to_string(body.size()) + "\r\n\r\n" + body;
+    if (first >= body.size())
+        return "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */"
+            + std::to_string(body.size()) + "\r\nContent-Length: 0\r\n\r\n";
+    last = std::min<unsigned long long>(last, body.size() - 1);
+    return "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) + "-"
+        + std::to_string(last) + "/" + std::to_string(body.size()) + "\r\nContent-Length: "
+        + std::to_string(last - first + 1) + "\r\n\r\n" + body.substr(first, last - first + 1);
+}
+
+
+/** True in the threads that run an \ref http_server
+ */
+inline bool & is_server_thread() {
+    thread_local bool serverThread = false;
+    return serverThread;
+}
+
+
+/** In-process HTTP/1.1 server listening in a loopback ephemeral port, or in a Unix domain
+    socket, for tests and benchmarks.
+ */
+class http_server {
+public:
+    explicit http_server(http_server_options options = {}, std::size_t threads = 1)
+        : options_(std::move(options)),
+          work_(io_),
+          acceptor_(io_, listen_endpoint(options_)) {
+        keepAliveResponse_ = canned_response(false);
+        closeResponse_ = canned_response(true);
+        net::spawn(io_, [this](net::yield_context yield) { accept_loop(yield); });
+        for (std::size_t i = 0; i < threads; ++i)
+            threads_.emplace_back([this] {
+                    is_server_thread() = true;
+                    io_.run();
+                });
+    }
+
+    http_server(http_server const &) = delete;
+    http_server & operator=(http_server const &) = delete;
+
+    ~http_server() {
+        io_.stop();
+        for (auto & t : threads_)
+            t.join();
+        if (!options_.unixSocketPath.empty())
+            ::unlink(options_.unixSocketPath.c_str());
+    }
+
+    /** Listening port. Zero when listening in a Unix domain socket */
+    unsigned short port() const {
+        if (!options_.unixSocketPath.empty())
+            return 0;
+        auto const endpoint = acceptor_.local_endpoint();
+        return ntohs(reinterpret_cast<sockaddr_in const *>(endpoint.data())->sin_port);
+    }
+
+    /** host:port, or unix:path, to pass as host to the library */
+    std::string host() const {
+        if (!options_.unixSocketPath.empty())
+            return "unix:" + options_.unixSocketPath;
+        return "127.0.0.1:" + std::to_string(port());
+    }
+
+    std::size_t connections() const { return connections_; }
+
+    std::size_t requests() const { return requests_; }
+
+    /** CPU time consumed by the server threads. Zero where it cannot be measured.
+     */
+    std::chrono::nanoseconds cpu_time() {
+        std::chrono::nanoseconds total{0};
+#if defined(__linux__)
+        for (auto & t : threads_) {
+            clockid_t clock;
+            timespec ts;
+            if (pthread_getcpuclockid(t.native_handle(), &clock) == 0
+                && clock_gettime(clock, &ts) == 0)
+                total += std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+        }
+#endif
+        return total;
+    }
+
+private:
+    using protocol = net::generic::stream_protocol;
+
+    static protocol::endpoint listen_endpoint(http_server_options const & options) {
+        if (options.unixSocketPath.empty())
+            return ip::tcp::endpoint(ip::address_v4::loopback(), 0);
+        //A socket file left by a previous run would make bind fail
+        ::unlink(options.unixSocketPath.c_str());
+        return net::local::stream_protocol::endpoint(options.unixSocketPath);
+    }
+
+    std::string canned_response(bool close) const {
+        std::string body(options_.bodySize, '\0');
+        for (std::size_t i = 0; i < body.size(); ++i)
+            body[i] = static_cast<char>('a' + i % 26);
+        std::string response =
+            "HTTP/1.1 " + std::to_string(options_.status) + " Canned\r\nServer: srl-test\r\n";
+        if (close)
+            response += "Connection: close\r\n";
+        if (!options_.chunked)
+            return response + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+        response += "Transfer-Encoding: chunked\r\n\r\n";
+        for (std::size_t offset = 0; offset < body.size(); offset += options_.chunkSize) {
+            auto const size = std::min(options_.chunkSize, body.size() - offset);
+            char chunkSize[32];
+            std::snprintf(chunkSize, sizeof(chunkSize), "%zx\r\n", size);
+            response += chunkSize + body.substr(offset, size) + "\r\n";
+        }
+        return response + "0\r\n\r\n";
+    }
+
+    void accept_loop(net::yield_context yield) {
+        for (;;) {
+            auto socket = std::make_shared<protocol::socket>(io_);
+            boost::system::error_code ec;
+            acceptor_.async_accept(*socket, yield[ec]);
+            if (ec)
+                return;
+            ++connections_;
+            net::spawn(io_, [this, socket](net::yield_context yield) { serve(*socket, yield); });
+        }
+    }
+
+    void serve(protocol::socket & socket, net::yield_context yield) {
+        net::streambuf buf;
+        boost::system::error_code ec;
+        for (;;) {
+            auto const headSize = net::async_read_until(socket, buf, "\r\n\r\n", yield[ec]);
+            if (ec)
+                return;
+            std::string request(net::buffers_begin(buf.data()),
+                                net::buffers_begin(buf.data()) + headSize);
+            buf.consume(headSize);
+            std::string lowered(request);
+            std::transform(lowered.begin(), lowered.end(), lowered.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+
+            if (options_.continueStatus
+                && lowered.find("\r\nexpect: 100-continue\r\n") != std::string::npos) {
+                if (options_.continueStatus != 100) {
+                    auto const refusal = "HTTP/1.1 " + std::to_string(options_.continueStatus)
+                        + " Refused\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+                    net::async_write(socket, net::buffer(refusal), yield[ec]);
+                    socket.shutdown(net::socket_base::shutdown_both, ec);
+                    return;
+                }
+                net::async_write(socket, net::buffer("HTTP/1.1 100 Continue\r\n\r\n", 25), yield[ec]);
+                if (ec)
+                    return;
+            }
+
+            //Request body, if any, is appended to the request given to the handler
+            auto const lengthPos = lowered.find("\r\ncontent-length:");
+            if (lowered.find("\r\ntransfer-encoding: chunked\r\n") != std::string::npos) {
+                //Decoded, chunk by chunk
+                for (;;) {
+                    auto const lineSize = net::async_read_until(socket, buf, "\r\n", yield[ec]);
+                    if (ec)
+                        return;
+                    auto const size = std::stoul(std::string(net::buffers_begin(buf.data()),
+                                                             net::buffers_begin(buf.data()) + lineSize),
+                                                 nullptr, 16);
+                    buf.consume(lineSize);
+                    if (buf.size() < size + 2)
+                        net::async_read(socket, buf, net::transfer_exactly(size + 2 - buf.size()),
+                                        yield[ec]);
+                    if (ec)
+                        return;
+                    request.append(net::buffers_begin(buf.data()), net::buffers_begin(buf.data()) + size);
+                    buf.consume(size + 2);
+                    if (!size)
+                        break;
+                }
+            }
+            else if (lengthPos != std::string::npos) {
+                auto const length = std::stoul(lowered.substr(lengthPos + 17));
+                if (buf.size() < length)
+                    net::async_read(socket, buf, net::transfer_exactly(length - buf.size()),
+                                    yield[ec]);
+                if (ec)
+                    return;
+                request.append(net::buffers_begin(buf.data()),
+                               net::buffers_begin(buf.data()) + length);
+                buf.consume(length);
+            }
+            ++requests_;
+
+            if (options_.latency.count()) {
+                net::steady_timer timer(io_);
+                timer.expires_from_now(options_.latency);
+                timer.async_wait(yield[ec]);
+            }
+            bool const close = !options_.keepAlive
+                || lowered.find("\r\nconnection: close") != std::string::npos;
+            if (options_.handler) {
+                auto const response = options_.handler(request);
+                net::async_write(socket, net::buffer(response), yield[ec]);
+            }
+            else {
+                net::async_write(socket, net::buffer(close ? closeResponse_ : keepAliveResponse_),
+                                 yield[ec]);
+            }
+            if (ec || close) {
+                socket.shutdown(net::socket_base::shutdown_both, ec);
+                return;
+            }
+        }
+    }
+
+    http_server_options const options_;
+    std::string keepAliveResponse_;
+    std::string closeResponse_;
+    net::io_service io_;
+    net::io_service::work work_;
+    net::basic_socket_acceptor<protocol> acceptor_;
+    std::atomic<std::size_t> connections_{0};
+    std::atomic<std::size_t> requests_{0};
+    std::vector<std::thread> threads_;
+};
+
+} //ns testing
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef GDG_SRL_TESTING_TEMP_FILE_HPP_
+#define GDG_SRL_TESTING_TEMP_FILE_HPP_
+
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+
+namespace gdg {
+
+namespace srl {
+
+namespace testing {
+
+/** Empty file with a unique name in the temporary directory ($TMPDIR, or /tmp), for tests.
+    It is removed when destroyed, whatever the test left in it
+ */
+class temp_file {
+public:
+    explicit temp_file(std::string const & prefix = "srl_test_") {
+        char const * dir = std::getenv("TMPDIR");
+        path_ = std::string(dir && *dir ? dir : "/tmp") + "/" + prefix + "XXXXXX";
+        auto const fd = ::mkstemp(&path_[0]);
+        if (fd == -1)
+            throw std::system_error(errno, std::generic_category(), "mkstemp");
+        ::close(fd);
+    }
+
+    temp_file(temp_file const &) = delete;
+    temp_file & operator=(temp_file const &) = delete;
+
+    ~temp_file() {
+        ::unlink(path_.c_str());
+    }
+
+    std::string const & path() const { return path_; }
+
+private:
+    std::string path_;
+};
+
+} //ns testing
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
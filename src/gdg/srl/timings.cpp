@@ -0,0 +1,298 @@
+#include "gdg/srl/timings.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+namespace {
+
+//Values below 2^subBucketBits have a bucket each. Above that, every power of two
+//is split in halfSubBuckets buckets of the same width.
+unsigned constexpr subBucketBits = 7;
+uint64_t constexpr subBuckets = uint64_t{1} << subBucketBits;
+uint64_t constexpr halfSubBuckets = subBuckets / 2;
+unsigned constexpr maxValueBits = 43;
+uint64_t constexpr maxTrackableValue = (uint64_t{1} << maxValueBits) - 1;
+size_t constexpr bucketCount = subBuckets + (maxValueBits - subBucketBits) * halfSubBuckets;
+
+
+unsigned most_significant_bit(uint64_t value) {
+    unsigned msb = 0;
+    while (value >>= 1)
+        ++msb;
+    return msb;
+}
+
+
+size_t bucket_index(uint64_t value) {
+    value = min(value, maxTrackableValue);
+    if (value < subBuckets)
+        return value;
+    auto const shift = most_significant_bit(value) - (subBucketBits - 1);
+    return subBuckets + (shift - 1) * halfSubBuckets + ((value >> shift) - halfSubBuckets);
+}
+
+
+//Largest value that falls in the bucket
+uint64_t bucket_highest_value(size_t index) {
+    if (index < subBuckets)
+        return index;
+    auto const offset = index - subBuckets;
+    auto const shift = offset / halfSubBuckets + 1;
+    auto const lowest = (offset % halfSubBuckets + halfSubBuckets) << shift;
+    return lowest + (uint64_t{1} << shift) - 1;
+}
+
+
+TEST_CASE("latency histogram buckets") {
+    CHECK(bucket_index(0) == 0);
+    CHECK(bucket_index(127) == 127);
+    CHECK(bucket_index(128) == 128);
+    CHECK(bucket_index(129) == 128);
+    CHECK(bucket_index(255) == 191);
+    CHECK(bucket_index(256) == 192);
+    CHECK(bucket_index(maxTrackableValue) == bucketCount - 1);
+    CHECK(bucket_index(maxTrackableValue + 1000) == bucketCount - 1);
+
+    for (uint64_t value : {uint64_t{0}, uint64_t{127}, uint64_t{128}, uint64_t{1000},
+                           uint64_t{123456789}, maxTrackableValue}) {
+        auto const index = bucket_index(value);
+        CHECK(bucket_highest_value(index) >= value);
+        CHECK(bucket_index(bucket_highest_value(index)) == index);
+        CHECK(bucket_highest_value(index) - value <= value / halfSubBuckets);
+    }
+}
+
+
+struct latency_registry {
+    mutex mtx;
+    map<string, host_latency_stats> hosts;
+};
+
+
+latency_registry & get_latency_registry() {
+    static latency_registry registry;
+    return registry;
+}
+
+} //anon namespace
+
+
+namespace gdg {
+
+namespace srl {
+
+
+latency_histogram::latency_histogram() : counts_(bucketCount) {
+    reset();
+}
+
+
+void latency_histogram::record(chrono::nanoseconds value) {
+    record(value, 1);
+}
+
+
+void latency_histogram::record(chrono::nanoseconds value, uint64_t count) {
+    if (!count)
+        return;
+    auto const ns = static_cast<uint64_t>(std::max(value.count(), chrono::nanoseconds::rep{0}));
+    counts_[bucket_index(ns)] += count;
+    count_ += count;
+    min_ = std::min(min_, ns);
+    max_ = std::max(max_, ns);
+    sum_ += static_cast<double>(ns) * count;
+}
+
+
+latency_histogram
+latency_histogram::corrected_for_coordinated_omission(chrono::nanoseconds expectedInterval) const {
+    latency_histogram corrected;
+    auto const interval = static_cast<uint64_t>(expectedInterval.count());
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        if (!counts_[i])
+            continue;
+        auto const value = std::min(std::max(bucket_highest_value(i), min_), max_);
+        corrected.record(chrono::nanoseconds(value), counts_[i]);
+        if (!interval)
+            continue;
+        for (auto missing = value - std::min(value, interval); missing >= interval; missing -= interval)
+            corrected.record(chrono::nanoseconds(missing), counts_[i]);
+    }
+    return corrected;
+}
+
+
+void latency_histogram::merge(latency_histogram const & other) {
+    for (size_t i = 0; i < counts_.size(); ++i)
+        counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+
+void latency_histogram::reset() {
+    fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    min_ = numeric_limits<uint64_t>::max();
+    max_ = 0;
+    sum_ = 0;
+}
+
+
+chrono::nanoseconds latency_histogram::min() const {
+    return chrono::nanoseconds(count_ ? min_ : 0);
+}
+
+
+chrono::nanoseconds latency_histogram::max() const {
+    return chrono::nanoseconds(max_);
+}
+
+
+chrono::nanoseconds latency_histogram::mean() const {
+    return chrono::nanoseconds(count_ ? static_cast<uint64_t>(sum_ / count_) : 0);
+}
+
+
+chrono::nanoseconds latency_histogram::percentile(double percentile) const {
+    if (!count_)
+        return chrono::nanoseconds::zero();
+    if (percentile <= 0)
+        return min();
+    auto const rank =
+        std::max<uint64_t>(1, static_cast<uint64_t>(ceil(std::min(percentile, 100.0) / 100.0 * count_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        seen += counts_[i];
+        if (seen >= rank)
+            return chrono::nanoseconds(std::min(std::max(bucket_highest_value(i), min_), max_));
+    }
+    return max();
+}
+
+
+void record_latency(string const & host, request_timings const & timings) {
+    if (!request_timings::enabled)
+        return;
+    auto & registry = get_latency_registry();
+    lock_guard<mutex> lock(registry.mtx);
+    auto & stats = registry.hosts[host];
+    stats.dns.record(timings.dns());
+    stats.connect.record(timings.connect());
+    stats.write.record(timings.write());
+    stats.firstByte.record(timings.first_byte());
+    stats.body.record(timings.body());
+    stats.total.record(timings.total());
+}
+
+
+map<string, host_latency_stats> snapshot_latency_stats() {
+    auto & registry = get_latency_registry();
+    lock_guard<mutex> lock(registry.mtx);
+    return registry.hosts;
+}
+
+
+chrono::nanoseconds total_latency_percentile(string const & host, double percentile, uint64_t minSamples) {
+    auto & registry = get_latency_registry();
+    lock_guard<mutex> lock(registry.mtx);
+    auto const it = registry.hosts.find(host);
+    if (it == registry.hosts.end() || it->second.total.count() < max<uint64_t>(minSamples, 1))
+        return chrono::nanoseconds::zero();
+    return it->second.total.percentile(percentile);
+}
+
+
+void reset_latency_stats() {
+    auto & registry = get_latency_registry();
+    lock_guard<mutex> lock(registry.mtx);
+    registry.hosts.clear();
+}
+
+
+TEST_CASE("latency histogram percentiles") {
+    latency_histogram histogram;
+    CHECK(histogram.percentile(99) == chrono::nanoseconds::zero());
+
+    for (int i = 1; i <= 1000; ++i)
+        histogram.record(chrono::microseconds(i));
+    CHECK(histogram.count() == 1000);
+    CHECK(histogram.min() == chrono::microseconds(1));
+    CHECK(histogram.max() == chrono::microseconds(1000));
+    CHECK(histogram.mean() == chrono::nanoseconds(500500));
+
+    auto const within = [](chrono::nanoseconds value, chrono::nanoseconds expected) {
+        return value >= expected && value - expected <= expected / 64;
+    };
+    CHECK(within(histogram.percentile(50), chrono::microseconds(500)));
+    CHECK(within(histogram.percentile(99), chrono::microseconds(990)));
+    CHECK(histogram.percentile(100) == chrono::microseconds(1000));
+    CHECK(histogram.percentile(0) == chrono::microseconds(1));
+
+    latency_histogram other;
+    other.record(chrono::seconds(2));
+    histogram.merge(other);
+    CHECK(histogram.count() == 1001);
+    CHECK(histogram.max() == chrono::seconds(2));
+    CHECK(histogram.percentile(100) == chrono::seconds(2));
+
+    histogram.reset();
+    CHECK(histogram.count() == 0);
+}
+
+
+TEST_CASE("latency histogram coordinated omission correction") {
+    latency_histogram histogram;
+    histogram.record(chrono::milliseconds(1), 99);
+    histogram.record(chrono::milliseconds(100));
+
+    auto const corrected = histogram.corrected_for_coordinated_omission(chrono::milliseconds(1));
+    //The 100ms stall hid 99 requests that would have waited 99ms, 98ms ... 1ms
+    CHECK(corrected.count() == 199);
+    CHECK(corrected.max() == chrono::milliseconds(100));
+    CHECK(histogram.percentile(90) < chrono::milliseconds(2));
+    CHECK(corrected.percentile(90) > chrono::milliseconds(70));
+
+    CHECK(histogram.corrected_for_coordinated_omission(chrono::seconds(1)).count() == 100);
+}
+
+
+TEST_CASE("request timings feed per host stats") {
+    reset_latency_stats();
+    request_timings timings;
+    timings.mark_start();
+    timings.mark_resolved();
+    timings.mark_connected();
+    timings.mark_request_written();
+    timings.mark_first_byte();
+    timings.mark_completed();
+    CHECK(timings.total() == timings.dns() + timings.connect() + timings.write()
+                             + timings.first_byte() + timings.body());
+
+    record_latency("www.boost.org", timings);
+    auto const stats = snapshot_latency_stats();
+    if (request_timings::enabled) {
+        CHECK(stats.size() == 1);
+        CHECK(stats.at("www.boost.org").total.count() == 1);
+        CHECK(total_latency_percentile("www.boost.org", 99) == stats.at("www.boost.org").total.max());
+        CHECK(total_latency_percentile("www.boost.org", 99, 2) == chrono::nanoseconds::zero());
+    }
+    else {
+        CHECK(stats.empty());
+        CHECK(timings.total() == request_timings::clock::duration::zero());
+    }
+    reset_latency_stats();
+}
+
+} //ns srl
+
+} //ns gdg
@@ -0,0 +1,159 @@
+#ifndef GDG_SRL_TIMINGS_HPP_
+#define GDG_SRL_TIMINGS_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef SRL_ENABLE_TIMINGS
+#define SRL_ENABLE_TIMINGS 1
+#endif
+
+namespace gdg {
+
+namespace srl {
+
+/** Timestamps taken at the phase boundaries of a request.
+
+    With SRL_ENABLE_TIMINGS=0 (meson option timings=false) the struct is empty,
+    marking a phase does nothing and every phase duration is zero.
+ */
+struct request_timings {
+    using clock = std::chrono::steady_clock;
+
+    static constexpr bool enabled = SRL_ENABLE_TIMINGS;
+
+    void mark_start() { mark(start_); }
+    void mark_resolved() { mark(resolved_); }
+    void mark_connected() { mark(connected_); }
+    void mark_request_written() { mark(requestWritten_); }
+    void mark_first_byte() { mark(firstByte_); }
+    void mark_completed() { mark(completed_); }
+
+    /** Name resolution */
+    clock::duration dns() const { return between(start_, resolved_); }
+    /** TCP handshake */
+    clock::duration connect() const { return between(resolved_, connected_); }
+    /** Writing the request into the socket */
+    clock::duration write() const { return between(connected_, requestWritten_); }
+    /** From the request written to the response headers received */
+    clock::duration first_byte() const { return between(requestWritten_, firstByte_); }
+    /** Body transfer */
+    clock::duration body() const { return between(firstByte_, completed_); }
+    /** Whole request */
+    clock::duration total() const { return between(start_, completed_); }
+
+private:
+#if SRL_ENABLE_TIMINGS
+    using stamp = clock::time_point;
+
+    static void mark(stamp & point) { point = clock::now(); }
+
+    static clock::duration between(stamp from, stamp to) {
+        return from == stamp{} || to == stamp{} ? clock::duration::zero() : to - from;
+    }
+
+    stamp start_, resolved_, connected_, requestWritten_, firstByte_, completed_;
+#else
+    using stamp = int;
+
+    static void mark(stamp) {}
+
+    static clock::duration between(stamp, stamp) { return clock::duration::zero(); }
+
+    static constexpr stamp start_ = 0, resolved_ = 0, connected_ = 0,
+        requestWritten_ = 0, firstByte_ = 0, completed_ = 0;
+#endif
+};
+
+
+/** Latency histogram with buckets of logarithmic magnitude, in the manner of HdrHistogram.
+
+    Values are nanoseconds, kept with a relative error below 1/64 up to about 2 hours.
+    Larger values are recorded as the largest trackable value.
+ */
+class latency_histogram {
+public:
+    latency_histogram();
+
+    void record(std::chrono::nanoseconds value);
+
+    /** Records count occurrences of value */
+    void record(std::chrono::nanoseconds value, std::uint64_t count);
+
+    /** Copy of this histogram corrected for coordinated omission, as HdrHistogram does.
+
+        For every value v larger than expectedInterval, the values v - expectedInterval,
+        v - 2 * expectedInterval... down to expectedInterval are added: the requests that
+        a closed loop would have sent while it was stalled waiting for v.
+     */
+    latency_histogram corrected_for_coordinated_omission(std::chrono::nanoseconds expectedInterval) const;
+
+    /** Adds the values of other to this histogram */
+    void merge(latency_histogram const & other);
+
+    void reset();
+
+    std::uint64_t count() const { return count_; }
+    std::chrono::nanoseconds min() const;
+    std::chrono::nanoseconds max() const;
+    std::chrono::nanoseconds mean() const;
+
+    /** Value below which percentile % of the recorded values are. Zero if empty.
+
+        @percentile[in] in the range [0, 100]
+     */
+    std::chrono::nanoseconds percentile(double percentile) const;
+
+private:
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t count_;
+    std::uint64_t min_;
+    std::uint64_t max_;
+    double sum_;
+};
+
+
+/** Latency of each phase of the successful requests to a host
+ */
+struct host_latency_stats {
+    latency_histogram dns;
+    latency_histogram connect;
+    latency_histogram write;
+    latency_histogram firstByte;
+    latency_histogram body;
+    latency_histogram total;
+};
+
+
+/** Adds timings to the latency stats of host. Does nothing if timings are disabled.
+ */
+void record_latency(std::string const & host, request_timings const & timings);
+
+
+/** Copy of the latency stats recorded for every host so far
+ */
+std::map<std::string, host_latency_stats> snapshot_latency_stats();
+
+
+/** Percentile of the total latency of the successful requests to host, read without
+    copying the stats. Zero if fewer than minSamples requests to host were recorded.
+ */
+std::chrono::nanoseconds total_latency_percentile(std::string const & host,
+                                                  double percentile,
+                                                  std::uint64_t minSamples = 1);
+
+
+/** Forgets the latency stats of every host
+ */
+void reset_latency_stats();
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
@@ -0,0 +1,158 @@
+#include "gdg/srl/url.hpp"
+#include <stdexcept>
+#include <string>
+
+#include "doctest/doctest.h"
+
+
+using namespace std;
+using namespace gdg::srl;
+
+
+namespace {
+
+
+bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+
+[[noreturn]] void throw_invalid(string_view_t url) {
+    throw invalid_argument("Invalid URL " + string(url));
+}
+
+
+//Length of the scheme of url, followed by "://", or zero if url has none
+size_t scheme_size(string_view_t url) {
+    if (url.empty() || !is_alpha(url[0]))
+        return 0;
+    size_t i = 1;
+    while (i < url.size() && (is_alpha(url[i]) || is_digit(url[i]) || url[i] == '+' || url[i] == '-' || url[i] == '.'))
+        ++i;
+    return url.substr(i, 3) == "://" ? i : 0;
+}
+
+
+} //anon namespace
+
+
+namespace gdg {
+
+namespace srl {
+
+
+url_view parse_url(string_view_t url) {
+    for (char c : url) {
+        if (static_cast<unsigned char>(c) <= ' ' || c == 0x7f)
+            throw_invalid(url);
+    }
+    url_view parts;
+    auto rest = url;
+    auto const schemeSize = scheme_size(url);
+    if (schemeSize) {
+        parts.scheme = url.substr(0, schemeSize);
+        rest = url.substr(schemeSize + 3);
+    }
+    else if (rest.substr(0, 2) == "//") {
+        rest = rest.substr(2);
+    }
+
+    auto const authorityEnd = rest.find_first_of("/?#");
+    auto authority = rest.substr(0, authorityEnd);
+    rest = authorityEnd == string_view_t::npos ? string_view_t() : rest.substr(authorityEnd);
+    auto const at = authority.rfind('@');
+    if (at != string_view_t::npos) {
+        parts.userinfo = authority.substr(0, at);
+        authority = authority.substr(at + 1);
+    }
+    parts.authority = authority;
+
+    size_t portColon = string_view_t::npos;
+    if (!authority.empty() && authority[0] == '[') {
+        auto const close = authority.find(']');
+        if (close == string_view_t::npos || close == 1)
+            throw_invalid(url);
+        parts.host = authority.substr(1, close - 1);
+        if (close + 1 < authority.size()) {
+            if (authority[close + 1] != ':')
+                throw_invalid(url);
+            portColon = close + 1;
+        }
+    }
+    else {
+        portColon = authority.find(':');
+        parts.host = authority.substr(0, portColon);
+    }
+    if (parts.host.empty())
+        throw_invalid(url);
+    if (portColon != string_view_t::npos) {
+        parts.port = authority.substr(portColon + 1);
+        unsigned long port = 0;
+        for (char c : parts.port) {
+            if (!is_digit(c) || (port = port * 10 + (c - '0')) > 65535)
+                throw_invalid(url);
+        }
+        if (parts.port.empty())
+            throw_invalid(url);
+    }
+
+    auto const hash = rest.find('#');
+    if (hash != string_view_t::npos) {
+        parts.fragment = rest.substr(hash + 1);
+        rest = rest.substr(0, hash);
+    }
+    parts.resource = rest;
+    auto const question = rest.find('?');
+    parts.path = rest.substr(0, question);
+    if (question != string_view_t::npos)
+        parts.query = rest.substr(question + 1);
+    return parts;
+}
+
+
+TEST_CASE("parse url") {
+    auto url = parse_url("http://user:pw@www.boost.org:8080/doc/libs?v=1_74#asio");
+    CHECK(url.scheme == "http");
+    CHECK(url.userinfo == "user:pw");
+    CHECK(url.host == "www.boost.org");
+    CHECK(url.port == "8080");
+    CHECK(url.authority == "www.boost.org:8080");
+    CHECK(url.path == "/doc/libs");
+    CHECK(url.query == "v=1_74");
+    CHECK(url.fragment == "asio");
+    CHECK(url.resource == "/doc/libs?v=1_74");
+
+    url = parse_url("http://fossilinsects.myspecies.info");
+    CHECK(url.host == "fossilinsects.myspecies.info");
+    CHECK(url.port.empty());
+    CHECK(url.resource.empty());
+
+    url = parse_url("HTTP://[::1]:80?q");
+    CHECK(url.scheme == "HTTP");
+    CHECK(url.host == "::1");
+    CHECK(url.authority == "[::1]:80");
+    CHECK(url.path.empty());
+    CHECK(url.query == "q");
+
+    url = parse_url("localhost:8080/health");
+    CHECK(url.scheme.empty());
+    CHECK(url.host == "localhost");
+    CHECK(url.port == "8080");
+    CHECK(url.path == "/health");
+
+    CHECK(parse_url("//127.0.0.1/").host == "127.0.0.1");
+
+    for (auto invalid : {"", "http://", "http:///x", "http://a:/", "http://a:70000/", "http://a:8x/",
+                         "http://[::1/", "http://[::1]x/", "http://a b/", "http://a/\r\n"})
+        CHECK_THROWS_AS(parse_url(invalid), invalid_argument);
+}
+
+
+} //ns srl
+
+} //ns gdg
@@ -0,0 +1,48 @@
+#ifndef GDG_SRL_URL_HPP_
+#define GDG_SRL_URL_HPP_
+
+#include "gdg/srl/alias.hpp"
+
+namespace gdg {
+
+namespace srl {
+
+/** Components of a URL (RFC 3986), as views of the string parsed.
+
+    Components not present in the URL are empty.
+ */
+struct url_view {
+    /** As written, without "://". Empty for URLs without scheme, as in "www.boost.org/x" */
+    string_view_t scheme;
+    /** Before the "@" of the authority */
+    string_view_t userinfo;
+    /** Name or address of the host, without the brackets of IPv6 addresses */
+    string_view_t host;
+    /** Digits after the colon that follows the host */
+    string_view_t port;
+    /** Host and port as written, brackets included: the host taken by \ref async_http_get */
+    string_view_t authority;
+    string_view_t path;
+    /** After the "?" */
+    string_view_t query;
+    /** After the "#" */
+    string_view_t fragment;
+    /** Path and query ("/x?y"): the resource taken by \ref async_http_get. Empty if both are */
+    string_view_t resource;
+};
+
+
+/** Splits url in its components, without allocating or decoding anything.
+
+    Throws std::invalid_argument if url has no host, has spaces or control characters,
+    or has a malformed scheme, IPv6 address or port.
+ */
+url_view parse_url(string_view_t url);
+
+
+} //ns srl
+
+} //ns gdg
+
+
+#endif
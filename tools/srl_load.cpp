@@ -0,0 +1,331 @@
+//Load generator built on the simple requests library, in the manner of wrk/wrk2.
+
+#include "gdg/srl/srl.hpp"
+#include "gdg/srl/exceptions.hpp"
+#include <docopt/docopt.h>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace srl = gdg::srl;
+using namespace std;
+
+namespace {
+
+char const usage[] =
+R"(srl_load: HTTP load generator built on the simple requests library.
+
+Usage:
+  srl_load [options] <urls-file>
+  srl_load (-h | --help)
+
+Each line of <urls-file> is a URL to GET, as host[:port][/path] with an
+optional http:// prefix, or as unix:/path/to.sock[:/path] for a server
+listening in a Unix domain socket. Requests go through the list in round robin.
+Each URL is parsed and its request serialized once, and its host resolved
+again at most every 30 seconds.
+
+By default the load is a closed loop: every one of the --concurrency
+callers sends its next request as soon as the previous one completes.
+Callers are not threads: each one sends its next request from the thread of
+the loop where the previous one completed, so --threads sets how many threads
+do the work, whatever the concurrency. Connections are kept alive and reused,
+one per caller, as wrk does, unless --no-keep-alive is given.
+With --rate, requests are scheduled at a constant rate (open loop) and
+latency is measured from the time each request was scheduled, so that a
+stalled server is not hidden by callers that stop sending (coordinated omission).
+
+Options:
+  -h --help               Show this screen.
+  -c --concurrency=<n>    Requests in flight at most [default: 16].
+  -d --duration=<s>       Seconds to generate load [default: 10].
+  -n --requests=<n>       Stop after this many requests instead of after --duration.
+  -t --threads=<n>        Threads running the event loop [default: 1].
+  -r --rate=<rps>         Constant rate in requests per second (open loop).
+  --timeout=<s>           Timeout of each request in seconds [default: 30].
+  --no-keep-alive         Close each connection after its response.
+)";
+
+
+srl::prepared_request parse_target(string const & line) {
+    if (line.compare(0, 5, "unix:") == 0) {
+        auto const colon = line.find(':', 5);
+        if (colon == string::npos)
+            return {line, "/"};
+        return {line.substr(0, colon), line.substr(colon + 1)};
+    }
+    return srl::prepared_request(line);
+}
+
+
+vector<srl::prepared_request> load_targets(string const & path) {
+    ifstream input(path);
+    if (!input)
+        throw runtime_error("Cannot open " + path);
+    vector<srl::prepared_request> targets;
+    string line;
+    while (getline(input, line)) {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && line[0] != '#')
+            targets.push_back(parse_target(line));
+    }
+    if (targets.empty())
+        throw runtime_error(path + " has no URLs");
+    return targets;
+}
+
+
+string error_kind(exception_ptr error) {
+    try {
+        rethrow_exception(error);
+    }
+    catch (srl::timeout_exception const &) {
+        return "timeout";
+    }
+    catch (srl::bad_request_exception const & e) {
+        return "status " + to_string(e.errorCode);
+    }
+    catch (boost::system::system_error const & e) {
+        return "socket: " + e.code().message();
+    }
+    catch (exception const & e) {
+        return string("other: ") + e.what();
+    }
+    catch (...) {
+        return "unknown";
+    }
+}
+
+
+//What each caller measured
+struct caller_stats {
+    srl::latency_histogram latency;
+    srl::latency_histogram serviceTime;
+    size_t completed = 0;
+    size_t bodyBytes = 0;
+    map<string, size_t> errors;
+};
+
+
+//The callers of a run. Each one sends a request, and the next one from the callback of
+//the previous, so that no thread waits on a request in flight
+class load_run {
+public:
+    struct settings {
+        size_t concurrency = 1;
+        bool countLimited = false;
+        size_t maxRequests = 0;
+        bool openLoop = false;
+        chrono::duration<double> period{0};
+        chrono::steady_clock::duration timeOut{};
+    };
+
+    load_run(srl::client & client, vector<srl::prepared_request> const & targets, settings s)
+        : client_(client), targets_(targets), settings_(s), stats_(s.concurrency),
+          running_(s.concurrency) {
+        for (size_t i = 0; i < s.concurrency; ++i)
+            timers_.push_back(make_unique<srl::net::steady_timer>(client.io()));
+    }
+
+    //Starts the callers, and waits until all of them are done, until duration if the
+    //number of requests is not limited
+    void run(chrono::steady_clock::duration duration) {
+        start_ = chrono::steady_clock::now();
+        end_ = start_ + duration;
+        for (size_t i = 0; i < settings_.concurrency; ++i)
+            next(i);
+        finished_.get_future().wait();
+    }
+
+    chrono::steady_clock::time_point start() const { return start_; }
+
+    vector<caller_stats> const & stats() const { return stats_; }
+
+private:
+    void next(size_t caller) {
+        auto const request = nextRequest_++;
+        if (request >= settings_.maxRequests) {
+            stop();
+            return;
+        }
+        if (!settings_.openLoop) {
+            send(caller, request, chrono::steady_clock::now());
+            return;
+        }
+        //In open loop every request has its slot in the schedule,
+        //whether or not a caller is free to send it on time
+        auto const scheduled = start_ + chrono::duration_cast<chrono::steady_clock::duration>
+            (settings_.period * static_cast<double>(request));
+        auto & timer = *timers_[caller];
+        timer.expires_at(scheduled);
+        timer.async_wait([this, caller, request, scheduled](boost::system::error_code) {
+                send(caller, request, scheduled);
+            });
+    }
+
+    void send(size_t caller, size_t request, chrono::steady_clock::time_point scheduled) {
+        if (!settings_.countLimited && scheduled >= end_) {
+            stop();
+            return;
+        }
+        auto const sent = chrono::steady_clock::now();
+        client_.async_http_get(targets_[request % targets_.size()], settings_.timeOut,
+                               [this, caller, scheduled, sent](future<srl::response> result) {
+                auto & mine = stats_[caller];
+                try {
+                    mine.bodyBytes += result.get().second.size();
+                    ++mine.completed;
+                }
+                catch (...) {
+                    ++mine.errors[error_kind(current_exception())];
+                }
+                auto const done = chrono::steady_clock::now();
+                mine.latency.record(done - scheduled);
+                mine.serviceTime.record(done - sent);
+                next(caller);
+            });
+    }
+
+    void stop() {
+        if (--running_ == 0)
+            finished_.set_value();
+    }
+
+    srl::client & client_;
+    vector<srl::prepared_request> const & targets_;
+    settings const settings_;
+    //Each one touched only by its caller, which has one request at a time
+    vector<caller_stats> stats_;
+    vector<unique_ptr<srl::net::steady_timer>> timers_;
+    atomic<size_t> nextRequest_{0};
+    atomic<size_t> running_;
+    promise<void> finished_;
+    chrono::steady_clock::time_point start_;
+    chrono::steady_clock::time_point end_;
+};
+
+
+void print_latency(char const * title, srl::latency_histogram const & latency) {
+    auto const ms = [](chrono::nanoseconds d) { return d.count() / 1e6; };
+    printf("  %s (ms)\n", title);
+    printf("    %8s %8s %8s %8s %8s %8s %8s %8s\n",
+           "mean", "50%", "75%", "90%", "99%", "99.9%", "99.99%", "max");
+    printf("    %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+           ms(latency.mean()), ms(latency.percentile(50)), ms(latency.percentile(75)),
+           ms(latency.percentile(90)), ms(latency.percentile(99)), ms(latency.percentile(99.9)),
+           ms(latency.percentile(99.99)), ms(latency.max()));
+}
+
+} //anon namespace
+
+
+int main(int argc, char ** argv) {
+    auto args = docopt::docopt(usage, {argv + 1, argv + argc}, true);
+
+    vector<srl::prepared_request> targets;
+    try {
+        targets = load_targets(args["<urls-file>"].asString());
+    }
+    catch (exception const & e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    size_t const concurrency = max(1L, args["--concurrency"].asLong());
+    size_t const threads = max(1L, args["--threads"].asLong());
+    bool const countLimited = static_cast<bool>(args["--requests"]);
+    size_t const maxRequests =
+        countLimited ? args["--requests"].asLong() : numeric_limits<size_t>::max();
+    auto const duration = chrono::seconds(args["--duration"].asLong());
+    auto const timeOut = chrono::seconds(args["--timeout"].asLong());
+    bool const openLoop = static_cast<bool>(args["--rate"]);
+    double const rate = openLoop ? stod(args["--rate"].asString()) : 0;
+    if (openLoop && rate <= 0) {
+        cerr << "--rate must be greater than zero" << endl;
+        return 1;
+    }
+
+    srl::net::io_service io;
+    srl::net::io_service::work work{io};
+    vector<thread> loopThreads;
+    for (size_t i = 0; i < threads; ++i)
+        loopThreads.emplace_back([&io] { io.run(); });
+    bool const keepAlive = !args["--no-keep-alive"].asBool();
+    srl::client_options clientOptions;
+    clientOptions.reuseConnections = keepAlive;
+    //Each caller keeps its connection between its requests
+    clientOptions.pool.maxIdlePerHost = concurrency;
+    srl::client client(io, clientOptions);
+
+    if (countLimited)
+        printf("Running %zu requests", maxRequests);
+    else
+        printf("Running %llds test", static_cast<long long>(duration.count()));
+    printf(" @ %zu target(s), %zu in flight, %zu thread(s), %s, ", targets.size(), concurrency, threads,
+           keepAlive ? "keep-alive" : "no keep-alive");
+    if (openLoop)
+        printf("open loop at %.1f req/s\n", rate);
+    else
+        printf("closed loop\n");
+    fflush(stdout);
+
+    load_run::settings settings;
+    settings.concurrency = concurrency;
+    settings.countLimited = countLimited;
+    settings.maxRequests = maxRequests;
+    settings.openLoop = openLoop;
+    settings.period = chrono::duration<double>(openLoop ? 1 / rate : 0);
+    settings.timeOut = timeOut;
+    load_run load(client, targets, settings);
+    load.run(duration);
+    auto const elapsed = chrono::duration<double>(chrono::steady_clock::now() - load.start()).count();
+    io.stop();
+    for (auto & t : loopThreads)
+        t.join();
+
+    caller_stats total;
+    for (auto const & s : load.stats()) {
+        total.latency.merge(s.latency);
+        total.serviceTime.merge(s.serviceTime);
+        total.completed += s.completed;
+        total.bodyBytes += s.bodyBytes;
+        for (auto const & e : s.errors)
+            total.errors[e.first] += e.second;
+    }
+
+    size_t errorCount = 0;
+    for (auto const & e : total.errors)
+        errorCount += e.second;
+    printf("  %zu requests in %.2fs, %.2f MiB of body read\n",
+           total.completed + errorCount, elapsed, total.bodyBytes / (1024.0 * 1024.0));
+    printf("  Requests/sec: %.2f (%.2f successful)\n",
+           (total.completed + errorCount) / elapsed, total.completed / elapsed);
+
+    if (openLoop) {
+        print_latency("Latency from scheduled send, corrected for coordinated omission", total.latency);
+        print_latency("Service time, uncorrected", total.serviceTime);
+    }
+    else {
+        //A closed loop sends nothing while its callers wait, so stalls hide the requests
+        //that would have been sent. Correct as HdrHistogram does, with the median as
+        //the expected interval between requests of each caller.
+        print_latency("Latency, corrected for coordinated omission",
+                      total.latency.corrected_for_coordinated_omission
+                      (total.latency.percentile(50)));
+        print_latency("Latency, uncorrected", total.latency);
+    }
+
+    if (errorCount) {
+        printf("  Errors: %zu\n", errorCount);
+        for (auto const & e : total.errors)
+            printf("    %-40s %zu\n", e.first.c_str(), e.second);
+    }
+    return errorCount ? 2 : 0;
+}